@@ -1,6 +1,8 @@
 #! /usr/bin/env python
 
 # https://wiki.osdev.org/CRC32
+#
+# Run with --mdfs to regenerate software/MDFS/MDFS_crc_tables.h
 
 """
 //Fill the lookup table -- table = the lookup table base address
@@ -28,6 +30,39 @@ def generate_table(poly):
     return table
 
 
+def generate_slice_tables(table, n):
+    """Tables for slice-by-n, tables[0] is the regular table"""
+    tables = [table]
+    for k in range(1, n):
+        prev = tables[k-1]
+        tables.append([(prev[i] >> 8) ^ table[prev[i] & 0xFF] for i in range(256)])
+    return tables
+
+
+def multmodp(a, b, poly):
+    """a * b modulo poly, reflected"""
+    m = 1 << 31
+    p = 0
+    while True:
+        if a & m:
+            p ^= b
+            if (a & (m - 1)) == 0:
+                break
+        m >>= 1
+        b = (b >> 1) ^ poly if b & 1 else b >> 1
+    return p
+
+
+def generate_x2n_table(poly):
+    """x^(2^n) modulo poly for n = 0..31, reflected. Used for crc combine"""
+    table = []
+    p = 1 << 30  # x^1
+    for n in range(32):
+        table.append(p)
+        p = multmodp(p, p, poly)
+    return table
+
+
 def calc_crc(data, table):
     crc = 0xFFFFFFFF
     for x in data:
@@ -42,6 +77,40 @@ def print_table(t):
                 *t[i*4:i*4 + i + 4]))
     print("]")
 
-# example table for CRC32 (ethernet etc.)
-t = generate_table(0xEDB88320)
-print_table(t)
\ No newline at end of file
+def write_mdfs_tables(filename, poly, n):
+    tables = generate_slice_tables(generate_table(poly), n)
+    with open(filename, "w", newline="\r\n") as f:
+        f.write("/* Generated by crc32_table_gen.py --mdfs, do not edit.\n")
+        f.write(" *\n")
+        f.write(" * Slice-by-{} tables for polynomial 0x{:08X} (reflected).\n".format(n, poly))
+        f.write(" * Table 0 is the regular byte-wise table.\n")
+        f.write(" */\n")
+        f.write("#ifndef _MDFS_CRC_TABLES_H_\n")
+        f.write("#define _MDFS_CRC_TABLES_H_\n\n")
+        f.write("static const uint32_t _mdfs_crc_table[{}][256] = {{\n".format(n))
+        for k, t in enumerate(tables):
+            f.write("  {\n")
+            for i in range(256//4):
+                f.write("    0x{:08X}, 0x{:08X}, 0x{:08X}, 0x{:08X}{}\n".format(
+                        *t[i*4:i*4 + 4], "," if i < 256//4 - 1 else ""))
+            f.write("  }}{}\n".format("," if k < n - 1 else ""))
+        f.write("};\n\n")
+        f.write("// x^(2^n) modulo the polynomial, for combining crcs\n")
+        f.write("static const uint32_t _mdfs_crc_x2n_table[32] = {\n")
+        t = generate_x2n_table(poly)
+        for i in range(32//4):
+            f.write("  0x{:08X}, 0x{:08X}, 0x{:08X}, 0x{:08X}{}\n".format(
+                    *t[i*4:i*4 + 4], "," if i < 32//4 - 1 else ""))
+        f.write("};\n\n")
+        f.write("#endif // _MDFS_CRC_TABLES_H_\n")
+
+
+if __name__ == "__main__":
+    import sys
+    if "--mdfs" in sys.argv:
+        # 0x93a409eb in normal notation, see MDFS_CRC_POLY
+        write_mdfs_tables("software/MDFS/MDFS_crc_tables.h", 0xD79025C9, 8)
+    else:
+        # example table for CRC32 (ethernet etc.)
+        t = generate_table(0xEDB88320)
+        print_table(t)
\ No newline at end of file
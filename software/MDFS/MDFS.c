@@ -11,6 +11,49 @@ No write actions are performed.
 #include <ctype.h>
 
 #include "MDFS.h"
+#include "MDFS_crc_tables.h"
+#if MDFS_HAVE_PCLMUL || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+#if MDFS_USE_PTHREADS
+#include <pthread.h>
+#include <unistd.h>
+#endif
+#if MDFS_USE_MMAP
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#if MDFS_THREAD_SAFE
+// Errors go to a buffer per thread, like errno
+static __thread char _mdfs_thread_error[MDFS_ERROR_LEN];
+#define _MDFS_ERROR_BUF(mdfs) (_mdfs_thread_error)
+// The lock is released when the variable goes out of scope, so every return
+// of a function that takes it unlocks.
+static void _mdfs_unlock(mdfs_t** locked) { pthread_rwlock_unlock(&(*locked)->lock); }
+#define _MDFS_READ_LOCK(mdfs) mdfs_t* _mdfs_locked __attribute__((cleanup(_mdfs_unlock))) = \
+  (pthread_rwlock_rdlock(&(mdfs)->lock), (mdfs))
+#define _MDFS_WRITE_LOCK(mdfs) mdfs_t* _mdfs_locked __attribute__((cleanup(_mdfs_unlock))) = \
+  (pthread_rwlock_wrlock(&(mdfs)->lock), (mdfs))
+#define _MDFS_POOL_LOCK(mdfs) pthread_mutex_lock(&(mdfs)->pool_lock)
+#define _MDFS_POOL_UNLOCK(mdfs) pthread_mutex_unlock(&(mdfs)->pool_lock)
+#define _MDFS_CACHE_LOCK(cache) pthread_mutex_lock(&(cache)->lock)
+#define _MDFS_CACHE_UNLOCK(cache) pthread_mutex_unlock(&(cache)->lock)
+#define _MDFS_DEVICE_LOCK(mdfs) pthread_mutex_lock(&(mdfs)->device_lock)
+#define _MDFS_DEVICE_UNLOCK(mdfs) pthread_mutex_unlock(&(mdfs)->device_lock)
+#else
+#define _MDFS_ERROR_BUF(mdfs) ((mdfs)->error)
+#define _MDFS_READ_LOCK(mdfs) do {} while (0)
+#define _MDFS_WRITE_LOCK(mdfs) do {} while (0)
+#define _MDFS_POOL_LOCK(mdfs) do {} while (0)
+#define _MDFS_POOL_UNLOCK(mdfs) do {} while (0)
+#define _MDFS_CACHE_LOCK(cache) do {} while (0)
+#define _MDFS_CACHE_UNLOCK(cache) do {} while (0)
+#define _MDFS_DEVICE_LOCK(mdfs) do {} while (0)
+#define _MDFS_DEVICE_UNLOCK(mdfs) do {} while (0)
+#endif
 
 
 
@@ -36,14 +79,115 @@ No write actions are performed.
  */
 static int _mdfs_build_file_list(mdfs_t* mdfs);
 static int _mdfs_get_file_index(mdfs_t* mdfs, const char* filename);
-static mdfs_file_t* _mdfs_alloc_entry(const char* filename, int filesize, uint32_t byte_offset);
+static void _mdfs_init_entry(mdfs_file_t* entry, const char* filename, int filesize, uint32_t byte_offset);
+static int _mdfs_open_into(mdfs_t* mdfs, const char* filename, const char* mode, mdfs_FILE* fd);
 static int _mdfs_insert(mdfs_t* mdfs, mdfs_file_t* entry, int index);
+static void _mdfs_verify(mdfs_FILE* f, const void* data, uint32_t start, uint32_t n);
+static void _mdfs_index_rebuild(mdfs_t* mdfs);
+static void _mdfs_index_add(mdfs_t* mdfs, int i);
+static void _mdfs_index_delete(mdfs_t* mdfs, int i);
+static void _mdfs_index_move(mdfs_t* mdfs, int from, int to);
+static mdfs_FILE* _mdfs_alloc_file(mdfs_t* mdfs);
+static void _mdfs_release_file(mdfs_FILE* f);
+static const char* _mdfs_open_filename(mdfs_FILE* f);
+static int _mdfs_reserve(mdfs_t* mdfs, uint32_t count);
+static int _mdfs_make_writable(mdfs_t* mdfs);
+static void _mdfs_load_direct(mdfs_t* mdfs);
+static int _mdfs_entry_valid(const mdfs_t* mdfs, const mdfs_file_t* entry);
+static int _mdfs_in_image(const mdfs_t* mdfs, const mdfs_file_t* entry);
+static void _mdfs_extents_rebuild(mdfs_t* mdfs);
+static uint32_t _mdfs_find_space(mdfs_t* mdfs, uint32_t size, uint32_t align, int* gap_pos);
+static void _mdfs_extent_take(mdfs_t* mdfs, int gap_pos, uint32_t offset, uint32_t size);
+static uint32_t _mdfs_batch_add(mdfs_t* mdfs, const char* filename, int32_t size, uint32_t target, int gap_pos);
+static int _mdfs_batch_remove(mdfs_t* mdfs, const char* filename);
+static int _mdfs_batch_rename(mdfs_t* mdfs, const char* filename, const char* newname);
+static int _mdfs_dev_read(mdfs_t* mdfs, uint32_t offset, void* dst, uint32_t n);
+static const void* _mdfs_dev_view(mdfs_t* mdfs, uint32_t offset, uint32_t* n);
+static int _mdfs_crc_at(mdfs_t* mdfs, uint32_t offset, uint32_t size, uint32_t* crc);
+static int _mdfs_read_at(mdfs_FILE* f, void* dst, uint32_t offset, uint32_t n);
+static void _mdfs_aio_free(struct MDFSAio* aio);
+static void _mdfs_readahead(mdfs_FILE* f, uint32_t n);
+static int _mdfs_read_next(mdfs_FILE* f, void* ptr, uint32_t n);
+
+// file_list only grows (see _mdfs_reserve), removing an entry never reallocs
+#define _MDFS_INCREMENT_FILE_COUNT(mdfs) (_mdfs_reserve(mdfs, mdfs->file_count + 1) ? -1 : (int)++mdfs->file_count)
+#define _MDFS_MIN_CAPACITY (16)
+typedef struct MDFSRename {
+  char from[MDFS_MAX_FILENAME]; // First so the struct compares like a name
+  char to[MDFS_MAX_FILENAME];
+  int done; // Only the first occurence is renamed
+} _mdfs_rename_t;
+
+// Changes queued between mdfs_begin_batch and mdfs_commit_batch
+struct MDFSBatch {
+  mdfs_file_t* adds; // Placed already, merged into file_list on commit
+  uint32_t add_count;
+  uint32_t add_capacity;
+  char (*removes)[MDFS_MAX_FILENAME];
+  uint32_t remove_count;
+  uint32_t remove_capacity;
+  _mdfs_rename_t* renames;
+  uint32_t rename_count;
+  uint32_t rename_capacity;
+  uint32_t end; // First byte after the last add
+};
+
+// Blocks read through mdfs_init_ex, least recently used is evicted
+#define _MDFS_CACHE_EMPTY (0xFFFFFFFF)
+struct MDFSCache {
+  uint32_t block_size; // Power of 2
+  uint32_t count; // Number of blocks
+  uint32_t last; // Slot of the last hit, checked first
+  uint64_t clock; // Stamp of the last use
+  uint32_t* tags; // Device block in each slot, _MDFS_CACHE_EMPTY when unused
+  uint64_t* stamps; // clock at last use of each slot, 0 when unused
+  uint8_t* data; // count * block_size bytes
+#if MDFS_THREAD_SAFE
+  pthread_mutex_t lock;
+#endif
+};
+#define _MDFS_DEVICE_CHUNK (1024) // Bytes on the stack for crcs over a device
 
-#define _MDFS_INCREMENT_FILE_COUNT(mdfs) mdfs->file_list = (mdfs_file_t*)realloc((void*)mdfs->file_list, ++mdfs->file_count * sizeof(mdfs_file_t) + MDFS_EXTRA_CRC_SIZE)
-#define _MDFS_DECREMENT_FILE_COUNT(mdfs) mdfs->file_list = (mdfs_file_t*)realloc((void*)mdfs->file_list, --mdfs->file_count * sizeof(mdfs_file_t) + MDFS_EXTRA_CRC_SIZE)
-#define _mdfs_free_entry(entry) free(entry)
+#define _MDFS_ALIGN_UP(offset, align) (((offset) + (align) - 1) & ~((align) - 1))
+#define _MDFS_CRC_POLY_REFLECTED (0xD79025C9) // MDFS_CRC_POLY, bit 31 is x^0
 
 
+/* Set up the fields of a fresh mdfs_t, file_list is left to the caller */
+static void _mdfs_init_common(mdfs_t* mdfs, const void* target)
+{
+	mdfs->target = target;
+	mdfs->target_size = 0;
+	mdfs->file_list = NULL;
+	mdfs->file_count = 0;
+	mdfs->file_capacity = 0;
+	mdfs->flags = 0;
+	mdfs->alloc_policy = MDFS_ALLOC_FIRST_FIT;
+	mdfs->alloc_rover = MDFS_BLOCKSIZE;
+	mdfs->batch = NULL;
+	memset((void*)&mdfs->device, 0, sizeof(mdfs->device));
+	mdfs->cache = NULL;
+	mdfs->aio = NULL;
+#if MDFS_USE_EXTENT_MAP
+	mdfs->extent_count = 0;
+	mdfs->free_end = MDFS_BLOCKSIZE;
+#endif
+	memset((void*)mdfs->error, 0, MDFS_ERROR_LEN);
+#if MDFS_THREAD_SAFE
+	pthread_rwlock_init(&mdfs->lock, NULL);
+	pthread_mutex_init(&mdfs->pool_lock, NULL);
+	pthread_mutex_init(&mdfs->device_lock, NULL);
+#endif
+	memset((void*)mdfs->file_pool, 0, sizeof(mdfs->file_pool)); // MDFS_STATE_CLOSED
+	// Chain all handles in the pool into the free list
+	int i;
+	mdfs->free_files = NULL;
+	for (i = MDFS_FILE_POOL_SIZE - 1; i >= 0; --i)
+	{
+		mdfs->file_pool[i].next_free = mdfs->free_files;
+		mdfs->free_files = &mdfs->file_pool[i];
+	}
+}
+
 /** @brief Returns an initialized mdfs instance
  * 
  * @copybrief MDFS_init_simple
@@ -54,14 +198,359 @@ static int _mdfs_insert(mdfs_t* mdfs, mdfs_file_t* entry, int index);
  */
 mdfs_t* mdfs_init_simple(const void* target) {
 	mdfs_t* mdfs = (mdfs_t*)malloc(sizeof(mdfs_t));
-	mdfs->target = target;
-	mdfs->file_list = (mdfs_file_t*)calloc(2, sizeof(uint32_t)); // room for crc
-	mdfs->file_count = 0;
-	memset((void*)mdfs->error, 0, MDFS_ERROR_LEN);
+	if (mdfs == NULL) return NULL;
+	_mdfs_init_common(mdfs, target);
 	_mdfs_build_file_list(mdfs);
 	return mdfs;
 }
 
+/** @brief Returns an mdfs instance that never allocates memory
+ * 
+ * @copybrief mdfs_init_static
+ * Like @ref mdfs_init_simple, but mdfs_t and the file list live in workspace.
+ * The file list has a fixed capacity of MDFS_MAX_FILECOUNT and open files 
+ * only come from the pool of MDFS_FILE_POOL_SIZE handles, so no call ever 
+ * mallocs. @ref mdfs_fopen fails with EMFILE when the pool is empty.
+ * @ref mdfs_verify_all checks one file after the other on the calling thread.
+ * @ref mdfs_fread_async isn't available, it fails with ENOTSUP.
+ * 
+ * @param target Absolute flash address of block 0
+ * @param workspace Buffer of at least MDFS_WORKSPACE_SIZE bytes. Must stay 
+ * valid until @ref mdfs_deinit.
+ * @param workspace_size Size of workspace in bytes
+ * @returns The mdfs (somewhere in workspace), NULL if workspace is too small.
+ * @ingroup mdfs
+ */
+mdfs_t* mdfs_init_static(const void* target, void* workspace, size_t workspace_size)
+{
+  if (workspace == NULL || workspace_size < MDFS_WORKSPACE_SIZE) return NULL;
+  // MDFS_WORKSPACE_SIZE includes room to align
+  uintptr_t p = ((uintptr_t)workspace + 7) & ~(uintptr_t)7;
+  mdfs_t* mdfs = (mdfs_t*)p;
+  _mdfs_init_common(mdfs, target);
+  mdfs->flags = MDFS_FLAG_STATIC;
+  mdfs->file_list = (mdfs_file_t*)(p + sizeof(mdfs_t));
+  mdfs->file_capacity = MDFS_MAX_FILECOUNT;
+  _mdfs_build_file_list(mdfs);
+  return mdfs;
+}
+
+/** @brief Returns an mdfs instance that uses the file list in block 0 as is
+ * 
+ * @copybrief mdfs_init_direct
+ * Like @ref mdfs_init_simple, but the entries aren't copied to RAM. This 
+ * works when block 0 holds the list as the builder writes it: valid entries 
+ * from index 0, followed by an entry with size 0 and the list crc. Otherwise 
+ * this falls back to copying the valid entries like mdfs_init_simple.
+ * 
+ * The list is copied the first time it's changed (@ref mdfs_add_file, 
+ * @ref mdfs_remove_file, @ref mdfs_rename_file, @ref mdfs_set_crc, 
+ * @ref mdfs_update_crc), block 0 is never written.
+ * 
+ * Only the copy is saved: init still checks every entry once and hashes the 
+ * names into the filename index. The free space map is built on the first 
+ * mdfs_add_file or mdfs_remove_file.
+ * 
+ * @param target Absolute flash address of block 0
+ * @ingroup mdfs
+ */
+mdfs_t* mdfs_init_direct(const void* target)
+{
+  mdfs_t* mdfs = (mdfs_t*)malloc(sizeof(mdfs_t));
+  if (mdfs == NULL) return NULL;
+  _mdfs_init_common(mdfs, target);
+  _mdfs_load_direct(mdfs);
+  return mdfs;
+}
+
+/* Use the list in block 0 in place when possible, see mdfs_init_direct */
+static void _mdfs_load_direct(mdfs_t* mdfs)
+{
+  const mdfs_file_t* fs_list = (const mdfs_file_t*)mdfs->target;
+  uint32_t count = 0;
+  while (count < MDFS_MAX_FILECOUNT && _mdfs_entry_valid(mdfs, &fs_list[count])) ++count;
+  if (count == 0 || fs_list[count].size != 0)
+  {
+    // Holes or no terminator, only a copy gives the list we expect
+    _mdfs_build_file_list(mdfs);
+    return;
+  }
+  mdfs->flags |= MDFS_FLAG_DIRECT;
+  mdfs->file_list = (mdfs_file_t*)fs_list; // Only read until _mdfs_make_writable
+  mdfs->file_count = count;
+  mdfs->file_capacity = count;
+  _mdfs_index_rebuild(mdfs);
+#if MDFS_USE_EXTENT_MAP
+  mdfs->flags |= MDFS_FLAG_EXTENTS_STALE; // Not needed to read files
+#endif
+}
+
+/** @brief Returns an mdfs instance that reads through a callback
+ * 
+ * @copybrief mdfs_init_ex
+ * For storage that isn't memory mapped (SPI flash, SD card, a file on the 
+ * host). Block 0 and all file data are read with device->read, through a 
+ * cache of device->cache_blocks blocks of device->cache_block bytes when 
+ * cache_blocks isn't 0. On a miss the least recently used block is replaced.
+ * Reads of whole blocks that aren't cached go straight to the caller's 
+ * buffer, so streaming a big file doesn't flush the cache.
+ * 
+ * @ref mdfs_get_file_location returns NULL for such an mdfs. Views from 
+ * @ref mdfs_fpeek point into the cache and end at a cache block boundary.
+ * device->read is called by one thread at a time, also with MDFS_THREAD_SAFE 
+ * and mdfs_fread_async.
+ * 
+ * @param device Read function and cache settings, copied
+ * @returns The mdfs, NULL on failure with errno set: EINVAL for a bad 
+ * device, ENOMEM, or EIO when block 0 can't be read.
+ * @ingroup mdfs
+ */
+mdfs_t* mdfs_init_ex(const mdfs_device_t* device)
+{
+  uint32_t block_size = device ? device->cache_block : 0;
+  if (block_size == 0) block_size = MDFS_CACHE_BLOCK;
+  if (device == NULL || device->read == NULL || (block_size & (block_size - 1)))
+  {
+    errno = EINVAL;
+    return NULL;
+  }
+  mdfs_t* mdfs = (mdfs_t*)malloc(sizeof(mdfs_t));
+  if (mdfs == NULL)
+  {
+    errno = ENOMEM;
+    return NULL;
+  }
+  _mdfs_init_common(mdfs, NULL);
+  mdfs->flags = MDFS_FLAG_DEVICE;
+  mdfs->device = *device;
+  mdfs->device.cache_block = block_size;
+  mdfs->target_size = device->size;
+  if (device->cache_blocks > 0)
+  {
+    uint32_t n = device->cache_blocks;
+    // One allocation, the data is aligned to 64 bytes behind the tables
+    size_t tables = (sizeof(struct MDFSCache) + n * (sizeof(uint64_t) + sizeof(uint32_t)) + 63) & ~(size_t)63;
+    struct MDFSCache* c = (struct MDFSCache*)malloc(tables + 63 + (size_t)n * block_size);
+    if (c == NULL)
+    {
+      free(mdfs);
+      errno = ENOMEM;
+      return NULL;
+    }
+    c->block_size = block_size;
+    c->count = n;
+    c->last = 0;
+    c->clock = 0;
+    c->stamps = (uint64_t*)(c + 1);
+    c->tags = (uint32_t*)(c->stamps + n);
+    c->data = (uint8_t*)(((uintptr_t)c + tables + 63) & ~(uintptr_t)63);
+    memset((void*)c->stamps, 0, n * sizeof(uint64_t));
+    memset((void*)c->tags, 0xFF, n * sizeof(uint32_t)); // _MDFS_CACHE_EMPTY
+#if MDFS_THREAD_SAFE
+    pthread_mutex_init(&c->lock, NULL);
+#endif
+    mdfs->cache = c;
+  }
+  if (_mdfs_build_file_list(mdfs) < 0)
+  {
+    mdfs_deinit(mdfs);
+    errno = EIO;
+    return NULL;
+  }
+  return mdfs;
+}
+
+/* Call device.read, one thread at a time. With a cache the cache lock is 
+ * held as well, always taken before this one. */
+static int _mdfs_device_call(mdfs_t* mdfs, uint32_t offset, uint32_t n, void* buf)
+{
+  _MDFS_DEVICE_LOCK(mdfs);
+  int result = mdfs->device.read(mdfs->device.ctx, offset, n, buf);
+  _MDFS_DEVICE_UNLOCK(mdfs);
+  return result;
+}
+
+/* Returns the cache slot holding device block or -1 */
+static int _mdfs_cache_find(struct MDFSCache* c, uint32_t block)
+{
+  if (c->tags[c->last] == block) return (int)c->last;
+  uint32_t i;
+  for (i = 0; i < c->count; ++i)
+  {
+    if (c->tags[i] == block) return (int)i;
+  }
+  return -1;
+}
+
+/* Returns the cache slot holding device block, read from the device on a 
+ * miss. -1 when the device fails. The cache lock is held.
+ */
+static int _mdfs_cache_get(mdfs_t* mdfs, uint32_t block)
+{
+  struct MDFSCache* c = mdfs->cache;
+  int slot = _mdfs_cache_find(c, block);
+  if (slot < 0)
+  {
+    // Replace the least recently used, unused slots have stamp 0
+    uint32_t i;
+    slot = 0;
+    for (i = 1; i < c->count; ++i)
+    {
+      if (c->stamps[i] < c->stamps[slot]) slot = (int)i;
+    }
+    uint64_t start = (uint64_t)block * c->block_size;
+    uint32_t n = c->block_size;
+    // Don't read past the end of the device, the rest of the slot isn't used
+    if (mdfs->target_size && start + n > mdfs->target_size) n = (uint32_t)(mdfs->target_size - start);
+    c->tags[slot] = _MDFS_CACHE_EMPTY;
+    c->stamps[slot] = 0;
+    if (_mdfs_device_call(mdfs, (uint32_t)start, n, c->data + (size_t)slot * c->block_size)) return -1;
+    c->tags[slot] = block;
+  }
+  c->stamps[slot] = ++c->clock;
+  c->last = (uint32_t)slot;
+  return slot;
+}
+
+/* Read n bytes at offset from the device of mdfs_init_ex, through the cache
+ * when there is one. Returns 0 on success, -1 when the device failed.
+ */
+static int _mdfs_dev_read(mdfs_t* mdfs, uint32_t offset, void* dst, uint32_t n)
+{
+  struct MDFSCache* c = mdfs->cache;
+  if (c == NULL) return _mdfs_device_call(mdfs, offset, n, dst) ? -1 : 0;
+  uint8_t* out = (uint8_t*)dst;
+  int result = 0;
+  _MDFS_CACHE_LOCK(c);
+  while (n > 0 && result == 0)
+  {
+    uint32_t block = offset / c->block_size;
+    uint32_t start = offset & (c->block_size - 1);
+    uint32_t len = c->block_size - start;
+    if (len > n) len = n;
+    if (len == c->block_size && _mdfs_cache_find(c, block) < 0)
+    {
+      // All whole blocks in one go, they're not worth caching
+      len = n & ~(c->block_size - 1);
+      if (_mdfs_device_call(mdfs, offset, len, out)) result = -1;
+    }
+    else
+    {
+      int slot = _mdfs_cache_get(mdfs, block);
+      if (slot < 0) result = -1;
+      else memcpy(out, c->data + (size_t)slot * c->block_size + start, len);
+    }
+    offset += len;
+    out += len;
+    n -= len;
+  }
+  _MDFS_CACHE_UNLOCK(c);
+  return result;
+}
+
+/* Pointer to the cached bytes at offset for views, *n is cut to the end of
+ * the cache block. Valid until the next read from the mdfs by any thread, the
+ * cache lock isn't held after this returns. NULL without a 
+ * cache (errno ENOTSUP) or when the device fails (errno EIO).
+ */
+static const void* _mdfs_dev_view(mdfs_t* mdfs, uint32_t offset, uint32_t* n)
+{
+  struct MDFSCache* c = mdfs->cache;
+  if (c == NULL)
+  {
+    errno = ENOTSUP;
+    return NULL;
+  }
+  uint32_t start = offset & (c->block_size - 1);
+  if (*n > c->block_size - start) *n = c->block_size - start;
+  _MDFS_CACHE_LOCK(c);
+  int slot = _mdfs_cache_get(mdfs, offset / c->block_size);
+  _MDFS_CACHE_UNLOCK(c);
+  if (slot < 0)
+  {
+    errno = EIO;
+    return NULL;
+  }
+  return c->data + (size_t)slot * c->block_size + start;
+}
+
+/* crc of size bytes at offset, from memory or the device.
+ * Returns 0 on success, -1 when the device failed.
+ */
+static int _mdfs_crc_at(mdfs_t* mdfs, uint32_t offset, uint32_t size, uint32_t* crc)
+{
+  if (!(mdfs->flags & MDFS_FLAG_DEVICE))
+  {
+    *crc = mdfs_calc_crc(mdfs_get_file_location(mdfs, offset), size);
+    return 0;
+  }
+  uint8_t buf[_MDFS_DEVICE_CHUNK];
+  mdfs_crc_t ctx;
+  mdfs_crc_init(&ctx);
+  while (size > 0)
+  {
+    uint32_t n = size < sizeof(buf) ? size : sizeof(buf);
+    if (_mdfs_dev_read(mdfs, offset, buf, n)) return -1;
+    mdfs_crc_update(&ctx, buf, n);
+    offset += n;
+    size -= n;
+  }
+  *crc = mdfs_crc_final(&ctx);
+  return 0;
+}
+
+#if MDFS_USE_MMAP
+/** @brief Open an image file on the host
+ * 
+ * @copybrief mdfs_open_image
+ * Maps the file read only and uses it like @ref mdfs_init_direct. The whole 
+ * file is read in up front (MAP_POPULATE where available) so reads don't 
+ * page fault. Files that don't fit in the image file are left out of the 
+ * list. Call @ref mdfs_deinit to unmap.
+ * 
+ * @param path Image file, e.g. from mdfs_mkimage
+ * @returns The mdfs, NULL on failure with errno set.
+ * @ingroup mdfs
+ */
+mdfs_t* mdfs_open_image(const char* path)
+{
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) return NULL;
+  struct stat st;
+  if (fstat(fd, &st))
+  {
+    close(fd);
+    return NULL;
+  }
+  if (st.st_size < MDFS_BLOCKSIZE)
+  {
+    close(fd);
+    errno = EINVAL;
+    return NULL;
+  }
+  int flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+  flags |= MAP_POPULATE;
+#endif
+  void* map = mmap(NULL, st.st_size, PROT_READ, flags, fd, 0);
+  close(fd); // The mapping stays
+  if (map == MAP_FAILED) return NULL;
+  madvise(map, st.st_size, MADV_WILLNEED);
+  mdfs_t* mdfs = (mdfs_t*)malloc(sizeof(mdfs_t));
+  if (mdfs == NULL)
+  {
+    munmap(map, st.st_size);
+    errno = ENOMEM;
+    return NULL;
+  }
+  _mdfs_init_common(mdfs, map);
+  mdfs->target_size = st.st_size;
+  mdfs->flags = MDFS_FLAG_IMAGE;
+  _mdfs_load_direct(mdfs);
+  return mdfs;
+}
+#endif
+
 /* Returns 0 whe name is printable, not length 0 or > max */
 static int _check_name(const char* name)
 {
@@ -77,9 +566,73 @@ static int _check_name(const char* name)
   else return 0;
 }
 
+/** @brief Make sure file_list has room for count entries
+ * 
+ * Grows to at least double the current capacity so adding files one by one
+ * doesn't realloc every time. There's always room for the size 0 + crc after
+ * the last entry.
+ * @returns 0 on success, -1 when out of memory (file_list is unchanged then)
+ */
+static int _mdfs_reserve(mdfs_t* mdfs, uint32_t count)
+{
+  if (mdfs->file_list != NULL && count <= mdfs->file_capacity) return 0;
+  if (mdfs->flags & MDFS_FLAG_STATIC) return -1; // Fixed size
+  uint32_t capacity = mdfs->file_capacity * 2;
+  if (capacity < _MDFS_MIN_CAPACITY) capacity = _MDFS_MIN_CAPACITY;
+  if (capacity > MDFS_MAX_FILECOUNT) capacity = MDFS_MAX_FILECOUNT;
+  if (capacity < count) capacity = count;
+  void* p = realloc((void*)mdfs->file_list, capacity * sizeof(mdfs_file_t) + MDFS_EXTRA_CRC_SIZE);
+  if (p == NULL) return -1;
+  mdfs->file_list = (mdfs_file_t*)p;
+  mdfs->file_capacity = capacity;
+  return 0;
+}
+
+/* Copy a direct file list from block 0 to RAM so it can be changed.
+ * Returns 0 on success (or when the list is already in RAM), -1 when out of memory.
+ */
+static int _mdfs_make_writable(mdfs_t* mdfs)
+{
+  if (!(mdfs->flags & MDFS_FLAG_DIRECT)) return 0;
+  mdfs_file_t* fs_list = mdfs->file_list;
+  mdfs->file_list = NULL;
+  mdfs->file_capacity = 0;
+  if (_mdfs_reserve(mdfs, mdfs->file_count))
+  {
+    mdfs->file_list = fs_list;
+    mdfs->file_capacity = mdfs->file_count;
+    snprintf(_MDFS_ERROR_BUF(mdfs), MDFS_ERROR_LEN, "Out of memory");
+    return -1;
+  }
+  // Entries plus the size 0 and crc behind them
+  memcpy((void*)mdfs->file_list, (void*)fs_list, mdfs->file_count * sizeof(mdfs_file_t) + MDFS_EXTRA_CRC_SIZE);
+  mdfs->flags &= ~MDFS_FLAG_DIRECT;
+  return 0;
+}
+
+/* Returns 1 when the data of entry is inside the image, always when the size
+ * of the image isn't known */
+static int _mdfs_in_image(const mdfs_t* mdfs, const mdfs_file_t* entry)
+{
+  return mdfs->target_size == 0 || 
+    (uint64_t)entry->byte_offset + entry->size <= mdfs->target_size;
+}
+
+/* Returns 1 when the entry in block 0 looks like a real file */
+static int _mdfs_entry_valid(const mdfs_t* mdfs, const mdfs_file_t* entry)
+{
+  // Check sanity of filesize and offset
+  if (entry->size <= 0 || entry->size > MDFS_MAX_FILESIZE) return 0;
+  if (entry->byte_offset < MDFS_BLOCKSIZE) return 0;
+  if (!_mdfs_in_image(mdfs, entry)) return 0;
+  // Check filename for non-ascii chars before \0 or weird length
+  return _check_name(entry->filename) ? 0 : 1;
+}
+
 static void _mdfs_update_file_list_crc(mdfs_t* mdfs)
 {
   if (mdfs->file_count <= 0) return;
+  if (mdfs->flags & MDFS_FLAG_DIRECT) return; // Never write to block 0
   // size 0 is appended to end of file list to make builder stop
   // next 4 bytes is CRC
   // The space is already allocated
@@ -95,7 +648,8 @@ static void _mdfs_update_file_list_crc(mdfs_t* mdfs)
  * @copybrief MDFS_build_file_list
  *
  * @param mdfs Initialized instance of mdfs_t, see @ref MDFS_open_simple.
- * @returns Number of files in the list.
+ * @returns Number of files in the list, -1 when block 0 can't be read from 
+ * the device (mdfs_init_ex).
  *
  * @todo discard entry if size or offset don't make sense, or if filename contains non-ascii or doesn't end in \0
  * 
@@ -103,59 +657,98 @@ static void _mdfs_update_file_list_crc(mdfs_t* mdfs)
  */
 static int _mdfs_build_file_list(mdfs_t* mdfs)
 {
-	// for 
-	// if entry at i size != 0
-	//   if index >= file_count
-	//     resize file_list
-	//   
-    //   allocate new file_list entry and memcpy from fs
+  // Count first so file_list is allocated once, then copy the valid entries
+  const mdfs_file_t* fs_list = (const mdfs_file_t*)mdfs->target;
+  void* block0 = NULL; // Copy of block 0 read from the device
+  if (mdfs->flags & MDFS_FLAG_DEVICE)
+  {
+    block0 = malloc(MDFS_BLOCKSIZE);
+    if (block0 == NULL || _mdfs_dev_read(mdfs, 0, block0, MDFS_BLOCKSIZE))
+    {
+      snprintf(_MDFS_ERROR_BUF(mdfs), MDFS_ERROR_LEN, block0 ? "Device read failed" : "Out of memory");
+      free(block0);
+      return -1;
+    }
+    fs_list = (const mdfs_file_t*)block0;
+  }
 	int i;
 	int count = 0;
 	for (i = 0; i < MDFS_MAX_FILECOUNT; ++i)
 	{
+    if (_mdfs_entry_valid(mdfs, &fs_list[i])) ++count;
+  }
+  if (_mdfs_reserve(mdfs, count))
+  {
+    snprintf(_MDFS_ERROR_BUF(mdfs), MDFS_ERROR_LEN, "Out of memory");
+  }
+  count = 0;
+	for (i = 0; i < MDFS_MAX_FILECOUNT && count < mdfs->file_capacity; ++i)
+	{
     // Grab the entry from the array in block 0 (which starts at mdfs->target)
-    mdfs_file_t* target = &((mdfs_file_t*)mdfs->target)[i];
-    // printf("[%i] s=%i, o=0x%08X\n", i, target->size, target->byte_offset);
-    // Check sanity of filesize and offset
-		if (
-      (target->size > 0) &&
-      (target->size <= MDFS_MAX_FILESIZE) &&
-      (target->byte_offset >= MDFS_BLOCKSIZE)
-    )
+    // printf("[%i] s=%i, o=0x%08X\n", i, fs_list[i].size, fs_list[i].byte_offset);
+		if (_mdfs_entry_valid(mdfs, &fs_list[i]))
 		{
-      // Check filename for non-ascii chars before \0 or weird length
-      if (_check_name(target->filename)) continue;
       // Everything makes sense, add it to the list
-			if (i >= mdfs->file_count) _MDFS_INCREMENT_FILE_COUNT(mdfs);
-			memcpy((void*)&mdfs->file_list[count], &((mdfs_file_t*)mdfs->target)[i], sizeof(mdfs_file_t));
-			// // Force last char in name \0
-			// mdfs->file_list[count]->filename[MDFS_MAX_FILENAME-1] = '\0';
+			memcpy((void*)&mdfs->file_list[count], &fs_list[i], sizeof(mdfs_file_t));
 			++count;
 		}
 	}
+  mdfs->file_count = count;
   // Copy crc from fs
-  uint32_t* fs_crc = (uint32_t*)(&((mdfs_file_t*)mdfs->target)[count]) + 1;
+  if (mdfs->file_list == NULL)
+  {
+    free(block0);
+    return 0;
+  }
+  uint32_t* fs_crc = (uint32_t*)(&fs_list[count]) + 1;
   uint32_t* mem_crc = ((uint32_t*)&mdfs->file_list[count]) + 1;
   *mem_crc = *fs_crc;
+  free(block0);
+  _mdfs_index_rebuild(mdfs);
+  _mdfs_extents_rebuild(mdfs);
 	return count;
 }
 
 /** @brief Close/Deinitialize mdfs
  * 
- * @todo just free filelist?
+ * Open files from the pool are invalid after this.
+ * Reads of @ref mdfs_fread_async that already started are finished first,
+ * the rest is dropped. No callbacks are called.
  * @ingroup mdfs
  */
 void mdfs_deinit(mdfs_t* mdfs)
 {
-  int i = 0;
-  for (i = 0; i < mdfs->file_count; ++i)
-  {
-    //_mdfs_free_entry(mdfs->file_list[i]);
-  }
-  free(mdfs->file_list);
+  if (mdfs->batch != NULL) mdfs_abort_batch(mdfs);
+  if (mdfs->aio != NULL) _mdfs_aio_free(mdfs->aio);
+#if MDFS_THREAD_SAFE
+  pthread_rwlock_destroy(&mdfs->lock);
+  pthread_mutex_destroy(&mdfs->pool_lock);
+  pthread_mutex_destroy(&mdfs->device_lock);
+  if (mdfs->cache != NULL) pthread_mutex_destroy(&mdfs->cache->lock);
+#endif
+  free(mdfs->cache);
+  if (mdfs->flags & MDFS_FLAG_STATIC) return; // Everything is in the workspace
+  if (!(mdfs->flags & MDFS_FLAG_DIRECT)) free(mdfs->file_list);
+#if MDFS_USE_MMAP
+  if (mdfs->flags & MDFS_FLAG_IMAGE) munmap((void*)mdfs->target, mdfs->target_size);
+#endif
   free(mdfs);
 }
 
+#if MDFS_THREAD_SAFE
+/** @brief Get the last error of the calling thread
+ * 
+ * With MDFS_THREAD_SAFE every thread has its own error text (shared by all 
+ * mdfs instances), so an error of one thread doesn't overwrite another's.
+ * @ingroup mdfs
+ */
+const char* mdfs_get_error(mdfs_t* mdfs)
+{
+  (void)mdfs;
+  return _mdfs_thread_error;
+}
+#endif
+
 /** @brief Get the filename at index in the file_list
  *
  * @copybrief MDFS_get_filename
@@ -171,9 +764,10 @@ void mdfs_deinit(mdfs_t* mdfs)
  */
 int mdfs_get_filename(mdfs_t* mdfs, int index, char* buffer)
 {
+  _MDFS_READ_LOCK(mdfs);
 	if (index < 0 || index >= mdfs->file_count)
 	{
-		snprintf(mdfs->error, MDFS_ERROR_LEN, "Invalid index.");
+		snprintf(_MDFS_ERROR_BUF(mdfs), MDFS_ERROR_LEN, "Invalid index.");
 		return -1;
 	}
 	
@@ -183,9 +777,10 @@ int mdfs_get_filename(mdfs_t* mdfs, int index, char* buffer)
 
 int32_t mdfs_get_filesize(mdfs_t* mdfs, int index)
 {
+  _MDFS_READ_LOCK(mdfs);
 	if (index < 0 || index >= mdfs->file_count)
 	{
-		snprintf(mdfs->error, MDFS_ERROR_LEN, "Invalid index.");
+		snprintf(_MDFS_ERROR_BUF(mdfs), MDFS_ERROR_LEN, "Invalid index.");
 		return -1;
 	}
 	return mdfs->file_list[index].size;
@@ -193,9 +788,10 @@ int32_t mdfs_get_filesize(mdfs_t* mdfs, int index)
 
 uint32_t mdfs_get_file_offset(mdfs_t* mdfs, int index)
 {
+  _MDFS_READ_LOCK(mdfs);
 	if (index < 0 || index >= mdfs->file_count)
 	{
-		snprintf(mdfs->error, MDFS_ERROR_LEN, "Invalid index.");
+		snprintf(_MDFS_ERROR_BUF(mdfs), MDFS_ERROR_LEN, "Invalid index.");
 		return 0;
 	}
 	return mdfs->file_list[index].byte_offset;
@@ -203,14 +799,15 @@ uint32_t mdfs_get_file_offset(mdfs_t* mdfs, int index)
 
 uint32_t mdfs_get_file_crc(mdfs_t* mdfs, int index)
 {
+  _MDFS_READ_LOCK(mdfs);
   if (index < 0 || index >= mdfs->file_count)
   {
-		snprintf(mdfs->error, MDFS_ERROR_LEN, "Invalid index.");
+		snprintf(_MDFS_ERROR_BUF(mdfs), MDFS_ERROR_LEN, "Invalid index.");
 		return 0;
   }
   if (mdfs->file_list[index].crc == 0)
   {
-    snprintf(mdfs->error, MDFS_ERROR_LEN, "No crc set.");
+    snprintf(_MDFS_ERROR_BUF(mdfs), MDFS_ERROR_LEN, "No crc set.");
     return 0;
   }
   return mdfs->file_list[index].crc;
@@ -224,7 +821,9 @@ uint32_t mdfs_get_file_crc(mdfs_t* mdfs, int index)
  * 
  * Error text is written in case of failure.
  *
- * @remarks This function can recurse up to 511, make sure there is stack space.
+ * The file goes in a gap between files that's big enough (an exact fit 
+ * counts), which gap depends on @ref mdfs_set_alloc_policy. Otherwise it's 
+ * placed after the last file.
  * 
  * @param mdfs Pointer to initialized mdfs.
  * @param filename Name of the new file (will be truncated to MDFS_MAX_FILENAME-1)
@@ -236,59 +835,78 @@ uint32_t mdfs_get_file_crc(mdfs_t* mdfs, int index)
  */
 uint32_t mdfs_add_file(mdfs_t* mdfs, const char* filename, int32_t size)
 {
+  return mdfs_add_file_ex(mdfs, filename, size, MDFS_ALIGN_NONE);
+}
+
+/** @brief Add a file with its start aligned
+ * 
+ * @copybrief mdfs_add_file_ex
+ * Like @ref mdfs_add_file, but the byte offset of the file is a multiple of 
+ * align, e.g. MDFS_ALIGN_PAGE for DMA or MDFS_ALIGN_BLOCK so a file starts on 
+ * an erase block. Padding in front of the file stays free for smaller files.
+ * Only the start is aligned: add all files with MDFS_ALIGN_BLOCK so no two 
+ * files share an erase block and reflashing one leaves the others alone.
+ * 
+ * The offset is from the start of the FS, target itself should be aligned 
+ * at least as much for the addresses to be aligned.
+ * 
+ * @param align Power of 2, at most MDFS_BLOCKSIZE. MDFS_ALIGN_NONE to pack.
+ * @returns The offset like mdfs_add_file, 0 on failure.
+ * @ingroup mdfs
+ */
+uint32_t mdfs_add_file_ex(mdfs_t* mdfs, const char* filename, int32_t size, uint32_t align)
+{
+  _MDFS_WRITE_LOCK(mdfs);
   if (size <= 0) 
   {
-    snprintf(mdfs->error, MDFS_ERROR_LEN, "Invalid size");
+    snprintf(_MDFS_ERROR_BUF(mdfs), MDFS_ERROR_LEN, "Invalid size");
   	return 0;
   }
    
   if (_check_name(filename)) 
   {
-    snprintf(mdfs->error, MDFS_ERROR_LEN, "Invalid name");
+    snprintf(_MDFS_ERROR_BUF(mdfs), MDFS_ERROR_LEN, "Invalid name");
     return 0;
   }
 
-  int i = 0; // Insertion index in file_list.
-  uint32_t target = MDFS_BLOCKSIZE;  // Target byte offset for new file
-  mdfs_file_t* next_file = NULL;
-  while(1)
+  if (align == 0 || align > MDFS_BLOCKSIZE || (align & (align - 1)))
   {
-    
-    if (i < mdfs->file_count) // Check if there's a file at i
-    {
-      next_file = &mdfs->file_list[i];
-      if (target + size < next_file->byte_offset) // Is there room before it?
-      {
-        break;
-      }
-      else
-      {
-        // No room
-        target = next_file->byte_offset + next_file->size;
-        ++i;
-        continue;
-      }
-    }
-    else // We're at the end of the list
-    {
-      break;
-    }
+    snprintf(_MDFS_ERROR_BUF(mdfs), MDFS_ERROR_LEN, "Invalid alignment: %u", align);
+    return 0;
+  }
+
+  int gap_pos;
+  uint32_t target = _mdfs_find_space(mdfs, size, align, &gap_pos);
+  if (mdfs->batch != NULL) return _mdfs_batch_add(mdfs, filename, size, target, gap_pos);
+  // Insertion index in file_list: after every file that starts before target
+  int lo = 0, hi = mdfs->file_count;
+  while (lo < hi)
+  {
+    int mid = (lo + hi) / 2;
+    if (mdfs->file_list[mid].byte_offset <= target) lo = mid + 1;
+    else hi = mid;
   }
-  mdfs_file_t* new = _mdfs_alloc_entry(filename, size, target);
-  int error = _mdfs_insert(mdfs, new, i);
-  _mdfs_free_entry(new);
+  int i = lo;
+  mdfs_file_t new;
+  _mdfs_init_entry(&new, filename, size, target);
+  int error = _mdfs_insert(mdfs, &new, i);
   switch (error)
   {
   case -1:
-    snprintf(mdfs->error, MDFS_ERROR_LEN, "borked index?");
+    snprintf(_MDFS_ERROR_BUF(mdfs), MDFS_ERROR_LEN, "borked index?");
     return 0;
   case -2:
-    snprintf(mdfs->error, MDFS_ERROR_LEN, "No room in file list");
+    snprintf(_MDFS_ERROR_BUF(mdfs), MDFS_ERROR_LEN, "No room in file list");
+    return 0;
+  case -3:
+    snprintf(_MDFS_ERROR_BUF(mdfs), MDFS_ERROR_LEN, "Out of memory");
     return 0;
   case 0:
+    _mdfs_extent_take(mdfs, gap_pos, target, size);
+    mdfs->alloc_rover = target + size;
     return target;
   default:
-    snprintf(mdfs->error, MDFS_ERROR_LEN, "unknown error: %i", error);
+    snprintf(_MDFS_ERROR_BUF(mdfs), MDFS_ERROR_LEN, "unknown error: %i", error);
     return 0;
   }
 }
@@ -305,30 +923,116 @@ uint32_t mdfs_add_file(mdfs_t* mdfs, const char* filename, int32_t size)
  */
 int mdfs_remove_file(mdfs_t* mdfs, const char* filename)
 {
+  _MDFS_WRITE_LOCK(mdfs);
   if (_check_name(filename)) return 0;
-  // All indices must be populated
-  // so after removal we should shift entries around
-  int i, j;
+  if (mdfs->batch != NULL) return _mdfs_batch_remove(mdfs, filename);
+  // All indices must be populated, so every entry after a removed one moves
+  // forward by the number of removed entries before it. One pass, each 
+  // entry is moved at most once.
+  // Only the first occurence is in the index
+  int i = _mdfs_get_file_index(mdfs, filename);
+  if (i < 0 || _mdfs_make_writable(mdfs)) return 0;
+  _mdfs_index_delete(mdfs, i);
   int count = 0;
-  for (i = 0; i < mdfs->file_count; ++i)
+  for (; i < mdfs->file_count; ++i)
   {
-    if (strcmp(filename, mdfs->file_list[i].filename)) continue; // no match
-    // move all remaining entries 
-    for (j = i+1; j < mdfs->file_count; ++j)
+    if (strcmp(filename, mdfs->file_list[i].filename) == 0)
     {
-      memcpy((void*)&mdfs->file_list[j-1], (void*)&mdfs->file_list[j], sizeof(mdfs_file_t));
+      ++count;
+      continue;
+    }
+    if (count)
+    {
+      memcpy((void*)&mdfs->file_list[i-count], (void*)&mdfs->file_list[i], sizeof(mdfs_file_t));
+      _mdfs_index_move(mdfs, i, i - count);
     }
-    // Now decrement filelist
-    _MDFS_DECREMENT_FILE_COUNT(mdfs);
-    // We removed entry i, so decrement and continue
-    --i;
-    ++count;
   }
+  mdfs->file_count -= count;
   _mdfs_update_file_list_crc(mdfs);
+  _mdfs_extents_rebuild(mdfs);
   return count;
 }
 
 
+/** @brief Select where mdfs_add_file puts new files
+ * 
+ * @copybrief mdfs_set_alloc_policy
+ * - MDFS_ALLOC_FIRST_FIT: the gap with the lowest offset that fits (default)
+ * - MDFS_ALLOC_BEST_FIT: the smallest gap that fits
+ * - MDFS_ALLOC_NEXT_FIT: like first fit, but starting after the last added 
+ *   file and wrapping around
+ * 
+ * The extent map is ordered by size, so best fit is a binary search (plus a 
+ * few steps when alignment doesn't fit). First and next fit look at every gap
+ * that's large enough, O(gaps).
+ * 
+ * Files that don't fit in any gap go after the last file.
+ * @returns 0 on success, -1 for an unknown policy (error is set)
+ * @ingroup mdfs
+ */
+int mdfs_set_alloc_policy(mdfs_t* mdfs, int policy)
+{
+  _MDFS_WRITE_LOCK(mdfs);
+  if (policy < MDFS_ALLOC_FIRST_FIT || policy > MDFS_ALLOC_NEXT_FIT)
+  {
+    snprintf(_MDFS_ERROR_BUF(mdfs), MDFS_ERROR_LEN, "Unknown policy: %i", policy);
+    return -1;
+  }
+  mdfs->alloc_policy = policy;
+  return 0;
+}
+
+/** @brief Get statistics about the free space between files
+ * 
+ * @copybrief mdfs_get_free_stats
+ * gap_bytes is what a repack would win back, fragmentation tells how much of 
+ * it is unusable for one big file.
+ * Taken from the extent map, so space of files added in a batch is counted as
+ * used. The file list is walked when there's no map.
+ * @ingroup mdfs
+ */
+void mdfs_get_free_stats(mdfs_t* mdfs, mdfs_free_stats_t* stats)
+{
+  _MDFS_READ_LOCK(mdfs);
+  memset((void*)stats, 0, sizeof(mdfs_free_stats_t));
+  uint32_t i;
+#if MDFS_USE_EXTENT_MAP
+  if (!(mdfs->flags & MDFS_FLAG_EXTENTS_STALE))
+  {
+    stats->gap_count = mdfs->extent_count;
+    for (i = 0; i < mdfs->extent_count; ++i) stats->gap_bytes += mdfs->extents[i].size;
+    // Ordered by size
+    if (mdfs->extent_count) stats->largest_gap = mdfs->extents[mdfs->extent_count - 1].size;
+    stats->end_offset = mdfs->free_end;
+    if (stats->gap_bytes)
+    {
+      stats->fragmentation = 100 - (uint32_t)((uint64_t)stats->largest_gap * 100 / stats->gap_bytes);
+    }
+    return;
+  }
+#endif
+  // No map (yet, for mdfs_init_direct), walk the gaps between files
+  uint32_t end = MDFS_BLOCKSIZE;
+  for (i = 0; i < mdfs->file_count; ++i)
+  {
+    const mdfs_file_t* file = &mdfs->file_list[i];
+    if (file->byte_offset > end)
+    {
+      uint32_t gap = file->byte_offset - end;
+      ++stats->gap_count;
+      stats->gap_bytes += gap;
+      if (gap > stats->largest_gap) stats->largest_gap = gap;
+    }
+    if (file->byte_offset + file->size > end) end = file->byte_offset + file->size;
+  }
+  stats->end_offset = end;
+  if (stats->gap_bytes)
+  {
+    stats->fragmentation = 100 - (uint32_t)((uint64_t)stats->largest_gap * 100 / stats->gap_bytes);
+  }
+}
+
+
 /** @brief Rename a file
  * 
  * @copybrief mdfs_rename_file. Only the first occurence will be renamed.
@@ -338,231 +1042,1853 @@ int mdfs_remove_file(mdfs_t* mdfs, const char* filename)
  */
 int mdfs_rename_file(mdfs_t* mdfs, const char* filename, const char* newname)
 {
+  _MDFS_WRITE_LOCK(mdfs);
   if (_check_name(filename) || _check_name(newname))
   {
-    snprintf(mdfs->error, MDFS_ERROR_LEN, "Invalid name");
+    snprintf(_MDFS_ERROR_BUF(mdfs), MDFS_ERROR_LEN, "Invalid name");
     return 0;
   }
   
   int index = _mdfs_get_file_index(mdfs, filename);
   if (index < 0)
   {
-    snprintf(mdfs->error, MDFS_ERROR_LEN, "File not found");
+    snprintf(_MDFS_ERROR_BUF(mdfs), MDFS_ERROR_LEN, "File not found");
     return 0;
   }
+  if (mdfs->batch != NULL) return _mdfs_batch_rename(mdfs, filename, newname);
+  if (_mdfs_make_writable(mdfs)) return 0;
   printf("renaming %i (%s) to %s\n", index, filename, newname);
 
   // Copy newname, including \0
+  _mdfs_index_delete(mdfs, index);
   memcpy(mdfs->file_list[index].filename, newname, strlen(newname)+1);
+  _mdfs_index_add(mdfs, index);
+#if MDFS_USE_HASH_INDEX
+  // A later file with the old name is the first occurence now
+  int i;
+  for (i = index + 1; i < mdfs->file_count; ++i)
+  {
+    if (strcmp(mdfs->file_list[i].filename, filename) == 0)
+    {
+      _mdfs_index_add(mdfs, i);
+      break;
+    }
+  }
+#endif
   return 1;
 }
 
 
-/** @brief Open a file
- * 
- * @copybrief mdfs_fopen
- * Works like libc fopen
+/** @brief Start queueing changes to the file list
  * 
- * @param mdfs Initialized mdfs.
- * @param filename Filename to open (case sensitive)
- * @param mode Only "r" supported
+ * @copybrief mdfs_begin_batch
+ * Until @ref mdfs_commit_batch, @ref mdfs_add_file(_ex), @ref mdfs_remove_file 
+ * and @ref mdfs_rename_file only queue the change, so building a large list 
+ * doesn't shift entries and recompute the list crc on every call.
  * 
- * @remarks Call @ref mdfs_close when you're done
+ * - Adds are placed right away and return their offset, but space of queued 
+ *   removes isn't reused.
+ * - Removes and renames refer to the list as it was at mdfs_begin_batch, a
+ *   remove wins over a rename of the same name.
+ * - The list itself (mdfs_fopen, mdfs_get_filecount, ...) doesn't change 
+ *   until the commit.
  * 
+ * Needs malloc, so it's not available after mdfs_init_static.
+ * @returns 0 on success, -1 otherwise (error is set)
  * @ingroup mdfs
  */
-mdfs_FILE* mdfs_fopen(mdfs_t* mdfs, const char* filename, const char* mode)
+int mdfs_begin_batch(mdfs_t* mdfs)
 {
-  // Only allow all mode starting with r
-  if (mode[0] != 'r') 
+  _MDFS_WRITE_LOCK(mdfs);
+  if (mdfs->batch != NULL)
   {
-    snprintf(mdfs->error, MDFS_ERROR_LEN, "Unsupported mode: %s", mode);
-    errno = EINVAL;
-    return NULL;
+    snprintf(_MDFS_ERROR_BUF(mdfs), MDFS_ERROR_LEN, "Batch already started");
+    return -1;
   }
-  if (strcmp(filename, "stdin") == 0)
+  if (mdfs->flags & MDFS_FLAG_STATIC)
   {
-    mdfs_FILE* fd = malloc(sizeof(mdfs_FILE));
-    fd->index = -1;
-    return fd;
+    snprintf(_MDFS_ERROR_BUF(mdfs), MDFS_ERROR_LEN, "No batches in static mode");
+    return -1;
   }
-
-  int index = _mdfs_get_file_index(mdfs, filename);
-  if (index < 0)
+  mdfs->batch = (struct MDFSBatch*)calloc(1, sizeof(struct MDFSBatch));
+  if (mdfs->batch == NULL)
   {
-    snprintf(mdfs->error, MDFS_ERROR_LEN, "File not found");
-    errno = ENOENT;
-    return NULL;
+    snprintf(_MDFS_ERROR_BUF(mdfs), MDFS_ERROR_LEN, "Out of memory");
+    return -1;
   }
-  mdfs_FILE* fd = malloc(sizeof(mdfs_FILE));
-  // Set values and copy filename
-  fd->base = (void*)((uint32_t)mdfs->target + mdfs->file_list[index].byte_offset);
-  fd->offset = 0;
-  fd->size = mdfs->file_list[index].size;
-  fd->crc = mdfs->file_list[index].crc;
-  memcpy((void*)fd->filename, (void*)mdfs->file_list[index].filename, MDFS_MAX_FILENAME);
-  fd->index = index;
-  return fd;
+  return 0;
 }
 
-/** @brief Reopen file with different filename or mode
- * 
- * @ingroup mdfs
+/* Make room for one more element in a batch array */
+static int _mdfs_batch_grow(void** list, uint32_t* capacity, uint32_t count, size_t size)
+{
+  if (count < *capacity) return 0;
+  uint32_t new_capacity = *capacity ? *capacity * 2 : _MDFS_MIN_CAPACITY;
+  void* p = realloc(*list, new_capacity * size);
+  if (p == NULL) return -1;
+  *list = p;
+  *capacity = new_capacity;
+  return 0;
+}
+
+static uint32_t _mdfs_batch_add(mdfs_t* mdfs, const char* filename, int32_t size, uint32_t target, int gap_pos)
+{
+  struct MDFSBatch* b = mdfs->batch;
+  if (mdfs->file_count + b->add_count >= MDFS_MAX_FILECOUNT)
+  {
+    snprintf(_MDFS_ERROR_BUF(mdfs), MDFS_ERROR_LEN, "No room in file list");
+    return 0;
+  }
+  if (_mdfs_batch_grow((void**)&b->adds, &b->add_capacity, b->add_count, sizeof(mdfs_file_t)))
+  {
+    snprintf(_MDFS_ERROR_BUF(mdfs), MDFS_ERROR_LEN, "Out of memory");
+    return 0;
+  }
+  _mdfs_init_entry(&b->adds[b->add_count++], filename, size, target);
+  _mdfs_extent_take(mdfs, gap_pos, target, size);
+  mdfs->alloc_rover = target + size;
+  if (target + size > b->end) b->end = target + size;
+  return target;
+}
+
+/* Queue a remove, returns the number of files it will remove */
+static int _mdfs_batch_remove(mdfs_t* mdfs, const char* filename)
+{
+  struct MDFSBatch* b = mdfs->batch;
+  int i;
+  int count = 0;
+  for (i = 0; i < mdfs->file_count; ++i)
+  {
+    if (strcmp(filename, mdfs->file_list[i].filename) == 0) ++count;
+  }
+  if (count == 0) return 0;
+  if (_mdfs_batch_grow((void**)&b->removes, &b->remove_capacity, b->remove_count, MDFS_MAX_FILENAME))
+  {
+    snprintf(_MDFS_ERROR_BUF(mdfs), MDFS_ERROR_LEN, "Out of memory");
+    return 0;
+  }
+  strcpy(b->removes[b->remove_count++], filename);
+  return count;
+}
+
+static int _mdfs_batch_rename(mdfs_t* mdfs, const char* filename, const char* newname)
+{
+  struct MDFSBatch* b = mdfs->batch;
+  int i;
+  for (i = 0; i < b->rename_count; ++i)
+  {
+    if (strcmp(filename, b->renames[i].from) == 0)
+    {
+      snprintf(_MDFS_ERROR_BUF(mdfs), MDFS_ERROR_LEN, "Already renamed in batch");
+      return 0;
+    }
+  }
+  if (_mdfs_batch_grow((void**)&b->renames, &b->rename_capacity, b->rename_count, sizeof(_mdfs_rename_t)))
+  {
+    snprintf(_MDFS_ERROR_BUF(mdfs), MDFS_ERROR_LEN, "Out of memory");
+    return 0;
+  }
+  strcpy(b->renames[b->rename_count].from, filename);
+  strcpy(b->renames[b->rename_count].to, newname);
+  b->renames[b->rename_count].done = 0;
+  ++b->rename_count;
+  return 1;
+}
+
+/* Names, and renames by their from name */
+static int _mdfs_name_cmp(const void* a, const void* b)
+{
+  return strcmp((const char*)a, (const char*)b);
+}
+
+static int _mdfs_offset_cmp(const void* a, const void* b)
+{
+  uint32_t oa = ((const mdfs_file_t*)a)->byte_offset;
+  uint32_t ob = ((const mdfs_file_t*)b)->byte_offset;
+  return oa < ob ? -1 : (oa > ob ? 1 : 0);
+}
+
+/** @brief Apply the changes queued since mdfs_begin_batch
+ * 
+ * @copybrief mdfs_commit_batch
+ * Removes and renames are looked up in sorted lists during one pass over 
+ * file_list, the sorted adds are merged in with a second pass. The list crc 
+ * and the filename index are updated once.
+ * 
+ * @returns 0 on success, -1 otherwise (error is set). Nothing is changed 
+ * and the batch stays open when it fails.
+ * @ingroup mdfs
+ */
+int mdfs_commit_batch(mdfs_t* mdfs)
+{
+  _MDFS_WRITE_LOCK(mdfs);
+  struct MDFSBatch* b = mdfs->batch;
+  if (b == NULL)
+  {
+    snprintf(_MDFS_ERROR_BUF(mdfs), MDFS_ERROR_LEN, "No batch started");
+    return -1;
+  }
+  if (_mdfs_make_writable(mdfs)) return -1;
+  if (_mdfs_reserve(mdfs, mdfs->file_count + b->add_count))
+  {
+    snprintf(_MDFS_ERROR_BUF(mdfs), MDFS_ERROR_LEN, "Out of memory");
+    return -1;
+  }
+  if (b->remove_count) qsort((void*)b->removes, b->remove_count, MDFS_MAX_FILENAME, _mdfs_name_cmp);
+  if (b->rename_count) qsort((void*)b->renames, b->rename_count, sizeof(_mdfs_rename_t), _mdfs_name_cmp);
+  if (b->add_count) qsort((void*)b->adds, b->add_count, sizeof(mdfs_file_t), _mdfs_offset_cmp);
+  // Drop removed files and rename, moving the rest forward
+  int i, j;
+  int count = 0;
+  for (i = 0; i < mdfs->file_count; ++i)
+  {
+    mdfs_file_t* entry = &mdfs->file_list[i];
+    if (b->remove_count && bsearch(entry->filename, b->removes, b->remove_count,
+        MDFS_MAX_FILENAME, _mdfs_name_cmp)) continue;
+    _mdfs_rename_t* r = b->rename_count ? (_mdfs_rename_t*)bsearch(entry->filename, 
+      b->renames, b->rename_count, sizeof(_mdfs_rename_t), _mdfs_name_cmp) : NULL;
+    if (r != NULL && !r->done)
+    {
+      memcpy(entry->filename, r->to, strlen(r->to)+1);
+      r->done = 1;
+    }
+    if (count != i) memcpy((void*)&mdfs->file_list[count], (void*)entry, sizeof(mdfs_file_t));
+    ++count;
+  }
+  // Merge the adds in from the back, both are ordered by byte_offset
+  i = count - 1;
+  j = b->add_count - 1;
+  count += b->add_count;
+  int w = count - 1;
+  while (j >= 0)
+  {
+    if (i >= 0 && mdfs->file_list[i].byte_offset > b->adds[j].byte_offset)
+    {
+      memcpy((void*)&mdfs->file_list[w--], (void*)&mdfs->file_list[i--], sizeof(mdfs_file_t));
+    }
+    else
+    {
+      memcpy((void*)&mdfs->file_list[w--], (void*)&b->adds[j--], sizeof(mdfs_file_t));
+    }
+  }
+  mdfs->file_count = count;
+  _mdfs_update_file_list_crc(mdfs);
+  _mdfs_index_rebuild(mdfs);
+  _mdfs_extents_rebuild(mdfs);
+  mdfs->batch = NULL;
+  free(b->adds);
+  free(b->removes);
+  free(b->renames);
+  free(b);
+  return 0;
+}
+
+/** @brief Drop the changes queued since mdfs_begin_batch
+ * @ingroup mdfs
+ */
+void mdfs_abort_batch(mdfs_t* mdfs)
+{
+  _MDFS_WRITE_LOCK(mdfs);
+  struct MDFSBatch* b = mdfs->batch;
+  if (b == NULL) return;
+  mdfs->batch = NULL;
+  free(b->adds);
+  free(b->removes);
+  free(b->renames);
+  free(b);
+  _mdfs_extents_rebuild(mdfs); // Give back the space of the adds
+}
+
+
+/** @brief Open a file
+ * 
+ * @copybrief mdfs_fopen
+ * Works like libc fopen
+ * 
+ * @param mdfs Initialized mdfs.
+ * @param filename Filename to open (case sensitive)
+ * @param mode Only "r" supported. Add "v" (e.g. "rv") to check the crc while 
+ * reading: once the last byte is read @ref mdfs_ferror reports a mismatch,
+ * and @ref mdfs_fclose does too.
+ * 
+ * @remarks Call @ref mdfs_close when you're done
+ * 
+ * @ingroup mdfs
+ */
+mdfs_FILE* mdfs_fopen(mdfs_t* mdfs, const char* filename, const char* mode)
+{
+  // Only allow all mode starting with r
+  if (mode[0] != 'r') 
+  {
+    snprintf(_MDFS_ERROR_BUF(mdfs), MDFS_ERROR_LEN, "Unsupported mode: %s", mode);
+    errno = EINVAL;
+    return NULL;
+  }
+  mdfs_FILE* fd = _mdfs_alloc_file(mdfs);
+  if (fd == NULL)
+  {
+    snprintf(_MDFS_ERROR_BUF(mdfs), MDFS_ERROR_LEN, "Too many open files");
+    errno = EMFILE;
+    return NULL;
+  }
+  int error;
+  {
+    _MDFS_READ_LOCK(mdfs);
+    error = _mdfs_open_into(mdfs, filename, mode, fd);
+  }
+  if (error)
+  {
+    _mdfs_release_file(fd);
+    return NULL;
+  }
+  return fd;
+}
+
+/** @brief Reopen file with different filename or mode
+ * 
+ * @ingroup mdfs
  */
 mdfs_FILE* mdfs_freopen(mdfs_t* mdfs, const char* filename, const char* mode, mdfs_FILE* f)
 {
-  if (filename == NULL) filename = f->filename;
-  mdfs_FILE* new = mdfs_fopen(mdfs, filename, mode);
-  if (new == NULL) 
+  _MDFS_READ_LOCK(mdfs);
+  if (filename == NULL) filename = _mdfs_open_filename(f);
+  if (filename == NULL)
+  {
+    snprintf(_MDFS_ERROR_BUF(mdfs), MDFS_ERROR_LEN, "File not found");
+    errno = ENOENT;
+    mdfs_fclose(f);
+    return NULL;
+  }
+  if (_mdfs_open_into(mdfs, filename, mode, f))
+  {
+    mdfs_fclose(f);
+    return NULL;
+  }
+  return f;
+}
+
+/* Take a handle from the pool, O(1). When the pool is empty static instances
+ * fail, others fall back to malloc. Returns NULL when there's none left.
+ */
+static mdfs_FILE* _mdfs_alloc_file(mdfs_t* mdfs)
+{
+  _MDFS_POOL_LOCK(mdfs);
+  mdfs_FILE* f = mdfs->free_files;
+  if (f != NULL) mdfs->free_files = f->next_free;
+  _MDFS_POOL_UNLOCK(mdfs);
+  if (f == NULL && !(mdfs->flags & MDFS_FLAG_STATIC))
+  {
+    f = malloc(sizeof(mdfs_FILE));
+  }
+  if (f == NULL) return NULL;
+  f->mdfs = mdfs;
+  f->state = MDFS_STATE_OPEN;
+  return f;
+}
+
+/* Give a handle back to the pool (or free it), O(1) */
+static void _mdfs_release_file(mdfs_FILE* f)
+{
+  mdfs_t* mdfs = f->mdfs;
+  f->state = MDFS_STATE_CLOSED;
+  if (f >= mdfs->file_pool && f < mdfs->file_pool + MDFS_FILE_POOL_SIZE)
+  {
+    _MDFS_POOL_LOCK(mdfs);
+    f->next_free = mdfs->free_files;
+    mdfs->free_files = f;
+    _MDFS_POOL_UNLOCK(mdfs);
+  }
+  else
+  {
+    free(f);
+  }
+}
+
+/* Set fd up for reading filename, used by fopen and freopen. 
+ * Returns 0 on success, -1 when the file doesn't exist (errno and error set)
+ */
+static int _mdfs_open_into(mdfs_t* mdfs, const char* filename, const char* mode, mdfs_FILE* fd)
+{
+  if (strcmp(filename, "stdin") == 0)
+  {
+    fd->index = -1;
+    fd->base = NULL;
+    fd->byte_offset = 0;
+    fd->offset = 0;
+    fd->size = 0;
+    fd->crc = 0;
+    fd->flags = 0;
+    fd->ra_next = fd->ra_end = fd->ra_window = 0;
+    fd->getc_end = 0;
+    return 0;
+  }
+
+  int index = _mdfs_get_file_index(mdfs, filename);
+  if (index < 0)
+  {
+    snprintf(_MDFS_ERROR_BUF(mdfs), MDFS_ERROR_LEN, "File not found");
+    errno = ENOENT;
+    return -1;
+  }
+  if (!_mdfs_in_image(mdfs, &mdfs->file_list[index]))
+  {
+    // Added after mdfs_open_image, there's no data for it
+    snprintf(_MDFS_ERROR_BUF(mdfs), MDFS_ERROR_LEN, "File outside image");
+    errno = ENXIO;
+    return -1;
+  }
+  // Set values, the filename isn't copied, see mdfs_get_open_filename
+  fd->base = mdfs_get_file_location(mdfs, mdfs->file_list[index].byte_offset);
+  fd->byte_offset = mdfs->file_list[index].byte_offset;
+  fd->offset = 0;
+  fd->size = mdfs->file_list[index].size;
+  fd->crc = mdfs->file_list[index].crc;
+  fd->index = index;
+  fd->flags = strchr(mode, 'v') ? MDFS_FILE_VERIFY : 0;
+  fd->crc_offset = 0;
+  mdfs_crc_init(&fd->crc_state);
+  fd->ra_next = fd->ra_end = fd->ra_window = 0;
+  fd->getc_end = 0;
+  return 0;
+}
+
+
+/** @brief close a file previously opened with @ref mdfs_fopen
+ * 
+ * @copybrief mdfs_fclose
+ * 
+ * In verify mode ("v") the part of the file that wasn't read yet is run 
+ * through the crc as well.
+ * 
+ * @param f Opened file
+ * @returns 0 on success, MDFS_EOF when the file was opened with "v" and the
+ * crc doesn't match (errno is EIO then).
+ * 
+ * @ingroup mdfs
+ */
+int mdfs_fclose(mdfs_FILE* f)
+{
+  if ((f->flags & MDFS_FILE_VERIFY) && f->crc_offset < f->size && f->base != NULL)
+  {
+    _mdfs_verify(f, (void*)(f->base + f->crc_offset), f->crc_offset, f->size - f->crc_offset);
+  }
+  // mdfs_init_ex, read the rest from the device in pieces
+  uint8_t buf[_MDFS_DEVICE_CHUNK];
+  while ((f->flags & MDFS_FILE_VERIFY) && f->crc_offset < f->size)
+  {
+    uint32_t n = f->size - f->crc_offset < sizeof(buf) ? f->size - f->crc_offset : sizeof(buf);
+    if (_mdfs_dev_read(f->mdfs, f->byte_offset + f->crc_offset, buf, n))
+    {
+      f->flags |= MDFS_FILE_ERROR;
+      errno = EIO;
+      break;
+    }
+    _mdfs_verify(f, buf, f->crc_offset, n);
+  }
+  int result = (f->flags & (MDFS_FILE_ERROR | MDFS_FILE_CRC_FAILED)) ? MDFS_EOF : 0;
+  if (f->flags & MDFS_FILE_CRC_FAILED) errno = EIO;
+  _mdfs_release_file(f);
+  return result;
+}
+
+/** @brief Get the name of an open file
+ * 
+ * @copybrief mdfs_get_open_filename
+ * Handles don't keep a copy of the name. The entry in the file list is found
+ * by byte_offset (unique per file), so this still works after other files 
+ * were added or removed, and gives the new name after a rename.
+ * 
+ * @param f Opened file
+ * @returns Pointer to the name in the file list, valid until the list is 
+ * changed. NULL when the file was removed from the list or f is stdin.
+ * 
+ * @ingroup mdfs
+ */
+const char* mdfs_get_open_filename(mdfs_FILE* f)
+{
+  _MDFS_READ_LOCK(f->mdfs);
+  return _mdfs_open_filename(f);
+}
+
+/* mdfs_get_open_filename with the lock held */
+static const char* _mdfs_open_filename(mdfs_FILE* f)
+{
+  mdfs_t* mdfs = f->mdfs;
+  if (f->index < 0) return NULL;
+  // Most of the time the list didn't change since opening
+  if (f->index < mdfs->file_count && mdfs->file_list[f->index].byte_offset == f->byte_offset)
+  {
+    return mdfs->file_list[f->index].filename;
+  }
+  // List is ordered by byte_offset
+  int lo = 0;
+  int hi = (int)mdfs->file_count - 1;
+  while (lo <= hi)
+  {
+    int mid = lo + (hi - lo) / 2;
+    uint32_t offset = mdfs->file_list[mid].byte_offset;
+    if (offset == f->byte_offset) return mdfs->file_list[mid].filename;
+    if (offset < f->byte_offset) lo = mid + 1;
+    else hi = mid - 1;
+  }
+  return NULL;
+}
+
+
+/* Copy for mdfs_fread. With MDFS_STREAM_COPY_MIN set, large copies use 
+ * non-temporal stores so a bulk read doesn't flush the whole cache. Off by 
+ * default: glibc's memcpy already does this and was faster in MDFS_bench.
+ */
+#if MDFS_STREAM_COPY_MIN > 0 && MDFS_STREAM_COPY_MIN < 64
+#error "MDFS_STREAM_COPY_MIN must be 0 or at least 64, the alignment head needs room"
+#endif
+static void _mdfs_copy(void* dst, const void* src, size_t n)
+{
+#if MDFS_STREAM_COPY_MIN > 0 && defined(__SSE2__)
+  if (n >= MDFS_STREAM_COPY_MIN)
+  {
+    // Align the destination, stores need 16 byte alignment
+    size_t head = (16 - ((uintptr_t)dst & 15)) & 15;
+    memcpy(dst, src, head);
+    uint8_t* d = (uint8_t*)dst + head;
+    const uint8_t* s = (const uint8_t*)src + head;
+    n -= head;
+    while (n >= 64)
+    {
+      __m128i a = _mm_loadu_si128((const __m128i*)s);
+      __m128i b = _mm_loadu_si128((const __m128i*)(s + 16));
+      __m128i c = _mm_loadu_si128((const __m128i*)(s + 32));
+      __m128i e = _mm_loadu_si128((const __m128i*)(s + 48));
+      _mm_stream_si128((__m128i*)d, a);
+      _mm_stream_si128((__m128i*)(d + 16), b);
+      _mm_stream_si128((__m128i*)(d + 32), c);
+      _mm_stream_si128((__m128i*)(d + 48), e);
+      s += 64;
+      d += 64;
+      n -= 64;
+    }
+    _mm_sfence();
+    memcpy(d, s, n);
+    return;
+  }
+#endif
+  memcpy(dst, src, n);
+}
+
+/** @brief Read block of data from file
+ * 
+ * @copybrief mdfs_fread
+ * Works like libc fread. When less than size*count bytes are left, all 
+ * remaining bytes are copied and the offset moves to the end of the file, but
+ * a partial element at the end is not counted in the return value.
+ * 
+ * @param ptr Pointer to block of memory with at least (size*count) bytes.
+ * @param size Size in bytes of each element to be read.
+ * @param count Number of elements to read.
+ * @param f pointer to a file opened with @ref mdfs_fopen.
+ * @returns The number of complete elements read.
+ * 
+ * @ingroup mdfs
+ */
+size_t mdfs_fread(void* ptr, size_t size, size_t count, mdfs_FILE* f)
+{
+  if (size == 0 || count == 0) return 0;
+  if (f->offset >= f->size) return 0;
+
+  size_t left = f->size - f->offset;
+  // Compare in elements so size*count can't overflow
+  size_t n = (count > left / size) ? left : size * count;
+  if (_mdfs_read_next(f, ptr, n)) return 0;
+  return n / size;
+}
+
+/* Copy the next n bytes of f to ptr and move on, n must be left in the file.
+ * Returns 0 on success, -1 on a read error (error flag and errno set).
+ */
+static int _mdfs_read_next(mdfs_FILE* f, void* ptr, uint32_t n)
+{
+  if (_mdfs_read_at(f, ptr, f->offset, n))
+  {
+    f->flags |= MDFS_FILE_ERROR;
+    errno = EIO;
+    return -1;
+  }
+  _mdfs_verify(f, ptr, f->offset, n);
+  f->offset += n;
+  _mdfs_readahead(f, n);
+  return 0;
+}
+
+
+/** @brief Look at the next bytes of a file without copying them
+ * 
+ * @copybrief mdfs_fpeek
+ * Returns a view straight into the memory mapped file system. The offset is
+ * not changed, see @ref mdfs_fread_view for that.
+ * 
+ * With @ref mdfs_init_ex the view points into the block cache, it ends at 
+ * the end of the cache block and is valid until the next read from the mdfs.
+ * That's a read by any thread, on any file: with MDFS_THREAD_SAFE another 
+ * thread's read can replace the block while the view is used. Copy with 
+ * @ref mdfs_fread when other threads read from the same mdfs.
+ * Without a cache the view is empty (errno ENOTSUP).
+ * 
+ * @param f pointer to a file opened with @ref mdfs_fopen.
+ * @param count Maximum number of bytes in the view
+ * @returns A view of min(count, bytes left) bytes. Size 0 at eof.
+ * 
+ * @ingroup mdfs
+ */
+mdfs_view_t mdfs_fpeek(mdfs_FILE* f, size_t count)
+{
+  mdfs_view_t view = {NULL, 0};
+  if (f->offset >= f->size) return view;
+  if (count > f->size - f->offset) count = f->size - f->offset;
+  if (count == 0) return view;
+  if (f->base == NULL)
+  {
+    uint32_t n = count;
+    view.data = _mdfs_dev_view(f->mdfs, f->byte_offset + f->offset, &n);
+    view.size = view.data ? n : 0;
+    return view;
+  }
+  view.data = (const void*)(f->base + f->offset);
+  view.size = count;
+  return view;
+}
+
+/** @brief Read from a file without copying
+ * 
+ * @copybrief mdfs_fread_view
+ * Like @ref mdfs_fpeek, but the offset is advanced past the bytes in the 
+ * view, same as @ref mdfs_fread would. In verify mode the bytes count towards
+ * the crc.
+ * 
+ * With @ref mdfs_init_ex the view is only valid until the next read from the 
+ * mdfs by any thread, see @ref mdfs_fpeek.
+ * 
+ * @param f pointer to a file opened with @ref mdfs_fopen.
+ * @param count Maximum number of bytes in the view
+ * @returns A view of min(count, bytes left) bytes. Size 0 at eof.
+ * 
+ * @ingroup mdfs
+ */
+mdfs_view_t mdfs_fread_view(mdfs_FILE* f, size_t count)
+{
+  mdfs_view_t view = mdfs_fpeek(f, count);
+  _mdfs_verify(f, view.data, f->offset, view.size);
+  f->offset += view.size;
+  // A device view is in the most recently used cache block, readahead takes
+  // at most half the cache so it stays
+  if (view.size) _mdfs_readahead(f, view.size);
+  return view;
+}
+
+/* Length of the next line of f, up to and including delim, at most max
+ * bytes. The offset must be before the end. -1 when the device failed.
+ */
+static int32_t _mdfs_line_length(mdfs_FILE* f, int delim, uint32_t max)
+{
+  uint32_t left = f->size - f->offset;
+  if (max > left) max = left;
+  if (f->base != NULL)
+  {
+    // libc's memchr compares 16 or 32 bytes at a time
+    const uint8_t* p = (const uint8_t*)f->base + f->offset;
+    const uint8_t* hit = (const uint8_t*)memchr(p, delim, max);
+    return hit ? (int32_t)(hit - p + 1) : (int32_t)max;
+  }
+  // mdfs_init_ex, scan in pieces (from the cache mostly)
+  uint8_t buf[128];
+  uint32_t n = 0;
+  while (n < max)
+  {
+    uint32_t len = max - n < sizeof(buf) ? max - n : sizeof(buf);
+    if (_mdfs_dev_read(f->mdfs, f->byte_offset + f->offset + n, buf, len))
+    {
+      f->flags |= MDFS_FILE_ERROR;
+      errno = EIO;
+      return -1;
+    }
+    const uint8_t* hit = (const uint8_t*)memchr(buf, delim, len);
+    if (hit) return (int32_t)(n + (hit - buf) + 1);
+    n += len;
+  }
+  return (int32_t)max;
+}
+
+/** @brief Read a line into a buffer
+ * 
+ * @copybrief mdfs_fgets
+ * Works like libc fgets: reads up to size - 1 bytes, stops after a '\n' and
+ * terminates s with \0.
+ * 
+ * @param s Buffer of size bytes
+ * @param size Size of s
+ * @param f pointer to a file opened with @ref mdfs_fopen.
+ * @returns s, NULL at the end of the file or on a read error.
+ * 
+ * @ingroup mdfs
+ */
+char* mdfs_fgets(char* s, int size, mdfs_FILE* f)
+{
+  if (size <= 0 || f->offset >= f->size) return NULL;
+  int32_t n = _mdfs_line_length(f, '\n', size - 1);
+  if (n < 0 || _mdfs_read_next(f, s, n)) return NULL;
+  s[n] = 0;
+  return s;
+}
+
+/** @brief Read up to a delimiter into a buffer that grows
+ * 
+ * @copybrief mdfs_getdelim
+ * Works like POSIX getdelim: *lineptr is (re)allocated with malloc when it 
+ * is NULL or smaller than the line, *n is its size. The line includes the 
+ * delimiter (unless the file ends without one) and is terminated with \0.
+ * 
+ * @param lineptr Buffer, NULL or from malloc
+ * @param n Size of *lineptr
+ * @param delim Byte that ends a line
+ * @param f pointer to a file opened with @ref mdfs_fopen.
+ * @returns Number of bytes in the line without the \0, -1 at the end of the
+ * file or on error (errno EINVAL, ENOMEM or EIO).
+ * 
+ * @ingroup mdfs
+ */
+int32_t mdfs_getdelim(char** lineptr, size_t* n, int delim, mdfs_FILE* f)
+{
+  if (lineptr == NULL || n == NULL)
+  {
+    errno = EINVAL;
+    return -1;
+  }
+  if (f->offset >= f->size) return -1;
+  int32_t len = _mdfs_line_length(f, delim, f->size - f->offset);
+  if (len < 0) return -1;
+  if (*lineptr == NULL || *n < (size_t)len + 1)
+  {
+    size_t size = ((size_t)len + 1 + 127) & ~(size_t)127;
+    char* p = (char*)realloc(*lineptr, size);
+    if (p == NULL)
+    {
+      errno = ENOMEM;
+      return -1;
+    }
+    *lineptr = p;
+    *n = size;
+  }
+  if (_mdfs_read_next(f, *lineptr, len)) return -1;
+  (*lineptr)[len] = 0;
+  return len;
+}
+
+/** @brief Read a line into a buffer that grows
+ * 
+ * @copybrief mdfs_getline
+ * @ref mdfs_getdelim with '\n'.
+ * @ingroup mdfs
+ */
+int32_t mdfs_getline(char** lineptr, size_t* n, mdfs_FILE* f)
+{
+  return mdfs_getdelim(lineptr, n, '\n', f);
+}
+
+/** @brief Read up to a delimiter without copying
+ * 
+ * @copybrief mdfs_getdelim_view
+ * Returns a view of the next line, including the delimiter, straight into 
+ * the memory mapped file system, and moves the offset past it like 
+ * @ref mdfs_fread_view. The view isn't terminated with \0.
+ * 
+ * With @ref mdfs_init_ex views end at a cache block (see @ref mdfs_fpeek),
+ * so a long line can come in pieces: only the last one ends with delim. They
+ * are only valid until the next read from the mdfs by any thread.
+ * 
+ * @param f pointer to a file opened with @ref mdfs_fopen.
+ * @param delim Byte that ends a line
+ * @returns The line, size 0 at the end of the file.
+ * 
+ * @ingroup mdfs
+ */
+mdfs_view_t mdfs_getdelim_view(mdfs_FILE* f, int delim)
+{
+  mdfs_view_t view = mdfs_fpeek(f, f->size > f->offset ? f->size - f->offset : 0);
+  if (view.size == 0) return view;
+  const uint8_t* hit = (const uint8_t*)memchr(view.data, delim, view.size);
+  return mdfs_fread_view(f, hit ? (size_t)(hit - (const uint8_t*)view.data + 1) : view.size);
+}
+
+// A read of mdfs_fread_async
+typedef struct MDFSAioReq {
+  mdfs_FILE* f;
+  void* buf;
+  uint32_t offset; // In the file
+  uint32_t n;
+  mdfs_aio_cb_t cb;
+  void* ctx;
+  int error;
+} _mdfs_aio_req_t;
+
+/* Submission and completion queue of mdfs_fread_async. Both rings hold 
+ * indices in reqs, a request is in one of them or in free.
+ */
+struct MDFSAio {
+  _mdfs_aio_req_t reqs[MDFS_AIO_DEPTH];
+  uint32_t free[MDFS_AIO_DEPTH];
+  uint32_t free_count;
+  uint32_t sq[MDFS_AIO_DEPTH];
+  uint32_t sq_head; // Next to read, sq_tail is next to write
+  uint32_t sq_tail;
+  uint32_t cq[MDFS_AIO_DEPTH];
+  uint32_t cq_head;
+  uint32_t cq_tail;
+#if MDFS_USE_PTHREADS
+  int stop;
+  pthread_mutex_t lock;
+  pthread_cond_t submitted;
+  pthread_cond_t completed;
+  pthread_t threads[MDFS_AIO_THREADS];
+  int thread_count;
+#endif
+};
+
+/* Read n bytes at offset in f, from memory or the device.
+ * Returns 0 on success, -1 when the device failed.
+ */
+static int _mdfs_read_at(mdfs_FILE* f, void* dst, uint32_t offset, uint32_t n)
+{
+  if (f->base != NULL)
+  {
+    _mdfs_copy(dst, (void*)(f->base + offset), n);
+    return 0;
+  }
+  return _mdfs_dev_read(f->mdfs, f->byte_offset + offset, dst, n);
+}
+
+static void _mdfs_aio_run(_mdfs_aio_req_t* req)
+{
+  req->error = _mdfs_read_at(req->f, req->buf, req->offset, req->n) ? EIO : 0;
+}
+
+#if MDFS_USE_PTHREADS
+static void* _mdfs_aio_worker(void* arg)
+{
+  struct MDFSAio* aio = (struct MDFSAio*)arg;
+  pthread_mutex_lock(&aio->lock);
+  while (1)
+  {
+    while (aio->sq_head == aio->sq_tail && !aio->stop) pthread_cond_wait(&aio->submitted, &aio->lock);
+    if (aio->stop) break;
+    uint32_t i = aio->sq[aio->sq_head++ % MDFS_AIO_DEPTH];
+    pthread_mutex_unlock(&aio->lock);
+    _mdfs_aio_run(&aio->reqs[i]);
+    pthread_mutex_lock(&aio->lock);
+    aio->cq[aio->cq_tail++ % MDFS_AIO_DEPTH] = i;
+    pthread_cond_signal(&aio->completed);
+  }
+  pthread_mutex_unlock(&aio->lock);
+  return NULL;
+}
+#endif
+
+/* Create the queues (and workers) on first use. Returns NULL when out of memory */
+static struct MDFSAio* _mdfs_aio_get(mdfs_t* mdfs)
+{
+  _MDFS_POOL_LOCK(mdfs);
+  struct MDFSAio* aio = mdfs->aio;
+  if (aio == NULL)
+  {
+    aio = (struct MDFSAio*)malloc(sizeof(struct MDFSAio));
+    if (aio != NULL)
+    {
+      uint32_t i;
+      for (i = 0; i < MDFS_AIO_DEPTH; ++i) aio->free[i] = MDFS_AIO_DEPTH - 1 - i;
+      aio->free_count = MDFS_AIO_DEPTH;
+      aio->sq_head = aio->sq_tail = 0;
+      aio->cq_head = aio->cq_tail = 0;
+#if MDFS_USE_PTHREADS
+      aio->stop = 0;
+      pthread_mutex_init(&aio->lock, NULL);
+      pthread_cond_init(&aio->submitted, NULL);
+      pthread_cond_init(&aio->completed, NULL);
+      // Device reads are done one at a time anyway
+      int threads = (mdfs->flags & MDFS_FLAG_DEVICE) ? 1 : MDFS_AIO_THREADS;
+      for (aio->thread_count = 0; aio->thread_count < threads; ++aio->thread_count)
+      {
+        if (pthread_create(&aio->threads[aio->thread_count], NULL, _mdfs_aio_worker, aio)) break;
+      }
+      if (aio->thread_count == 0)
+      {
+        free(aio);
+        aio = NULL;
+      }
+#endif
+      mdfs->aio = aio;
+    }
+  }
+  _MDFS_POOL_UNLOCK(mdfs);
+  return aio;
+}
+
+/* Stop the workers, completions that weren't polled are dropped */
+static void _mdfs_aio_free(struct MDFSAio* aio)
+{
+#if MDFS_USE_PTHREADS
+  pthread_mutex_lock(&aio->lock);
+  aio->stop = 1;
+  pthread_cond_broadcast(&aio->submitted);
+  pthread_mutex_unlock(&aio->lock);
+  while (aio->thread_count > 0) pthread_join(aio->threads[--aio->thread_count], NULL);
+  pthread_mutex_destroy(&aio->lock);
+  pthread_cond_destroy(&aio->submitted);
+  pthread_cond_destroy(&aio->completed);
+#endif
+  free(aio);
+}
+
+/** @brief Start a read without waiting for it
+ * 
+ * @copybrief mdfs_fread_async
+ * Reads up to len bytes at the current offset of f into ptr on a worker 
+ * thread, so many reads can be in flight, e.g. on an image from 
+ * @ref mdfs_open_image where a read may page fault. The offset is advanced 
+ * right away, so the next read (sync or async) continues after this one.
+ * cb is called from @ref mdfs_aio_poll on the polling thread.
+ * 
+ * ptr and f must stay valid until the callback ran. The bytes don't count 
+ * towards verify mode ("v"), @ref mdfs_fclose checks what's left then.
+ * For an mdfs from @ref mdfs_init_ex there's one worker, and without 
+ * MDFS_THREAD_SAFE no other reads may be done on it while reads are in 
+ * flight. Without MDFS_USE_PTHREADS the read is done before returning, the
+ * callback still waits for mdfs_aio_poll.
+ * 
+ * @param f pointer to a file opened with @ref mdfs_fopen.
+ * @param ptr Buffer of at least len bytes
+ * @param len Maximum number of bytes to read, less at the end of the file
+ * @param cb Called with the result
+ * @param ctx Passed to cb
+ * @returns 0 when the read was queued, -1 otherwise with errno set: EAGAIN 
+ * when MDFS_AIO_DEPTH reads are in flight (poll first), ENOMEM, ENOTSUP for
+ * an mdfs from @ref mdfs_init_static (error is set).
+ * 
+ * @ingroup mdfs
+ */
+int mdfs_fread_async(mdfs_FILE* f, void* ptr, size_t len, mdfs_aio_cb_t cb, void* ctx)
+{
+  if (f->mdfs->flags & MDFS_FLAG_STATIC)
+  {
+    // The queues and workers would need malloc
+    snprintf(_MDFS_ERROR_BUF(f->mdfs), MDFS_ERROR_LEN, "Async reads need malloc");
+    errno = ENOTSUP;
+    return -1;
+  }
+  struct MDFSAio* aio = _mdfs_aio_get(f->mdfs);
+  if (aio == NULL)
+  {
+    errno = ENOMEM;
+    return -1;
+  }
+  size_t left = f->offset < f->size ? f->size - f->offset : 0;
+#if MDFS_USE_PTHREADS
+  pthread_mutex_lock(&aio->lock);
+#endif
+  int result = -1;
+  if (aio->free_count == 0)
+  {
+    errno = EAGAIN;
+  }
+  else
+  {
+    uint32_t i = aio->free[--aio->free_count];
+    _mdfs_aio_req_t* req = &aio->reqs[i];
+    req->f = f;
+    req->buf = ptr;
+    req->offset = f->offset;
+    req->n = len < left ? len : left;
+    req->cb = cb;
+    req->ctx = ctx;
+    f->offset += req->n;
+#if MDFS_USE_PTHREADS
+    aio->sq[aio->sq_tail++ % MDFS_AIO_DEPTH] = i;
+    pthread_cond_signal(&aio->submitted);
+#else
+    _mdfs_aio_run(req);
+    aio->cq[aio->cq_tail++ % MDFS_AIO_DEPTH] = i;
+#endif
+    result = 0;
+  }
+#if MDFS_USE_PTHREADS
+  pthread_mutex_unlock(&aio->lock);
+#endif
+  return result;
+}
+
+/** @brief Run the callbacks of finished async reads
+ * 
+ * @copybrief mdfs_aio_poll
+ * Calls the callback of every read of @ref mdfs_fread_async that is done, 
+ * on the calling thread. Callbacks may start new reads.
+ * 
+ * @param mdfs The mdfs
+ * @param wait When not 0, block until at least one read is done (unless 
+ * none are in flight)
+ * @returns Number of callbacks called, 0 when nothing was done.
+ * 
+ * @ingroup mdfs
+ */
+int mdfs_aio_poll(mdfs_t* mdfs, int wait)
+{
+  struct MDFSAio* aio = mdfs->aio;
+  if (aio == NULL) return 0;
+  _mdfs_aio_req_t done[MDFS_AIO_DEPTH];
+  int count = 0;
+#if MDFS_USE_PTHREADS
+  pthread_mutex_lock(&aio->lock);
+  while (wait && aio->cq_head == aio->cq_tail && aio->free_count < MDFS_AIO_DEPTH)
+  {
+    pthread_cond_wait(&aio->completed, &aio->lock);
+  }
+#else
+  (void)wait;
+#endif
+  // Copy out and free the slots so callbacks can submit again
+  while (aio->cq_head != aio->cq_tail)
+  {
+    uint32_t i = aio->cq[aio->cq_head++ % MDFS_AIO_DEPTH];
+    done[count++] = aio->reqs[i];
+    aio->free[aio->free_count++] = i;
+  }
+#if MDFS_USE_PTHREADS
+  pthread_mutex_unlock(&aio->lock);
+#endif
+  int i;
+  for (i = 0; i < count; ++i)
+  {
+    _mdfs_aio_req_t* req = &done[i];
+    if (req->error) req->f->flags |= MDFS_FILE_ERROR;
+    req->cb(req->f, req->buf, req->n, req->error, req->ctx);
+  }
+  return count;
+}
+
+/* Get bytes start..end of f on their way: into the cache of a device, the 
+ * page cache for an image file, the cpu cache for memory. Errors are left 
+ * for the read that needs the bytes.
+ */
+static void _mdfs_prefetch(mdfs_FILE* f, uint32_t start, uint32_t end)
+{
+  mdfs_t* mdfs = f->mdfs;
+  if (end > (uint32_t)f->size) end = f->size;
+  if (start >= end) return;
+  if (f->base == NULL)
+  {
+    struct MDFSCache* c = mdfs->cache;
+    if (c == NULL) return; // Nowhere to put it
+    uint32_t block = (f->byte_offset + start) / c->block_size;
+    uint32_t last = (f->byte_offset + end - 1) / c->block_size;
+    // Keep half the cache for what was read before
+    if (last - block >= c->count / 2) last = block + (c->count > 1 ? c->count / 2 : 1) - 1;
+    _MDFS_CACHE_LOCK(c);
+    for (; block <= last; ++block)
+    {
+      if (_mdfs_cache_find(c, block) < 0 && _mdfs_cache_get(mdfs, block) < 0) break;
+    }
+    _MDFS_CACHE_UNLOCK(c);
+    return;
+  }
+#if MDFS_USE_MMAP
+  if (mdfs->flags & MDFS_FLAG_IMAGE)
+  {
+    uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+    uintptr_t from = ((uintptr_t)f->base + start) & ~(page - 1);
+    madvise((void*)from, (uintptr_t)f->base + end - from, MADV_WILLNEED);
+    return;
+  }
+#endif
+  const uint8_t* p = (const uint8_t*)f->base + start;
+  const uint8_t* stop = (const uint8_t*)f->base + end;
+  for (; p < stop; p += 64) __builtin_prefetch(p);
+}
+
+/* Called after reading the n bytes before the offset of f, so the read isn't
+ * held up by it (device reads are synchronous). A read that starts where
+ * the last one ended is sequential: the window opens at MDFS_READAHEAD_MIN 
+ * and doubles every time it's used, up to MDFS_READAHEAD_MAX. Anything else
+ * closes it again. Readahead is done when less than half a window is left.
+ */
+static void _mdfs_readahead(mdfs_FILE* f, uint32_t n)
+{
+  if (f->flags & MDFS_FILE_RANDOM) return;
+  uint32_t offset = f->offset - n;
+  uint32_t next = f->ra_next;
+  f->ra_next = offset + n;
+  if (offset != next && !(f->flags & MDFS_FILE_SEQUENTIAL))
+  {
+    f->ra_window = 0;
+    f->ra_end = 0;
+    return;
+  }
+  if (f->ra_window == 0) f->ra_window = MDFS_READAHEAD_MIN;
+  if (offset + n + f->ra_window / 2 <= f->ra_end) return;
+  // Big reads fill no cache, they go to the device as they are. A cache of 
+  // one block can't hold the block being read and the next one.
+  struct MDFSCache* c = f->mdfs->cache;
+  if (f->base == NULL && (c == NULL || c->count < 2 || n >= c->block_size)) return;
+  uint32_t start = f->ra_end > offset + n ? f->ra_end : offset + n;
+  f->ra_end = offset + n + f->ra_window;
+  _mdfs_prefetch(f, start, f->ra_end);
+  if (f->ra_window < MDFS_READAHEAD_MAX) f->ra_window *= 2;
+}
+
+/** @brief Tell how a file is going to be read
+ * 
+ * @copybrief mdfs_fadvise
+ * Like posix_fadvise. Sequential reads are detected without this, see 
+ * MDFS_READAHEAD_MIN.
+ * - MDFS_FADV_NORMAL: readahead when reads are sequential
+ * - MDFS_FADV_SEQUENTIAL: the full window from the first read, jumps don't 
+ *   close it
+ * - MDFS_FADV_RANDOM: no readahead
+ * - MDFS_FADV_WILLNEED: read offset..offset+len in now. Into the block cache
+ *   for @ref mdfs_init_ex (at most half of it), madvise for 
+ *   @ref mdfs_open_image, cpu prefetch for memory.
+ * - MDFS_FADV_DONTNEED: drop the blocks in the range from the block cache, 
+ *   or the pages from the page cache for an image.
+ * 
+ * @param f pointer to a file opened with @ref mdfs_fopen.
+ * @param offset From the start of the file
+ * @param len Bytes, 0 for up to the end of the file
+ * @param hint MDFS_FADV_ value
+ * @returns 0 on success, -1 for an unknown hint (errno EINVAL)
+ * 
+ * @ingroup mdfs
+ */
+int mdfs_fadvise(mdfs_FILE* f, uint32_t offset, uint32_t len, int hint)
+{
+  uint32_t end = (len == 0 || offset + len > (uint32_t)f->size) ? (uint32_t)f->size : offset + len;
+  switch (hint)
+  {
+  case MDFS_FADV_NORMAL:
+    f->flags &= ~(MDFS_FILE_RANDOM | MDFS_FILE_SEQUENTIAL);
+    break;
+  case MDFS_FADV_SEQUENTIAL:
+    f->flags = (f->flags & ~MDFS_FILE_RANDOM) | MDFS_FILE_SEQUENTIAL;
+    f->ra_window = MDFS_READAHEAD_MAX;
+    break;
+  case MDFS_FADV_RANDOM:
+    f->flags = (f->flags & ~MDFS_FILE_SEQUENTIAL) | MDFS_FILE_RANDOM;
+    f->ra_window = 0;
+    break;
+  case MDFS_FADV_WILLNEED:
+    _mdfs_prefetch(f, offset, end);
+    break;
+  case MDFS_FADV_DONTNEED:
+    if (offset >= end) break;
+    if (f->base == NULL && f->mdfs->cache != NULL)
+    {
+      struct MDFSCache* c = f->mdfs->cache;
+      uint32_t first = (f->byte_offset + offset) / c->block_size;
+      uint32_t last = (f->byte_offset + end - 1) / c->block_size;
+      uint32_t i;
+      _MDFS_CACHE_LOCK(c);
+      for (i = 0; i < c->count; ++i)
+      {
+        if (c->tags[i] < first || c->tags[i] > last) continue;
+        c->tags[i] = _MDFS_CACHE_EMPTY;
+        c->stamps[i] = 0;
+      }
+      _MDFS_CACHE_UNLOCK(c);
+    }
+#if MDFS_USE_MMAP
+    else if (f->mdfs->flags & MDFS_FLAG_IMAGE)
+    {
+      // Only whole pages, the ones at the edges may hold other files
+      uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+      uintptr_t from = ((uintptr_t)f->base + offset + page - 1) & ~(page - 1);
+      uintptr_t to = ((uintptr_t)f->base + end) & ~(page - 1);
+      if (to > from) madvise((void*)from, to - from, MADV_DONTNEED);
+    }
+#endif
+    f->ra_end = offset < f->ra_end ? offset : f->ra_end;
+    break;
+  default:
+    errno = EINVAL;
+    return -1;
+  }
+  return 0;
+}
+
+/** @brief Move the read position
+ * 
+ * @copybrief mdfs_fseek
+ * Like libc fseek, O(1). The position can't go before the start or past 
+ * the end of the file. In verify mode ("v") the crc still covers every byte
+ * once: only bytes following the ones seen so far count, @ref mdfs_fclose 
+ * reads what was skipped.
+ * 
+ * @param f pointer to a file opened with @ref mdfs_fopen.
+ * @param offset Bytes relative to whence
+ * @param whence SEEK_SET, SEEK_CUR or SEEK_END
+ * @returns 0 on success, -1 with errno EINVAL otherwise (the position is
+ * unchanged then).
+ * 
+ * @ingroup mdfs
+ */
+int mdfs_fseek(mdfs_FILE* f, long offset, int whence)
+{
+  int64_t pos;
+  switch (whence)
+  {
+  case SEEK_SET: pos = offset; break;
+  case SEEK_CUR: pos = (int64_t)f->offset + offset; break;
+  case SEEK_END: pos = (int64_t)f->size + offset; break;
+  default: pos = -1; break;
+  }
+  if (pos < 0 || pos > f->size)
+  {
+    errno = EINVAL;
+    return -1;
+  }
+  f->offset = (uint32_t)pos;
+  return 0;
+}
+
+/** @brief Get the read position
+ * 
+ * @copybrief mdfs_ftell
+ * @returns Bytes from the start of the file
+ * @ingroup mdfs
+ */
+long mdfs_ftell(mdfs_FILE* f)
+{
+  return (long)f->offset;
+}
+
+/** @brief Back to the start of the file
+ * 
+ * @copybrief mdfs_rewind
+ * Like libc rewind, the error indicator is cleared as well. A crc mismatch
+ * found in verify mode is remembered, @ref mdfs_fclose still fails.
+ * @ingroup mdfs
+ */
+void mdfs_rewind(mdfs_FILE* f)
+{
+  f->offset = 0;
+  f->flags &= ~MDFS_FILE_ERROR;
+}
+
+/** @brief Read at a position without using the handle's position
+ * 
+ * @copybrief mdfs_pread
+ * Like POSIX pread. Nothing in f is changed (offset, readahead, verify 
+ * state), so threads can share a handle for positional reads. The bytes 
+ * don't count towards verify mode.
+ * 
+ * @param f pointer to a file opened with @ref mdfs_fopen.
+ * @param ptr Buffer of at least len bytes
+ * @param len Maximum number of bytes to read
+ * @param offset From the start of the file
+ * @returns Bytes read, less than len at the end of the file and 0 at or 
+ * past the end. -1 when the device failed (errno EIO).
+ * 
+ * @ingroup mdfs
+ */
+int32_t mdfs_pread(mdfs_FILE* f, void* ptr, size_t len, uint32_t offset)
+{
+  if (offset >= (uint32_t)f->size) return 0;
+  uint32_t n = (uint32_t)f->size - offset;
+  if (len < n) n = (uint32_t)len;
+  if (_mdfs_read_at(f, ptr, offset, n))
+  {
+    errno = EIO;
+    return -1;
+  }
+  return (int32_t)n;
+}
+
+int mdfs_feof(mdfs_FILE* f)
+{
+  return f->size == f->offset ? 1 : 0;
+}
+
+static void _mdfs_init_entry(mdfs_file_t* entry, const char* filename, int filesize, uint32_t byte_offset)
+{
+  memset((void*)entry, 0, sizeof(mdfs_file_t));
+  snprintf(entry->filename, MDFS_MAX_FILENAME, "%s", filename);
+  entry->size = filesize;
+  entry->byte_offset = byte_offset;
+  entry->crc = 0;
+}
+
+
+/** @brief Read one byte
+ * 
+ * @copybrief mdfs_fgetc
+ * The slow path of @ref mdfs_getc. For memory mapped files that aren't 
+ * opened in verify mode this sets getc_end, so mdfs_getc reads the next
+ * MDFS_READAHEAD_MIN bytes inline and then calls this again for readahead.
+ * 
+ * @param f pointer to a file opened with @ref mdfs_fopen.
+ * @returns The byte, MDFS_EOF at the end of the file or on a read error.
+ * @ingroup mdfs
+ */
+int mdfs_fgetc(mdfs_FILE* f)
+{
+  if (mdfs_feof(f)) return MDFS_EOF;
+  // mdfs_getc read up to here inline, that's sequential
+  if (f->offset == f->getc_end) f->ra_next = f->offset;
+  uint8_t byte;
+  uint8_t* c = &byte;
+  if (f->base != NULL) c = (uint8_t*)(f->base + f->offset);
+  else if (_mdfs_dev_read(f->mdfs, f->byte_offset + f->offset, c, 1))
+  {
+    f->flags |= MDFS_FILE_ERROR;
+    errno = EIO;
+    return MDFS_EOF;
+  }
+  _mdfs_verify(f, c, f->offset, 1);
+  f->offset++;
+  _mdfs_readahead(f, 1);
+  if (f->base != NULL && !(f->flags & MDFS_FILE_VERIFY))
+  {
+    uint32_t end = (f->flags & MDFS_FILE_RANDOM) ? (uint32_t)f->size : f->offset + MDFS_READAHEAD_MIN;
+    f->getc_end = end < (uint32_t)f->size ? end : (uint32_t)f->size;
+  }
+  return (int)*c;
+}
+
+/** @brief Check the error indicator of a file
+ * 
+ * @copybrief mdfs_ferror
+ * Set when a file opened in verify mode ("v") was read to the end and the crc
+ * didn't match, or when the device of @ref mdfs_init_ex failed to read.
+ * @returns non-zero when the error indicator is set
+ * @ingroup mdfs
+ */
+int mdfs_ferror(mdfs_FILE* f)
+{
+  return (f->flags & MDFS_FILE_ERROR) ? 1 : 0;
+}
+
+/* Verify mode: add n bytes read at start to the running crc
+ * Only the part that continues the bytes seen so far is used, so re-reading 
+ * doesn't count twice. data must point to the bytes at start (can be a copy).
+ * When the whole file has been seen the crc is checked.
+ */
+static void _mdfs_verify(mdfs_FILE* f, const void* data, uint32_t start, uint32_t n)
+{
+  if (!(f->flags & MDFS_FILE_VERIFY)) return;
+  if (start > f->crc_offset || start + n <= f->crc_offset) return;
+  uint32_t skip = f->crc_offset - start;
+  mdfs_crc_update(&f->crc_state, (const uint8_t*)data + skip, n - skip);
+  f->crc_offset += n - skip;
+  if (f->crc_offset >= f->size)
+  {
+    f->flags &= ~MDFS_FILE_VERIFY;
+    if (mdfs_crc_final(&f->crc_state) != f->crc)
+    {
+      f->flags |= MDFS_FILE_ERROR | MDFS_FILE_CRC_FAILED;
+      errno = EIO;
+    }
+  }
+}
+
+
+static int _mdfs_insert(mdfs_t* mdfs, mdfs_file_t* entry, int index)
+{
+	if (mdfs->file_count >= MDFS_MAX_FILECOUNT) return -2; // Error: No room
+	if (index > mdfs->file_count) return -1; // Error: Illegal index
+  if (_mdfs_make_writable(mdfs)) return -3; // Error: Out of memory
+  // Make room
+	if (_MDFS_INCREMENT_FILE_COUNT(mdfs) < 0) return -3; // Error: Out of memory
+  // Shift index..end down by one in a single move (nothing to move when
+  // appending). ex: Insert at 1 with file_count 5->6: items 1..4 go to 2..5
+  memmove(
+    (void*)&mdfs->file_list[index+1],
+    (void*)&mdfs->file_list[index],
+    (mdfs->file_count - 1 - index) * sizeof(mdfs_file_t));
+  // Copy entry into index
+  memcpy((void*)&mdfs->file_list[index], (void*)entry, sizeof(mdfs_file_t));
+  _mdfs_update_file_list_crc(mdfs);
+  // From the back, so an index that's already moved up can't be found again
+  int i;
+  for (i = mdfs->file_count - 1; i > index; --i) _mdfs_index_move(mdfs, i - 1, i);
+  _mdfs_index_add(mdfs, index);
+  return 0;
+}
+
+#if MDFS_USE_HASH_INDEX
+/* FNV-1a over the filename, stops at \0 */
+static uint32_t _mdfs_hash_name(const char* name)
+{
+  uint32_t h = 2166136261u;
+  while (*name) 
   {
-    mdfs_fclose(f);
-    return NULL;
+    h ^= (uint8_t)*name++;
+    h *= 16777619u;
   }
-  memcpy((void*)f, (void*)new, sizeof(mdfs_FILE));
-  f->offset = 0;
-  mdfs_fclose(new);
-  return f;
+  return h;
 }
+#endif
 
-
-/** @brief close a file previously opened with @ref mdfs_fopen
- * 
- * @copybrief mdfs_fclose
+/** @brief Rebuild the filename index from file_list
  * 
- * @param f Opened file
- * 
- * @ingroup mdfs
+ * Called when the whole list is (re)built: init and mdfs_commit_batch. Single
+ * changes use _mdfs_index_add, _mdfs_index_delete and _mdfs_index_move, which
+ * only touch the slots of the entries involved.
+ * When a name occurs more than once only the first occurence is indexed, same 
+ * as the linear search would find.
  */
-int mdfs_fclose(mdfs_FILE* f)
+static void _mdfs_index_rebuild(mdfs_t* mdfs)
 {
-  free(f);
-  return 0;
+#if MDFS_USE_HASH_INDEX
+  int i;
+  memset((void*)mdfs->index, 0xFF, sizeof(mdfs->index)); // all MDFS_INDEX_EMPTY
+  for (i = 0; i < mdfs->file_count; ++i)
+  {
+    const char* name = mdfs->file_list[i].filename;
+    uint32_t h = _mdfs_hash_name(name);
+    uint32_t slot = h & (MDFS_INDEX_SLOTS - 1);
+    while (mdfs->index[slot].index != MDFS_INDEX_EMPTY)
+    {
+      if (mdfs->index[slot].tag == (uint16_t)(h >> 16) &&
+          strcmp(mdfs->file_list[mdfs->index[slot].index].filename, name) == 0)
+      {
+        break; // Duplicate, keep the first
+      }
+      slot = (slot + 1) & (MDFS_INDEX_SLOTS - 1);
+    }
+    if (mdfs->index[slot].index != MDFS_INDEX_EMPTY) continue;
+    mdfs->index[slot].index = (uint16_t)i;
+    mdfs->index[slot].tag = (uint16_t)(h >> 16);
+  }
+#endif
 }
 
+#if MDFS_USE_HASH_INDEX
+/* Slot holding index i on the probe chain of name, MDFS_INDEX_SLOTS if none */
+static uint32_t _mdfs_index_find(mdfs_t* mdfs, const char* name, int i)
+{
+  uint32_t slot = _mdfs_hash_name(name) & (MDFS_INDEX_SLOTS - 1);
+  while (mdfs->index[slot].index != MDFS_INDEX_EMPTY)
+  {
+    if (mdfs->index[slot].index == i) return slot;
+    slot = (slot + 1) & (MDFS_INDEX_SLOTS - 1);
+  }
+  return MDFS_INDEX_SLOTS;
+}
+#endif
 
-/** @brief Read block of data from file
- * 
- * @copybrief mdfs_fread
- * Works like libc fread, size is forced to 1.
- * 
- * @param ptr Pointer to block of memory with at least (size*count) bytes.
- * @param size Size in bytes of each element to be read. LIMITED TO 1
- * @param count Number of elements to read.
- * @param f pointer to a file opened with @ref mdfs_fopen.
- * @returns The number of elements read.
- * 
- * @ingroup mdfs
- */
-size_t mdfs_fread(void* ptr, size_t size, size_t count, mdfs_FILE* f)
+/* Index file_list[i], unless an earlier file with the same name is indexed */
+static void _mdfs_index_add(mdfs_t* mdfs, int i)
 {
-  if (size == 0 || count == 0) return 0;
+#if MDFS_USE_HASH_INDEX
+  const char* name = mdfs->file_list[i].filename;
+  uint32_t h = _mdfs_hash_name(name);
+  uint32_t slot = h & (MDFS_INDEX_SLOTS - 1);
+  while (mdfs->index[slot].index != MDFS_INDEX_EMPTY)
+  {
+    if (mdfs->index[slot].tag == (uint16_t)(h >> 16) &&
+        strcmp(mdfs->file_list[mdfs->index[slot].index].filename, name) == 0)
+    {
+      if (mdfs->index[slot].index > i) mdfs->index[slot].index = (uint16_t)i;
+      return;
+    }
+    slot = (slot + 1) & (MDFS_INDEX_SLOTS - 1);
+  }
+  mdfs->index[slot].index = (uint16_t)i;
+  mdfs->index[slot].tag = (uint16_t)(h >> 16);
+#else
+  (void)mdfs;
+  (void)i;
+#endif
+}
 
+/* Drop the slot of file_list[i], if indexed. Slots further along the probe 
+ * chain shift back into the hole so lookups still reach them. */
+static void _mdfs_index_delete(mdfs_t* mdfs, int i)
+{
+#if MDFS_USE_HASH_INDEX
+  uint32_t hole = _mdfs_index_find(mdfs, mdfs->file_list[i].filename, i);
+  if (hole == MDFS_INDEX_SLOTS) return;
+  uint32_t slot = (hole + 1) & (MDFS_INDEX_SLOTS - 1);
+  while (mdfs->index[slot].index != MDFS_INDEX_EMPTY)
+  {
+    const char* name = mdfs->file_list[mdfs->index[slot].index].filename;
+    uint32_t home = _mdfs_hash_name(name) & (MDFS_INDEX_SLOTS - 1);
+    // Can move when the hole is between home and slot
+    if (((slot - home) & (MDFS_INDEX_SLOTS - 1)) >= ((slot - hole) & (MDFS_INDEX_SLOTS - 1)))
+    {
+      mdfs->index[hole] = mdfs->index[slot];
+      hole = slot;
+    }
+    slot = (slot + 1) & (MDFS_INDEX_SLOTS - 1);
+  }
+  mdfs->index[hole].index = MDFS_INDEX_EMPTY;
+#else
+  (void)mdfs;
+  (void)i;
+#endif
+}
 
-  // printf("reading %i elements of %i bytes\n", count, size);
-  // printf("offset = %i, base = 0x%p, size = %i\n", f->offset, f->base, f->size);
+/* The entry that was at from is at to now (file_list[to]) */
+static void _mdfs_index_move(mdfs_t* mdfs, int from, int to)
+{
+#if MDFS_USE_HASH_INDEX
+  uint32_t slot = _mdfs_index_find(mdfs, mdfs->file_list[to].filename, from);
+  if (slot != MDFS_INDEX_SLOTS) mdfs->index[slot].index = (uint16_t)to;
+#else
+  (void)mdfs;
+  (void)from;
+  (void)to;
+#endif
+}
 
-  if (f->offset + count <= f->size) // if we can fit entire count still
+/// Returns -1 if file doesn't exist
+static int _mdfs_get_file_index(mdfs_t* mdfs, const char* filename)
+{
+#if MDFS_USE_HASH_INDEX
+  // There are always empty slots (MDFS_INDEX_SLOTS > MDFS_MAX_FILECOUNT) so 
+  // the probe ends.
+  uint32_t h = _mdfs_hash_name(filename);
+  uint32_t slot = h & (MDFS_INDEX_SLOTS - 1);
+  while (mdfs->index[slot].index != MDFS_INDEX_EMPTY)
   {
-    memcpy(ptr, (void*)(f->base + f->offset), count);
-    f->offset += count;
-    return count;
+    int i = mdfs->index[slot].index;
+    if (mdfs->index[slot].tag == (uint16_t)(h >> 16) &&
+        strcmp(mdfs->file_list[i].filename, filename) == 0)
+    {
+      return i;
+    }
+    slot = (slot + 1) & (MDFS_INDEX_SLOTS - 1);
   }
-  else
+  return -1;
+#else
+  int i = 0;
+  for (i = 0; i < mdfs->file_count; ++i)
   {
-    // count doesn't fit
-    int n = f->size - f->offset;
-    if (n < 0) return 0;
-    memcpy(ptr, (void*)(f->base + f->offset), n);
-    f->offset += n;
-    return n;
+    if (strcmp(mdfs->file_list[i].filename, filename) == 0) return i;
   }
+  return -1;
+#endif
+}
 
+#if MDFS_USE_EXTENT_MAP
+/* First position in extents that is not smaller than (size, offset) */
+static int _mdfs_extent_lower_bound(mdfs_t* mdfs, uint32_t size, uint32_t offset)
+{
+  int lo = 0, hi = mdfs->extent_count;
+  while (lo < hi)
+  {
+    int mid = (lo + hi) / 2;
+    const mdfs_extent_t* e = &mdfs->extents[mid];
+    if (e->size < size || (e->size == size && e->offset < offset)) lo = mid + 1;
+    else hi = mid;
+  }
+  return lo;
 }
 
+/* Binary search for the position, then a memmove of the larger gaps behind it,
+ * O(gaps) in the worst case */
+static void _mdfs_extent_insert(mdfs_t* mdfs, uint32_t offset, uint32_t size)
+{
+  // There's at most one gap in front of every file, so this never overflows
+  if (size == 0 || mdfs->extent_count >= MDFS_MAX_FILECOUNT) return;
+  int i = _mdfs_extent_lower_bound(mdfs, size, offset);
+  memmove((void*)&mdfs->extents[i+1], (void*)&mdfs->extents[i],
+    (mdfs->extent_count - i) * sizeof(mdfs_extent_t));
+  mdfs->extents[i].offset = offset;
+  mdfs->extents[i].size = size;
+  ++mdfs->extent_count;
+}
 
-int mdfs_feof(mdfs_FILE* f)
+static int _mdfs_extent_cmp(const void* a, const void* b)
 {
-  return f->size == f->offset ? 1 : 0;
+  const mdfs_extent_t* ea = (const mdfs_extent_t*)a;
+  const mdfs_extent_t* eb = (const mdfs_extent_t*)b;
+  if (ea->size != eb->size) return ea->size < eb->size ? -1 : 1;
+  if (ea->offset != eb->offset) return ea->offset < eb->offset ? -1 : 1;
+  return 0;
 }
+#endif
 
-static mdfs_file_t* _mdfs_alloc_entry(const char* filename, int filesize, uint32_t byte_offset)
+/** @brief Rebuild the extent map (gaps between files) from file_list
+ * 
+ * Done after the list is built and after removing files, for 
+ * mdfs_init_direct on the first add. Adding a file updates the map in place, 
+ * see _mdfs_extent_take.
+ */
+static void _mdfs_extents_rebuild(mdfs_t* mdfs)
 {
-  mdfs_file_t* new_entry = calloc(1, sizeof(mdfs_file_t));
-  snprintf(new_entry->filename, MDFS_MAX_FILENAME, "%s", filename);
-  new_entry->size = filesize;
-  new_entry->byte_offset = byte_offset;
-  new_entry->crc = 0;
-  return new_entry;
+#if MDFS_USE_EXTENT_MAP
+  mdfs->flags &= ~MDFS_FLAG_EXTENTS_STALE;
+  uint32_t end = MDFS_BLOCKSIZE;
+  int i;
+  mdfs->extent_count = 0;
+  for (i = 0; i < mdfs->file_count; ++i)
+  {
+    const mdfs_file_t* file = &mdfs->file_list[i];
+    if (file->byte_offset > end)
+    {
+      mdfs->extents[mdfs->extent_count].offset = end;
+      mdfs->extents[mdfs->extent_count].size = file->byte_offset - end;
+      ++mdfs->extent_count;
+    }
+    if (file->byte_offset + file->size > end) end = file->byte_offset + file->size;
+  }
+  mdfs->free_end = end;
+  qsort((void*)mdfs->extents, mdfs->extent_count, sizeof(mdfs_extent_t), _mdfs_extent_cmp);
+#endif
 }
 
+/* Returns 1 when gap can hold size bytes at an aligned offset and is a better
+ * pick than best */
+static int _mdfs_gap_better(mdfs_t* mdfs, uint32_t size, uint32_t align, const mdfs_extent_t* gap, const mdfs_extent_t* best)
+{
+  uint64_t start = _MDFS_ALIGN_UP((uint64_t)gap->offset, align);
+  if (start + size > (uint64_t)gap->offset + gap->size) return 0;
+  if (best == NULL) return 1;
+  switch (mdfs->alloc_policy)
+  {
+  case MDFS_ALLOC_BEST_FIT:
+    if (gap->size != best->size) return gap->size < best->size;
+    return gap->offset < best->offset;
+  case MDFS_ALLOC_NEXT_FIT:
+  {
+    // Gaps from the rover on come first, then the ones before it
+    int gap_wrapped = gap->offset < mdfs->alloc_rover;
+    int best_wrapped = best->offset < mdfs->alloc_rover;
+    if (gap_wrapped != best_wrapped) return best_wrapped;
+    return gap->offset < best->offset;
+  }
+  default:
+    return gap->offset < best->offset;
+  }
+}
 
+/** @brief Find room for size bytes according to alloc_policy
+ * 
+ * With the extent map, gaps smaller than size are skipped with a binary 
+ * search. Best fit stops at the first gap that fits, first and next fit scan
+ * all remaining gaps for the lowest offset. Without the map the whole file 
+ * list is walked.
+ * 
+ * @param align Power of 2, the returned offset is a multiple of it
+ * @param gap_pos Set to the position of the gap in extents, -1 when the file 
+ * goes after the last file (or there's no extent map).
+ * @returns The byte offset for the new file
+ */
+static uint32_t _mdfs_find_space(mdfs_t* mdfs, uint32_t size, uint32_t align, int* gap_pos)
+{
+  const mdfs_extent_t* best = NULL;
+  *gap_pos = -1;
+#if MDFS_USE_EXTENT_MAP
+  if (mdfs->flags & MDFS_FLAG_EXTENTS_STALE) _mdfs_extents_rebuild(mdfs);
+  // Everything before lower bound is too small
+  int i = _mdfs_extent_lower_bound(mdfs, size, 0);
+  for (; i < mdfs->extent_count; ++i)
+  {
+    if (_mdfs_gap_better(mdfs, size, align, &mdfs->extents[i], best))
+    {
+      best = &mdfs->extents[i];
+      // Ordered by size, the first one that fits is the best fit
+      if (mdfs->alloc_policy == MDFS_ALLOC_BEST_FIT) break;
+    }
+  }
+  if (best == NULL) return _MDFS_ALIGN_UP(mdfs->free_end, align);
+  *gap_pos = best - mdfs->extents;
+  return _MDFS_ALIGN_UP(best->offset, align);
+#else
+  // No map, walk the gaps between files
+  mdfs_extent_t gap, found;
+  uint32_t end = MDFS_BLOCKSIZE;
+  int i;
+  for (i = 0; i < mdfs->file_count; ++i)
+  {
+    const mdfs_file_t* file = &mdfs->file_list[i];
+    if (file->byte_offset > end)
+    {
+      gap.offset = end;
+      gap.size = file->byte_offset - end;
+      if (_mdfs_gap_better(mdfs, size, align, &gap, best))
+      {
+        found = gap;
+        best = &found;
+      }
+    }
+    if (file->byte_offset + file->size > end) end = file->byte_offset + file->size;
+  }
+  // Gaps don't know about queued adds, those go after everything
+  if (mdfs->batch != NULL) return _MDFS_ALIGN_UP(end > mdfs->batch->end ? end : mdfs->batch->end, align);
+  return _MDFS_ALIGN_UP(best ? best->offset : end, align);
+#endif
+}
 
-int mdfs_fgetc(mdfs_FILE* f)
+/* Update the extent map for a new file of size at offset, in the gap at 
+ * gap_pos or after the last file when gap_pos < 0. Whatever is left of the gap
+ * on either side goes back into the map. Removing and inserting move the 
+ * entries behind them, O(gaps).
+ */
+static void _mdfs_extent_take(mdfs_t* mdfs, int gap_pos, uint32_t offset, uint32_t size)
 {
-  if (mdfs_feof(f)) return MDFS_EOF;
-  return (int)(*(uint8_t*)(f->base + f->offset++));
+#if MDFS_USE_EXTENT_MAP
+  if (gap_pos < 0)
+  {
+    if (offset > mdfs->free_end) _mdfs_extent_insert(mdfs, mdfs->free_end, offset - mdfs->free_end);
+    mdfs->free_end = offset + size;
+    return;
+  }
+  mdfs_extent_t gap = mdfs->extents[gap_pos];
+  memmove((void*)&mdfs->extents[gap_pos], (void*)&mdfs->extents[gap_pos+1],
+    (mdfs->extent_count - gap_pos - 1) * sizeof(mdfs_extent_t));
+  --mdfs->extent_count;
+  _mdfs_extent_insert(mdfs, gap.offset, offset - gap.offset);
+  _mdfs_extent_insert(mdfs, offset + size, gap.offset + gap.size - offset - size);
+#endif
 }
 
 
-static int _mdfs_insert(mdfs_t* mdfs, mdfs_file_t* entry, int index)
+// ------------------------------------------------------------------
+
+// CRC engines. All work on the raw (not inverted) crc state so they can be 
+// chained, mdfs_calc_crc does the 0xffffffff init and final xor.
+// Tables are generated with included crc32_table_gen.py --mdfs
+
+/* One table lookup per byte */
+static uint32_t _mdfs_crc_bytewise(uint32_t crc, const uint8_t* p, size_t n)
 {
-	if (mdfs->file_count >= MDFS_MAX_FILECOUNT) return -2; // Error: No room
-	if (index == mdfs->file_count)
-	{
-		// New file at end of list, make room and copy entry into it.
-		_MDFS_INCREMENT_FILE_COUNT(mdfs);
-    memcpy((void*)&mdfs->file_list[index], (void*)entry, sizeof(mdfs_file_t));
-    _mdfs_update_file_list_crc(mdfs);
-		return 0;
-	}
-	else if (index > mdfs->file_count)
-	{
-		// Wut? what are you doing?
-		return -1; // Error: Illegal index
-	}
-	else
-	{
-		// Insert at existing index. 
-    // Make room
-		_MDFS_INCREMENT_FILE_COUNT(mdfs);
-    // Shift everything down
-    // ex: Insert at 1 with file_count 5->6: copy items at 1..5 to 2..6
-    // copy to 5 to 6 first, then move back. (we're not betting on cache/memcpy 
-    // implementation fixing this for us)
-    int i;
-    for (i = mdfs->file_count-1; i > index; --i)
-    {
-      memcpy(
-        (void*)&mdfs->file_list[i],
-        (void*)&mdfs->file_list[i-1],
-        sizeof(mdfs_file_t));
-    }
-    // Copy entry into index
-    memcpy((void*)&mdfs->file_list[index], (void*)entry, sizeof(mdfs_file_t));
-    _mdfs_update_file_list_crc(mdfs);
-		return 0;
-	}
+  while (n-- != 0)
+  {
+    crc = _mdfs_crc_table[0][(uint8_t)crc ^ *p++] ^ (crc >> 8);
+  }
+  return crc;
 }
 
-/// Returns -1 if file doesn't exist
-static int _mdfs_get_file_index(mdfs_t* mdfs, const char* filename)
+/* Slice-by-8, 8 bytes per step using 8 tables */
+static uint32_t _mdfs_crc_slice8(uint32_t crc, const uint8_t* p, size_t n)
 {
-  int i = 0;
-  for (i = 0; i < mdfs->file_count; ++i)
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+  // Byte-wise until aligned, some targets don't like unaligned word reads
+  while (n != 0 && ((uintptr_t)p & 3))
   {
-    if (strcmp(mdfs->file_list[i].filename, filename) == 0) return i;
+    crc = _mdfs_crc_table[0][(uint8_t)crc ^ *p++] ^ (crc >> 8);
+    --n;
   }
-  return -1;
+  while (n >= 8)
+  {
+    uint32_t one, two;
+    memcpy(&one, p, 4);
+    memcpy(&two, p + 4, 4);
+    one ^= crc;
+    crc = 
+      _mdfs_crc_table[7][one & 0xFF] ^
+      _mdfs_crc_table[6][(one >> 8) & 0xFF] ^
+      _mdfs_crc_table[5][(one >> 16) & 0xFF] ^
+      _mdfs_crc_table[4][one >> 24] ^
+      _mdfs_crc_table[3][two & 0xFF] ^
+      _mdfs_crc_table[2][(two >> 8) & 0xFF] ^
+      _mdfs_crc_table[1][(two >> 16) & 0xFF] ^
+      _mdfs_crc_table[0][two >> 24];
+    p += 8;
+    n -= 8;
+  }
+#endif
+  return _mdfs_crc_bytewise(crc, p, n);
 }
 
+#if MDFS_HAVE_PCLMUL
+/* Folding with carry-less multiply, 64 bytes per step.
+ *
+ * Same scheme as Intel's "Fast CRC Computation for Generic Polynomials Using
+ * PCLMULQDQ". The constants are (x^n mod P)' << 1 for our polynomial:
+ * x^(4*128+32), x^(4*128-32) for the 4-way fold, x^(128+32), x^(128-32) for
+ * the single fold. Instead of a Barrett reduction the last 16 folded bytes are
+ * run through slice-by-8 starting from 0, which gives the same state.
+ */
+__attribute__((target("pclmul,sse2")))
+static uint32_t _mdfs_crc_pclmul(uint32_t crc, const uint8_t* p, size_t n)
+{
+  if (n < 64) return _mdfs_crc_slice8(crc, p, n);
+  const __m128i k4 = _mm_set_epi64x(0x1BEFBE2DCLL, 0x1B13E1ECELL);
+  const __m128i k1 = _mm_set_epi64x(0x0FF647C46LL, 0x0504CEA8CLL);
+  __m128i x0 = _mm_xor_si128(_mm_loadu_si128((const __m128i*)p), _mm_cvtsi32_si128((int)crc));
+  __m128i x1 = _mm_loadu_si128((const __m128i*)(p + 16));
+  __m128i x2 = _mm_loadu_si128((const __m128i*)(p + 32));
+  __m128i x3 = _mm_loadu_si128((const __m128i*)(p + 48));
+  p += 64;
+  n -= 64;
+
+#define _MDFS_FOLD(x, k, d) \
+  _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128((x), (k), 0x00), \
+    _mm_clmulepi64_si128((x), (k), 0x11)), (d))
 
-// ------------------------------------------------------------------
+  while (n >= 64)
+  {
+    x0 = _MDFS_FOLD(x0, k4, _mm_loadu_si128((const __m128i*)p));
+    x1 = _MDFS_FOLD(x1, k4, _mm_loadu_si128((const __m128i*)(p + 16)));
+    x2 = _MDFS_FOLD(x2, k4, _mm_loadu_si128((const __m128i*)(p + 32)));
+    x3 = _MDFS_FOLD(x3, k4, _mm_loadu_si128((const __m128i*)(p + 48)));
+    p += 64;
+    n -= 64;
+  }
+  x0 = _MDFS_FOLD(x0, k1, x1);
+  x0 = _MDFS_FOLD(x0, k1, x2);
+  x0 = _MDFS_FOLD(x0, k1, x3);
+  while (n >= 16)
+  {
+    x0 = _MDFS_FOLD(x0, k1, _mm_loadu_si128((const __m128i*)p));
+    p += 16;
+    n -= 16;
+  }
+#undef _MDFS_FOLD
+
+  uint8_t folded[16];
+  _mm_storeu_si128((__m128i*)folded, x0);
+  crc = _mdfs_crc_slice8(0, folded, 16);
+  return _mdfs_crc_slice8(crc, p, n);
+}
+#endif
+
+/** @brief Check if a crc engine can be used on this machine
+ * 
+ * @param engine One of the MDFS_CRC_ENGINE_ defines
+ * @returns 1 when available, 0 otherwise
+ * @ingroup mdfs
+ */
+int mdfs_crc_engine_available(int engine)
+{
+  switch (engine)
+  {
+  case MDFS_CRC_ENGINE_AUTO:
+  case MDFS_CRC_ENGINE_BYTEWISE:
+  case MDFS_CRC_ENGINE_SLICE8:
+    return 1;
+#if MDFS_HAVE_PCLMUL
+  case MDFS_CRC_ENGINE_PCLMUL:
+    return __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse2");
+#endif
+  default:
+    return 0;
+  }
+}
+
+/* Run the fastest available engine over the raw crc state */
+static uint32_t _mdfs_crc_update(uint32_t crc, const uint8_t* p, size_t n)
+{
+#if MDFS_HAVE_PCLMUL
+  static int has_pclmul = -1;
+  if (has_pclmul < 0) has_pclmul = mdfs_crc_engine_available(MDFS_CRC_ENGINE_PCLMUL);
+  if (has_pclmul) return _mdfs_crc_pclmul(crc, p, n);
+#endif
+  return _mdfs_crc_slice8(crc, p, n);
+}
 
 /** @brief Caculate the crc for for data
  * 
  * @copybrief mdfs_calc_crc
  * Polynomial is 0xc9d204f5 (in implicit + 1 notation). 0x93a409eb in wikipedia's
  * normal representation.
+ * Uses the fastest engine available, see @ref mdfs_calc_crc_engine.
  * @param data A pointer to the data to calculate the crc over.
  * @param size The number of bytes in data.
  * @returns the calculated crc. 0xFFFFFFFF in case of invalid sizes or NULL 
@@ -571,86 +2897,131 @@ static int _mdfs_get_file_index(mdfs_t* mdfs, const char* filename)
  */
 uint32_t mdfs_calc_crc(const void* data, int32_t size)
 {
-  // default crc impl. don't care about speed
-  // https://wiki.osdev.org/CRC32
-  // polynomial = 0x93a409eb (bit per term, x^32 implicit)
-  // Below table is generated with included crc32_gen_table.py
-  static const uint32_t _table[256] = {
-    0x00000000, 0x3CD0EADC, 0x79A1D5B8, 0x45713F64,
-    0xF343AB70, 0xCF9341AC, 0x8AE27EC8, 0xB6329414,
-    0x49A71D73, 0x7577F7AF, 0x3006C8CB, 0x0CD62217,
-    0xBAE4B603, 0x86345CDF, 0xC34563BB, 0xFF958967,
-    0x934E3AE6, 0xAF9ED03A, 0xEAEFEF5E, 0xD63F0582,
-    0x600D9196, 0x5CDD7B4A, 0x19AC442E, 0x257CAEF2,
-    0xDAE92795, 0xE639CD49, 0xA348F22D, 0x9F9818F1,
-    0x29AA8CE5, 0x157A6639, 0x500B595D, 0x6CDBB381,
-    0x89BC3E5F, 0xB56CD483, 0xF01DEBE7, 0xCCCD013B,
-    0x7AFF952F, 0x462F7FF3, 0x035E4097, 0x3F8EAA4B,
-    0xC01B232C, 0xFCCBC9F0, 0xB9BAF694, 0x856A1C48,
-    0x3358885C, 0x0F886280, 0x4AF95DE4, 0x7629B738,
-    0x1AF204B9, 0x2622EE65, 0x6353D101, 0x5F833BDD,
-    0xE9B1AFC9, 0xD5614515, 0x90107A71, 0xACC090AD,
-    0x535519CA, 0x6F85F316, 0x2AF4CC72, 0x162426AE,
-    0xA016B2BA, 0x9CC65866, 0xD9B76702, 0xE5678DDE,
-    0xBC58372D, 0x8088DDF1, 0xC5F9E295, 0xF9290849,
-    0x4F1B9C5D, 0x73CB7681, 0x36BA49E5, 0x0A6AA339,
-    0xF5FF2A5E, 0xC92FC082, 0x8C5EFFE6, 0xB08E153A,
-    0x06BC812E, 0x3A6C6BF2, 0x7F1D5496, 0x43CDBE4A,
-    0x2F160DCB, 0x13C6E717, 0x56B7D873, 0x6A6732AF,
-    0xDC55A6BB, 0xE0854C67, 0xA5F47303, 0x992499DF,
-    0x66B110B8, 0x5A61FA64, 0x1F10C500, 0x23C02FDC,
-    0x95F2BBC8, 0xA9225114, 0xEC536E70, 0xD08384AC,
-    0x35E40972, 0x0934E3AE, 0x4C45DCCA, 0x70953616,
-    0xC6A7A202, 0xFA7748DE, 0xBF0677BA, 0x83D69D66,
-    0x7C431401, 0x4093FEDD, 0x05E2C1B9, 0x39322B65,
-    0x8F00BF71, 0xB3D055AD, 0xF6A16AC9, 0xCA718015,
-    0xA6AA3394, 0x9A7AD948, 0xDF0BE62C, 0xE3DB0CF0,
-    0x55E998E4, 0x69397238, 0x2C484D5C, 0x1098A780,
-    0xEF0D2EE7, 0xD3DDC43B, 0x96ACFB5F, 0xAA7C1183,
-    0x1C4E8597, 0x209E6F4B, 0x65EF502F, 0x593FBAF3,
-    0xD79025C9, 0xEB40CF15, 0xAE31F071, 0x92E11AAD,
-    0x24D38EB9, 0x18036465, 0x5D725B01, 0x61A2B1DD,
-    0x9E3738BA, 0xA2E7D266, 0xE796ED02, 0xDB4607DE,
-    0x6D7493CA, 0x51A47916, 0x14D54672, 0x2805ACAE,
-    0x44DE1F2F, 0x780EF5F3, 0x3D7FCA97, 0x01AF204B,
-    0xB79DB45F, 0x8B4D5E83, 0xCE3C61E7, 0xF2EC8B3B,
-    0x0D79025C, 0x31A9E880, 0x74D8D7E4, 0x48083D38,
-    0xFE3AA92C, 0xC2EA43F0, 0x879B7C94, 0xBB4B9648,
-    0x5E2C1B96, 0x62FCF14A, 0x278DCE2E, 0x1B5D24F2,
-    0xAD6FB0E6, 0x91BF5A3A, 0xD4CE655E, 0xE81E8F82,
-    0x178B06E5, 0x2B5BEC39, 0x6E2AD35D, 0x52FA3981,
-    0xE4C8AD95, 0xD8184749, 0x9D69782D, 0xA1B992F1,
-    0xCD622170, 0xF1B2CBAC, 0xB4C3F4C8, 0x88131E14,
-    0x3E218A00, 0x02F160DC, 0x47805FB8, 0x7B50B564,
-    0x84C53C03, 0xB815D6DF, 0xFD64E9BB, 0xC1B40367,
-    0x77869773, 0x4B567DAF, 0x0E2742CB, 0x32F7A817,
-    0x6BC812E4, 0x5718F838, 0x1269C75C, 0x2EB92D80,
-    0x988BB994, 0xA45B5348, 0xE12A6C2C, 0xDDFA86F0,
-    0x226F0F97, 0x1EBFE54B, 0x5BCEDA2F, 0x671E30F3,
-    0xD12CA4E7, 0xEDFC4E3B, 0xA88D715F, 0x945D9B83,
-    0xF8862802, 0xC456C2DE, 0x8127FDBA, 0xBDF71766,
-    0x0BC58372, 0x371569AE, 0x726456CA, 0x4EB4BC16,
-    0xB1213571, 0x8DF1DFAD, 0xC880E0C9, 0xF4500A15,
-    0x42629E01, 0x7EB274DD, 0x3BC34BB9, 0x0713A165,
-    0xE2742CBB, 0xDEA4C667, 0x9BD5F903, 0xA70513DF,
-    0x113787CB, 0x2DE76D17, 0x68965273, 0x5446B8AF,
-    0xABD331C8, 0x9703DB14, 0xD272E470, 0xEEA20EAC,
-    0x58909AB8, 0x64407064, 0x21314F00, 0x1DE1A5DC,
-    0x713A165D, 0x4DEAFC81, 0x089BC3E5, 0x344B2939,
-    0x8279BD2D, 0xBEA957F1, 0xFBD86895, 0xC7088249,
-    0x389D0B2E, 0x044DE1F2, 0x413CDE96, 0x7DEC344A,
-    0xCBDEA05E, 0xF70E4A82, 0xB27F75E6, 0x8EAF9F3A};
+  return mdfs_calc_crc_engine(data, size, MDFS_CRC_ENGINE_AUTO);
+}
 
+/** @brief Caculate the crc for data with a specific engine
+ * 
+ * @copybrief mdfs_calc_crc_engine
+ * All engines give the same result as @ref mdfs_calc_crc, this is mostly
+ * useful for testing and benchmarking.
+ * @param data A pointer to the data to calculate the crc over.
+ * @param size The number of bytes in data.
+ * @param engine One of the MDFS_CRC_ENGINE_ defines. Unavailable engines fall
+ * back to MDFS_CRC_ENGINE_AUTO, see @ref mdfs_crc_engine_available.
+ * @returns the calculated crc. 0xFFFFFFFF in case of invalid sizes or NULL 
+ * data.
+ * @ingroup mdfs
+ */
+uint32_t mdfs_calc_crc_engine(const void* data, int32_t size, int engine)
+{
   uint32_t crc = 0xffffffff;
   if (size <= 0 || data == NULL) return crc;
-	while (size-- !=0)
+  if (!mdfs_crc_engine_available(engine)) engine = MDFS_CRC_ENGINE_AUTO;
+  switch (engine)
   {
-    crc = _table[(((uint8_t) crc) ^ *(uint8_t*)(data++))] ^ (crc >> 8);
-  } 
+  case MDFS_CRC_ENGINE_BYTEWISE:
+    crc = _mdfs_crc_bytewise(crc, (const uint8_t*)data, size);
+    break;
+  case MDFS_CRC_ENGINE_SLICE8:
+    crc = _mdfs_crc_slice8(crc, (const uint8_t*)data, size);
+    break;
+#if MDFS_HAVE_PCLMUL
+  case MDFS_CRC_ENGINE_PCLMUL:
+    crc = _mdfs_crc_pclmul(crc, (const uint8_t*)data, size);
+    break;
+#endif
+  default:
+    crc = _mdfs_crc_update(crc, (const uint8_t*)data, size);
+    break;
+  }
 	return (crc ^ 0xffffffff);
 }
 
 
+/** @brief Start a streaming crc calculation
+ * 
+ * @copybrief mdfs_crc_init
+ * Use @ref mdfs_crc_update for every chunk of data and @ref mdfs_crc_final to
+ * get the crc. The result is the same as @ref mdfs_calc_crc over all chunks
+ * in one go, except for 0 bytes of data: that gives 0 here.
+ * @param ctx The context to initialize
+ * @ingroup mdfs
+ */
+void mdfs_crc_init(mdfs_crc_t* ctx)
+{
+  ctx->state = 0xffffffff;
+}
+
+/** @brief Add a chunk of data to a streaming crc
+ * 
+ * @param ctx Context initialized with @ref mdfs_crc_init
+ * @param data The next chunk of data
+ * @param size Number of bytes in data, may be 0
+ * @ingroup mdfs
+ */
+void mdfs_crc_update(mdfs_crc_t* ctx, const void* data, size_t size)
+{
+  if (size == 0 || data == NULL) return;
+  ctx->state = _mdfs_crc_update(ctx->state, (const uint8_t*)data, size);
+}
+
+/** @brief Get the crc of all data passed to @ref mdfs_crc_update so far
+ * 
+ * The context is not changed, more data can be added after this.
+ * @ingroup mdfs
+ */
+uint32_t mdfs_crc_final(const mdfs_crc_t* ctx)
+{
+  return ctx->state ^ 0xffffffff;
+}
+
+/* a * b modulo the polynomial, reflected (bit 31 is x^0) */
+static uint32_t _mdfs_crc_multmodp(uint32_t a, uint32_t b)
+{
+  uint32_t m = (uint32_t)1 << 31;
+  uint32_t p = 0;
+  while (1)
+  {
+    if (a & m)
+    {
+      p ^= b;
+      if ((a & (m - 1)) == 0) break;
+    }
+    m >>= 1;
+    b = (b & 1) ? (b >> 1) ^ _MDFS_CRC_POLY_REFLECTED : b >> 1;
+  }
+  return p;
+}
+
+/** @brief Combine the crcs of two consecutive blocks of data
+ * 
+ * @copybrief mdfs_crc_combine
+ * Gives the crc of A followed by B from the crc of A, the crc of B and the
+ * length of B. Costs O(log(len2)), the data itself isn't needed. Works on
+ * the values from @ref mdfs_crc_final and @ref mdfs_calc_crc (for non-empty
+ * blocks).
+ * @param crc1 crc of the first block
+ * @param crc2 crc of the second block
+ * @param len2 Length of the second block in bytes
+ * @returns The crc of both blocks
+ * @ingroup mdfs
+ */
+uint32_t mdfs_crc_combine(uint32_t crc1, uint32_t crc2, size_t len2)
+{
+  // crc1 * x^(8*len2) + crc2, same as zlib's crc32_combine
+  uint32_t xn = (uint32_t)1 << 31; // x^0
+  int k = 3;
+  while (len2)
+  {
+    if (len2 & 1) xn = _mdfs_crc_multmodp(_mdfs_crc_x2n_table[k & 31], xn);
+    len2 >>= 1;
+    ++k;
+  }
+  return _mdfs_crc_multmodp(xn, crc1) ^ crc2;
+}
+
+
 /** @brief Read file and check crc
  * 
  * @copybrief mdfs_check_crc
@@ -662,8 +3033,8 @@ uint32_t mdfs_calc_crc(const void* data, int32_t size)
  */
 int mdfs_check_crc(const mdfs_FILE* f)
 {
-  void* data = f->base + f->offset;
-  uint32_t crc = mdfs_calc_crc(data, f->size);
+  uint32_t crc;
+  if (_mdfs_crc_at(f->mdfs, f->byte_offset, f->size, &crc)) return 0;
   if (crc == f->crc) return 1;
   else return 0;
 }
@@ -680,6 +3051,7 @@ int mdfs_check_crc(const mdfs_FILE* f)
  */
 int mdfs_check_file_list_crc(mdfs_t* mdfs)
 {
+  _MDFS_READ_LOCK(mdfs);
   uint32_t calc = mdfs_calc_crc(mdfs->file_list, mdfs->file_count * sizeof(mdfs_file_t));
   uint32_t stored = mdfs_get_file_list_crc(mdfs);
   if (calc == stored) return 1;
@@ -700,8 +3072,10 @@ int mdfs_check_file_list_crc(mdfs_t* mdfs)
  */
 int mdfs_set_crc(mdfs_t* mdfs, const char* filename, uint32_t crc)
 {
+  _MDFS_WRITE_LOCK(mdfs);
   int i = _mdfs_get_file_index(mdfs, filename);
   if (i < 0) return -1;
+  if (_mdfs_make_writable(mdfs)) return -1;
   mdfs->file_list[i].crc = crc;
   return 0;
 }
@@ -718,10 +3092,186 @@ int mdfs_set_crc(mdfs_t* mdfs, const char* filename, uint32_t crc)
  */
 int mdfs_update_crc(mdfs_t* mdfs, const char* filename)
 {
-  mdfs_FILE* f = mdfs_fopen(mdfs, filename, "r");
-  if (f == NULL) return -1;
-  mdfs->file_list[f->index].crc = mdfs_calc_crc(
-    (void*)(f->base + f->offset),
-    f->size);
+  _MDFS_WRITE_LOCK(mdfs);
+  int i = _mdfs_get_file_index(mdfs, filename);
+  if (i < 0)
+  {
+    snprintf(_MDFS_ERROR_BUF(mdfs), MDFS_ERROR_LEN, "File not found");
+    errno = ENOENT;
+    return -1;
+  }
+  mdfs_file_t* file = &mdfs->file_list[i];
+  if (!_mdfs_in_image(mdfs, file))
+  {
+    snprintf(_MDFS_ERROR_BUF(mdfs), MDFS_ERROR_LEN, "File outside image");
+    errno = ENXIO;
+    return -1;
+  }
+  if (_mdfs_make_writable(mdfs)) return -1;
+  file = &mdfs->file_list[i];
+  if (_mdfs_crc_at(mdfs, file->byte_offset, file->size, &file->crc))
+  {
+    snprintf(_MDFS_ERROR_BUF(mdfs), MDFS_ERROR_LEN, "Device read failed");
+    errno = EIO;
+    return -1;
+  }
   return 0;
 }
+
+
+// A piece of a file for mdfs_verify_all
+typedef struct MDFSVerifyChunk {
+  uint32_t file; // Index in file_list
+  uint32_t start; // From the start of the file
+  uint32_t size;
+  uint32_t crc;
+  int failed; // The device couldn't read the chunk
+} _mdfs_verify_chunk_t;
+
+typedef struct MDFSVerifyJob {
+  mdfs_t* mdfs;
+  _mdfs_verify_chunk_t* chunks;
+  uint32_t count;
+  uint32_t next; // Next chunk to do, taken with an atomic add
+} _mdfs_verify_job_t;
+
+static void* _mdfs_verify_worker(void* arg)
+{
+  _mdfs_verify_job_t* job = (_mdfs_verify_job_t*)arg;
+  while (1)
+  {
+    uint32_t i = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED);
+    if (i >= job->count) break;
+    _mdfs_verify_chunk_t* c = &job->chunks[i];
+    const mdfs_file_t* file = &job->mdfs->file_list[c->file];
+    c->crc = 0;
+    if (!_mdfs_in_image(job->mdfs, file)) continue; // Fails anyway
+    c->failed = _mdfs_crc_at(job->mdfs, file->byte_offset + c->start, c->size, &c->crc);
+  }
+  return NULL;
+}
+
+/* Set or clear bit i of the optional bitmap of mdfs_verify_all */
+static void _mdfs_verify_mark(uint8_t* bitmap, uint32_t i, int ok)
+{
+  if (bitmap == NULL) return;
+  if (ok) bitmap[i / 8] |= (uint8_t)(1 << (i % 8));
+  else bitmap[i / 8] &= (uint8_t)~(1 << (i % 8));
+}
+
+/* mdfs_verify_all for mdfs_init_static, which mustn't malloc: no chunk list
+ * and no threads, one file after the other. The lock is held. */
+static int _mdfs_verify_all_static(mdfs_t* mdfs, uint8_t* bitmap)
+{
+  int failed = 0;
+  uint32_t i;
+  for (i = 0; i < mdfs->file_count; ++i)
+  {
+    const mdfs_file_t* file = &mdfs->file_list[i];
+    uint32_t crc = 0;
+    int ok = _mdfs_in_image(mdfs, file) && 
+      _mdfs_crc_at(mdfs, file->byte_offset, file->size, &crc) == 0 && crc == file->crc;
+    if (!ok) ++failed;
+    _mdfs_verify_mark(bitmap, i, ok);
+  }
+  if (mdfs_calc_crc(mdfs->file_list, mdfs->file_count * sizeof(mdfs_file_t)) != mdfs_get_file_list_crc(mdfs)) ++failed;
+  return failed;
+}
+
+/** @brief Check the crc of every file and of the file list
+ * 
+ * @copybrief mdfs_verify_all
+ * Files are split in chunks of MDFS_VERIFY_CHUNK bytes, the chunks are spread
+ * over threads and the crcs of the chunks of a file are combined with 
+ * @ref mdfs_crc_combine. Large and small files alike keep all threads busy.
+ * Without MDFS_USE_PTHREADS, or for an mdfs from @ref mdfs_init_ex (device 
+ * reads are done one at a time), everything runs on the calling thread.
+ * For an mdfs from @ref mdfs_init_static nothing is allocated: files are 
+ * checked whole, one after the other on the calling thread, threads is 
+ * ignored.
+ * 
+ * @param threads Number of threads to use, 0 for one per online cpu.
+ * @param bitmap Optional, at least (file count + 7) / 8 bytes. Bit i (bit 
+ * i % 8 of byte i / 8) is set when file i is OK and cleared otherwise.
+ * @returns The number of files with a wrong crc, plus 1 when the file list 
+ * crc is wrong. So 0 means everything is OK. -1 when out of memory (error is
+ * set).
+ * @ingroup mdfs
+ */
+int mdfs_verify_all(mdfs_t* mdfs, int threads, uint8_t* bitmap)
+{
+  _MDFS_READ_LOCK(mdfs);
+  if (mdfs->flags & MDFS_FLAG_STATIC) return _mdfs_verify_all_static(mdfs, bitmap);
+  uint32_t i, j;
+  _mdfs_verify_job_t job;
+  job.mdfs = mdfs;
+  job.count = 0;
+  job.next = 0;
+  for (i = 0; i < mdfs->file_count; ++i)
+  {
+    job.count += (mdfs->file_list[i].size + MDFS_VERIFY_CHUNK - 1) / MDFS_VERIFY_CHUNK;
+  }
+  job.chunks = (_mdfs_verify_chunk_t*)malloc((job.count ? job.count : 1) * sizeof(_mdfs_verify_chunk_t));
+  if (job.chunks == NULL)
+  {
+    snprintf(_MDFS_ERROR_BUF(mdfs), MDFS_ERROR_LEN, "Out of memory");
+    return -1;
+  }
+  _mdfs_verify_chunk_t* c = job.chunks;
+  for (i = 0; i < mdfs->file_count; ++i)
+  {
+    uint32_t size = mdfs->file_list[i].size;
+    for (j = 0; j < size; j += MDFS_VERIFY_CHUNK, ++c)
+    {
+      c->file = i;
+      c->start = j;
+      c->size = size - j < MDFS_VERIFY_CHUNK ? size - j : MDFS_VERIFY_CHUNK;
+      c->failed = 0;
+    }
+  }
+
+#if MDFS_USE_PTHREADS
+  if (threads <= 0) threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  if (threads > job.count) threads = job.count;
+  if (mdfs->flags & MDFS_FLAG_DEVICE) threads = 1;
+  // The calling thread is one of the workers
+  pthread_t* tids = threads > 1 ? (pthread_t*)malloc((threads - 1) * sizeof(pthread_t)) : NULL;
+  int started = 0;
+  if (tids != NULL)
+  {
+    for (; started < threads - 1; ++started)
+    {
+      if (pthread_create(&tids[started], NULL, _mdfs_verify_worker, &job)) break;
+    }
+  }
+  _mdfs_verify_worker(&job);
+  while (started > 0) pthread_join(tids[--started], NULL);
+  free(tids);
+#else
+  (void)threads;
+  _mdfs_verify_worker(&job);
+#endif
+
+  // Chunks are in file order, combine them per file
+  int failed = 0;
+  c = job.chunks;
+  for (i = 0; i < mdfs->file_count; ++i)
+  {
+    const mdfs_file_t* file = &mdfs->file_list[i];
+    uint32_t crc = c->crc;
+    uint32_t size = c->size;
+    int read_failed = c->failed;
+    for (++c; size < file->size; size += c->size, ++c)
+    {
+      crc = mdfs_crc_combine(crc, c->crc, c->size);
+      read_failed |= c->failed;
+    }
+    int ok = crc == file->crc && _mdfs_in_image(mdfs, file) && !read_failed;
+    if (!ok) ++failed;
+    _mdfs_verify_mark(bitmap, i, ok);
+  }
+  free(job.chunks);
+  // Not mdfs_check_file_list_crc, the lock is held already
+  if (mdfs_calc_crc(mdfs->file_list, mdfs->file_count * sizeof(mdfs_file_t)) != mdfs_get_file_list_crc(mdfs)) ++failed;
+  return failed;
+}
@@ -11,18 +11,106 @@
 #define MDFS_STATE_CLOSED (0)
 #define MDFS_STATE_OPEN (1)
 #define MDFS_EOF EOF
+#define MDFS_FILE_VERIFY (0x01) // Opened with "v", crc is checked while reading
+#define MDFS_FILE_ERROR (0x02) // Verify failed, see mdfs_ferror
+#define MDFS_FILE_RANDOM (0x04) // No readahead, see mdfs_fadvise
+#define MDFS_FILE_SEQUENTIAL (0x08) // Full readahead window from the start, see mdfs_fadvise
+#define MDFS_FILE_CRC_FAILED (0x10) // Verify failed, unlike MDFS_FILE_ERROR not cleared by mdfs_rewind
+#define MDFS_FADV_NORMAL (0) // Readahead when reads are sequential, the default
+#define MDFS_FADV_SEQUENTIAL (1)
+#define MDFS_FADV_RANDOM (2)
+#define MDFS_FADV_WILLNEED (3) // Read the range in now
+#define MDFS_FADV_DONTNEED (4) // Drop the range from the cache / page cache
+#ifndef MDFS_READAHEAD_MIN
+#define MDFS_READAHEAD_MIN (4096) // First readahead window of a sequential reader
+#endif
+#ifndef MDFS_READAHEAD_MAX
+#define MDFS_READAHEAD_MAX (128*1024) // The window doubles up to this
+#endif
+#define MDFS_FLAG_STATIC (0x01) // mdfs_t lives in a caller supplied workspace
+#define MDFS_FLAG_DIRECT (0x02) // file_list points into block 0, copied on first change
+#define MDFS_FLAG_IMAGE (0x04) // target is an mmap'ed image file, see mdfs_open_image
+#define MDFS_FLAG_DEVICE (0x08) // No target, data is read through a mdfs_device_t, see mdfs_init_ex
+#define MDFS_FLAG_EXTENTS_STALE (0x10) // extents not built yet, done on the first add or remove
+#define MDFS_CACHE_BLOCK (4096) // Default bytes per block in the mdfs_init_ex cache
+#ifndef MDFS_USE_MMAP
+#if defined(__unix__) || defined(__APPLE__)
+#define MDFS_USE_MMAP (1) // mdfs_open_image
+#else
+#define MDFS_USE_MMAP (0)
+#endif
+#endif
+#ifndef MDFS_FILE_POOL_SIZE
+#define MDFS_FILE_POOL_SIZE (8) // Open files without malloc, the limit for mdfs_init_static
+#endif
 #define MDFS_EXTRA_CRC_SIZE (8) // Bytes to append for CRC to file list
+#ifndef MDFS_STREAM_COPY_MIN
+#define MDFS_STREAM_COPY_MIN (0) // mdfs_fread size for streaming stores, 0 = never
+#endif
+#ifndef MDFS_USE_HASH_INDEX
+#define MDFS_USE_HASH_INDEX (1) // Keep a hashed filename index in RAM
+#endif
+#define MDFS_INDEX_SLOTS (1024) // Power of 2, at least 2x MDFS_MAX_FILECOUNT
+#define MDFS_INDEX_EMPTY (0xFFFF)
+#ifndef MDFS_THREAD_SAFE
+#define MDFS_THREAD_SAFE (0) // Lock mdfs_t so it can be shared by threads, needs pthreads
+#endif
+#if MDFS_THREAD_SAFE
+#include <pthread.h>
+#endif
+#ifndef MDFS_USE_EXTENT_MAP
+#define MDFS_USE_EXTENT_MAP (1) // Keep the free space between files in RAM
+#endif
+#define MDFS_ALLOC_FIRST_FIT (0) // Lowest offset that fits, the default
+#define MDFS_ALLOC_BEST_FIT (1) // Smallest gap that fits
+#define MDFS_ALLOC_NEXT_FIT (2) // First fit, starting after the last added file
+#define MDFS_ALIGN_NONE (1) // Files are packed byte by byte
+#define MDFS_ALIGN_CACHELINE (64)
+#define MDFS_ALIGN_PAGE (4096)
+#define MDFS_ALIGN_BLOCK (MDFS_BLOCKSIZE) // Flash erase block
+#ifndef MDFS_AIO_THREADS
+#define MDFS_AIO_THREADS (4) // Workers for mdfs_fread_async, needs MDFS_USE_PTHREADS
+#endif
+#ifndef MDFS_AIO_DEPTH
+#define MDFS_AIO_DEPTH (64) // mdfs_fread_async reads in flight per mdfs
+#endif
+
+typedef struct MDFSCrc {
+	uint32_t state; ///< Running crc, not inverted
+} mdfs_crc_t;
+
+struct MDFS;
 
 typedef struct _mdfs_iobuf
 {
   int index; ///< Index in file list at time of opening
   uint32_t offset; ///< Read position
-  void* base; ///< Absolute start address
+  void* base; ///< Absolute start address, NULL with mdfs_init_ex
+  uint32_t byte_offset; ///< Identifies the entry in the file list
   int32_t size;
 	uint32_t crc; ///< Copied at time of opening
-  char filename[MDFS_MAX_FILENAME];
+  uint32_t flags; ///< MDFS_FILE_ flags
+  uint32_t crc_offset; ///< Number of bytes in crc_state (verify mode)
+  mdfs_crc_t crc_state; ///< Running crc over bytes read (verify mode)
+  uint32_t ra_next; ///< Offset where a sequential read continues
+  uint32_t ra_end; ///< Read ahead up to here
+  uint32_t ra_window; ///< Bytes to read ahead, 0 until reads look sequential
+  uint32_t getc_end; ///< mdfs_getc reads base inline below this offset, set by mdfs_fgetc
+  int state; ///< MDFS_STATE_OPEN or MDFS_STATE_CLOSED
+  struct MDFS* mdfs; ///< Owner
+  struct _mdfs_iobuf* next_free; ///< Free list link while in the pool
 } mdfs_FILE;
 
+/** Called by mdfs_aio_poll when a read of mdfs_fread_async is done. n is the
+ * number of bytes in buf, error is 0 or an errno value. */
+typedef void (*mdfs_aio_cb_t)(mdfs_FILE* f, void* buf, size_t n, int error, void* ctx);
+
+// Read-only view into the file system, see mdfs_fread_view
+typedef struct MDFSView {
+	const void* data; ///< Start of the bytes, NULL when size is 0
+	uint32_t size; ///< Number of bytes at data
+} mdfs_view_t;
+
 // Structure of a entry in the file list
 typedef struct MDFSFile {
 	int32_t size;
@@ -32,23 +120,101 @@ typedef struct MDFSFile {
 } mdfs_file_t;
 #define MDFS_MAX_FILECOUNT (MDFS_BLOCKSIZE/sizeof(struct MDFSFile)-1) // = 511
 
+// Slot in the filename index, maps a name hash to an index in file_list
+typedef struct MDFSIndexSlot {
+	uint16_t index; ///< Index in file_list, MDFS_INDEX_EMPTY if unused
+	uint16_t tag; ///< Upper 16 bits of the name hash
+} mdfs_index_slot_t;
+
+// Free space between files
+typedef struct MDFSExtent {
+	uint32_t offset; ///< From start of FS
+	uint32_t size; ///< Bytes
+} mdfs_extent_t;
+
+typedef struct MDFSFreeStats {
+	uint32_t gap_count; ///< Number of gaps between files
+	uint32_t gap_bytes; ///< Bytes in those gaps, what a repack wins back
+	uint32_t largest_gap; ///< Largest file that fits without growing the image
+	uint32_t end_offset; ///< First byte after the last file
+	uint32_t fragmentation; ///< 0..100: 100 - largest_gap * 100 / gap_bytes, 0 without gaps
+} mdfs_free_stats_t;
+
+struct MDFSBatch; // Pending changes, see mdfs_begin_batch
+struct MDFSCache; // Block cache, see mdfs_init_ex
+struct MDFSAio; // Queues of mdfs_fread_async
+
+/** Read size bytes at offset (from the start of the FS) into buf.
+ * Returns 0 on success, anything else is a read error. Never called from two
+ * threads at once (MDFS_THREAD_SAFE takes a lock around it), so it needn't be
+ * thread safe. */
+typedef int (*mdfs_read_fn_t)(void* ctx, uint32_t offset, uint32_t size, void* buf);
+
+// Storage that isn't memory mapped, see mdfs_init_ex
+typedef struct MDFSDevice {
+	mdfs_read_fn_t read;
+	void* ctx; ///< Passed to read
+	size_t size; ///< Bytes on the device, 0 when unknown
+	uint32_t cache_block; ///< Bytes per cache block, a power of 2 (e.g. 4096 or 65536). 0 = MDFS_CACHE_BLOCK
+	uint32_t cache_blocks; ///< Number of blocks in the cache, 0 = no cache
+} mdfs_device_t;
+
 typedef struct MDFS {
 	const void* target;
+	size_t target_size; ///< Bytes at target, 0 when unknown (flash)
 	mdfs_file_t* file_list; ///< List is ordered by byte_offset
 	uint32_t file_count; ///< Number of entries in file_list
-	char error[MDFS_ERROR_LEN]; ///< Buffer for error msg. Always a valid string.
+	uint32_t file_capacity; ///< Number of entries allocated in file_list
+	char error[MDFS_ERROR_LEN]; ///< Buffer for error msg. Always a valid string. Per thread with MDFS_THREAD_SAFE
+	uint32_t flags; ///< MDFS_FLAG_ flags
+	mdfs_FILE file_pool[MDFS_FILE_POOL_SIZE]; ///< Handles for mdfs_fopen
+	mdfs_FILE* free_files; ///< Unused handles in file_pool
+#if MDFS_USE_HASH_INDEX
+	mdfs_index_slot_t index[MDFS_INDEX_SLOTS]; ///< Open addressed, linear probing
+#endif
+	uint32_t alloc_policy; ///< MDFS_ALLOC_ policy for mdfs_add_file
+	uint32_t alloc_rover; ///< Where MDFS_ALLOC_NEXT_FIT starts looking
+	struct MDFSBatch* batch; ///< Changes queued since mdfs_begin_batch, NULL otherwise
+	mdfs_device_t device; ///< Only used with MDFS_FLAG_DEVICE
+	struct MDFSCache* cache; ///< Blocks read from device, NULL without cache
+	struct MDFSAio* aio; ///< Created by the first mdfs_fread_async
+#if MDFS_THREAD_SAFE
+	pthread_rwlock_t lock; ///< Shared for lookups, exclusive for changes to the list
+	pthread_mutex_t pool_lock; ///< Protects free_files
+	pthread_mutex_t device_lock; ///< Held around every call of device.read
+#endif
+#if MDFS_USE_EXTENT_MAP
+	mdfs_extent_t extents[MDFS_MAX_FILECOUNT]; ///< Gaps, ordered by size then offset
+	uint32_t extent_count; ///< Number of entries in extents
+	uint32_t free_end; ///< First byte after the last file
+#endif
 } mdfs_t;
 
+/** Bytes needed for mdfs_init_static: mdfs_t, a full file list and alignment */
+#define MDFS_WORKSPACE_SIZE (sizeof(mdfs_t) + MDFS_MAX_FILECOUNT * sizeof(mdfs_file_t) + MDFS_EXTRA_CRC_SIZE + 8)
+
 
 mdfs_t* mdfs_init_simple(const void* target);
+mdfs_t* mdfs_init_static(const void* target, void* workspace, size_t workspace_size);
+mdfs_t* mdfs_init_direct(const void* target);
+mdfs_t* mdfs_init_ex(const mdfs_device_t* device);
+#if MDFS_USE_MMAP
+mdfs_t* mdfs_open_image(const char* path);
+#endif
 void mdfs_deinit(mdfs_t* mdfs);
 int mdfs_get_filename(mdfs_t* mdfs, int index, char* buffer);
 int32_t mdfs_get_filesize(mdfs_t* mdfs, int index);
 uint32_t mdfs_get_file_offset(mdfs_t* mdfs, int index);
 uint32_t mdfs_get_file_crc(mdfs_t* mdfs, int index);
 uint32_t mdfs_add_file(mdfs_t* mdfs, const char* filename, int32_t size);
+uint32_t mdfs_add_file_ex(mdfs_t* mdfs, const char* filename, int32_t size, uint32_t align);
 int mdfs_remove_file(mdfs_t* mdfs, const char* filename);
 int mdfs_rename_file(mdfs_t* mdfs, const char* filename, const char* newname);
+int mdfs_set_alloc_policy(mdfs_t* mdfs, int policy);
+int mdfs_begin_batch(mdfs_t* mdfs);
+int mdfs_commit_batch(mdfs_t* mdfs);
+void mdfs_abort_batch(mdfs_t* mdfs);
+void mdfs_get_free_stats(mdfs_t* mdfs, mdfs_free_stats_t* stats);
 
 // IO functions
 mdfs_FILE* mdfs_fopen(mdfs_t* mdfs, const char* filename, const char* mode);
@@ -57,8 +223,26 @@ int mdfs_fclose(mdfs_FILE* f);
 size_t mdfs_fread(void* ptr, size_t size, size_t count, mdfs_FILE* f);
 int mdfs_feof(mdfs_FILE* f);
 int mdfs_fgetc(mdfs_FILE* f);
-#define mdfs_ferror(f) (0)
-#define mdfs_getc(f) mdfs_fgetc(f)
+mdfs_view_t mdfs_fpeek(mdfs_FILE* f, size_t count);
+mdfs_view_t mdfs_fread_view(mdfs_FILE* f, size_t count);
+char* mdfs_fgets(char* s, int size, mdfs_FILE* f);
+int32_t mdfs_getdelim(char** lineptr, size_t* n, int delim, mdfs_FILE* f);
+int32_t mdfs_getline(char** lineptr, size_t* n, mdfs_FILE* f);
+mdfs_view_t mdfs_getdelim_view(mdfs_FILE* f, int delim);
+#define mdfs_getline_view(f) mdfs_getdelim_view((f), '\n')
+int mdfs_fread_async(mdfs_FILE* f, void* ptr, size_t len, mdfs_aio_cb_t cb, void* ctx);
+int mdfs_aio_poll(mdfs_t* mdfs, int wait);
+int mdfs_ferror(mdfs_FILE* f);
+int mdfs_fadvise(mdfs_FILE* f, uint32_t offset, uint32_t len, int hint);
+int mdfs_fseek(mdfs_FILE* f, long offset, int whence);
+long mdfs_ftell(mdfs_FILE* f);
+void mdfs_rewind(mdfs_FILE* f);
+int32_t mdfs_pread(mdfs_FILE* f, void* ptr, size_t len, uint32_t offset);
+const char* mdfs_get_open_filename(mdfs_FILE* f);
+/** Like mdfs_fgetc, inline while the next byte is below getc_end: a compare
+ * and a load. f is evaluated more than once, like getc. */
+#define mdfs_getc(f) ((f)->offset < (f)->getc_end ? \
+	(int)((const uint8_t*)(f)->base)[(f)->offset++] : mdfs_fgetc(f))
 #define mdfs_passthrough_stdin(mdfs) mdfs_fopen((mdfs), "stdin", "r")
 inline size_t mdfs_get_file_list_size(mdfs_t* mdfs) __attribute__((always_inline));
 inline size_t mdfs_get_file_list_size(mdfs_t* mdfs) { 
@@ -68,28 +252,70 @@ inline size_t mdfs_get_file_list_size(mdfs_t* mdfs) {
 inline uint32_t mdfs_get_filecount(mdfs_t* mdfs) __attribute__((always_inline));
 inline uint32_t mdfs_get_filecount(mdfs_t* mdfs) { return mdfs->file_count; } 
 
+#if MDFS_THREAD_SAFE
+const char* mdfs_get_error(mdfs_t* mdfs); // Last error of the calling thread
+#else
 inline const char* mdfs_get_error(mdfs_t* mdfs) __attribute__((always_inline));
 inline const char* mdfs_get_error(mdfs_t* mdfs) { return mdfs->error; }
+#endif
 
 inline void* mdfs_get_file_location(mdfs_t* mdfs, uint32_t offset) __attribute__((always_inline));
 inline void* mdfs_get_file_location(mdfs_t* mdfs, uint32_t offset)
 {
+	if (mdfs->target == NULL) return NULL; // mdfs_init_ex
 	return (void*)(mdfs->target + offset);
 }
 
 inline void* mdfs_get_open_file_location(mdfs_FILE* f) __attribute__((always_inline));
 inline void* mdfs_get_open_file_location(mdfs_FILE* f)
 {
-	if (f == NULL) return NULL;
+	if (f == NULL || f->base == NULL) return NULL;
 	else return (void*)(f->base + f->offset);
 }
 
 inline void* mdfs_get_file_list(mdfs_t* mdfs) __attribute__((always_inline));
 inline void* mdfs_get_file_list(mdfs_t* mdfs) { return (void*)mdfs->file_list; }
 
+/** RAM used by the filename index in bytes, 0 when it's compiled out */
+inline size_t mdfs_get_index_size(mdfs_t* mdfs) __attribute__((always_inline));
+inline size_t mdfs_get_index_size(mdfs_t* mdfs) {
+#if MDFS_USE_HASH_INDEX
+	return sizeof(mdfs->index);
+#else
+	return 0;
+#endif
+}
+
 // CRC functions
 #define MDFS_CRC_POLY 0xc9d204f5
+#ifndef MDFS_USE_PTHREADS
+#if defined(__unix__) || defined(__APPLE__)
+#define MDFS_USE_PTHREADS (1) // mdfs_verify_all runs on several threads
+#else
+#define MDFS_USE_PTHREADS (0)
+#endif
+#endif
+#ifndef MDFS_VERIFY_CHUNK
+#define MDFS_VERIFY_CHUNK (1024*1024) // Files are split in chunks of this for mdfs_verify_all
+#endif
+#define MDFS_CRC_ENGINE_AUTO (0) // Fastest available
+#define MDFS_CRC_ENGINE_BYTEWISE (1) // One table lookup per byte
+#define MDFS_CRC_ENGINE_SLICE8 (2) // Slice-by-8, 8 KB of tables
+#define MDFS_CRC_ENGINE_PCLMUL (3) // x86 carry-less multiply folding
+#ifndef MDFS_HAVE_PCLMUL
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define MDFS_HAVE_PCLMUL (1)
+#else
+#define MDFS_HAVE_PCLMUL (0)
+#endif
+#endif
 uint32_t mdfs_calc_crc(const void* data, int32_t size);
+void mdfs_crc_init(mdfs_crc_t* ctx);
+void mdfs_crc_update(mdfs_crc_t* ctx, const void* data, size_t size);
+uint32_t mdfs_crc_final(const mdfs_crc_t* ctx);
+uint32_t mdfs_crc_combine(uint32_t crc1, uint32_t crc2, size_t len2);
+uint32_t mdfs_calc_crc_engine(const void* data, int32_t size, int engine);
+int mdfs_crc_engine_available(int engine);
 inline uint32_t mdfs_get_stored_crc(mdfs_FILE* f) __attribute__((always_inline));
 inline uint32_t mdfs_get_stored_crc(mdfs_FILE* f) { return f->crc; }
 inline uint32_t mdfs_get_file_list_crc(mdfs_t* mdfs) __attribute__((always_inline));
@@ -98,6 +324,7 @@ inline uint32_t mdfs_get_file_list_crc(mdfs_t* mdfs) {
 }
 int mdfs_check_crc(const mdfs_FILE* f);
 int mdfs_check_file_list_crc(mdfs_t* mdfs);
+int mdfs_verify_all(mdfs_t* mdfs, int threads, uint8_t* bitmap);
 int mdfs_set_crc(mdfs_t* mdfs, const char* filename, uint32_t crc);
 int mdfs_update_crc(mdfs_t* mdfs, const char* filename);
 
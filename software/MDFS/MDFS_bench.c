@@ -0,0 +1,226 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "MDFS.h"
+
+/* Benchmarks for MDFS, not part of the tests.
+ * Build with optimization, e.g. gcc -O2 MDFS_bench.c MDFS.c
+ */
+
+static double _now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// --------------------------------------------------------------------
+// CRC engines
+// --------------------------------------------------------------------
+#define B_CRC_SIZE (64*1024*1024)
+#define B_CRC_ROUNDS (4)
+
+static void B_mdfs_calc_crc_engines()
+{
+  static const char* names[] = {"auto", "bytewise", "slice8", "pclmul"};
+  uint8_t* data = malloc(B_CRC_SIZE);
+  int i, engine;
+  srand(1);
+  for (i = 0; i < B_CRC_SIZE; ++i) data[i] = rand();
+  printf("mdfs_calc_crc (%i MB):\n", B_CRC_SIZE >> 20);
+  for (engine = MDFS_CRC_ENGINE_AUTO; engine <= MDFS_CRC_ENGINE_PCLMUL; ++engine)
+  {
+    if (!mdfs_crc_engine_available(engine))
+    {
+      printf("\t%-10s not available\n", names[engine]);
+      continue;
+    }
+    uint32_t crc = 0;
+    double t = _now();
+    for (i = 0; i < B_CRC_ROUNDS; ++i) crc = mdfs_calc_crc_engine(data, B_CRC_SIZE, engine);
+    t = _now() - t;
+    printf("\t%-10s %7.2f GB/s (crc=0x%08X)\n",
+      names[engine], (double)B_CRC_SIZE * B_CRC_ROUNDS / t / 1e9, crc);
+  }
+  free(data);
+}
+
+// --------------------------------------------------------------------
+// mdfs_fread
+// --------------------------------------------------------------------
+#define B_FREAD_TOTAL (1024*1024*1024)
+
+static void B_mdfs_fread_bulk()
+{
+  static const int32_t sizes[] = {4096, 64*1024, 256*1024, 1024*1024, 16*1024*1024};
+  int32_t max = 16*1024*1024;
+  uint8_t* fs = malloc(MDFS_BLOCKSIZE + max);
+  memset(fs, 0xFF, MDFS_BLOCKSIZE);
+  memset(fs + MDFS_BLOCKSIZE, 0x5A, max);
+  uint8_t* buf = malloc(max);
+  mdfs_t* mdfs = mdfs_init_simple(fs);
+  mdfs_add_file(mdfs, "asset_table", max);
+  int i, j;
+  if (MDFS_STREAM_COPY_MIN) printf("mdfs_fread (streaming stores from %i KB):\n", MDFS_STREAM_COPY_MIN >> 10);
+  else printf("mdfs_fread (memcpy only):\n");
+  for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i)
+  {
+    int rounds = B_FREAD_TOTAL / sizes[i];
+    mdfs_FILE* f = mdfs_fopen(mdfs, "asset_table", "r");
+    double t = _now();
+    for (j = 0; j < rounds; ++j)
+    {
+      f->offset = 0;
+      mdfs_fread(buf, 1, sizes[i], f);
+    }
+    t = _now() - t;
+    mdfs_fclose(f);
+    double t_memcpy = _now();
+    for (j = 0; j < rounds; ++j) memcpy(buf, fs + MDFS_BLOCKSIZE, sizes[i]);
+    t_memcpy = _now() - t_memcpy;
+    printf("\t%8i bytes %7.2f GB/s (memcpy %7.2f GB/s)\n", sizes[i],
+      (double)rounds * sizes[i] / t / 1e9, (double)rounds * sizes[i] / t_memcpy / 1e9);
+  }
+  mdfs_deinit(mdfs);
+  free(buf);
+  free(fs);
+}
+
+// --------------------------------------------------------------------
+// mdfs_getc
+// --------------------------------------------------------------------
+#define B_GETC_SIZE (64*1024*1024)
+
+static void B_mdfs_getc()
+{
+  uint8_t* fs = malloc(MDFS_BLOCKSIZE + B_GETC_SIZE);
+  memset(fs, 0xFF, MDFS_BLOCKSIZE);
+  memset(fs + MDFS_BLOCKSIZE, 'x', B_GETC_SIZE);
+  mdfs_t* mdfs = mdfs_init_simple(fs);
+  mdfs_add_file(mdfs, "source.lua", B_GETC_SIZE);
+  uint32_t sum = 0;
+  mdfs_FILE* f = mdfs_fopen(mdfs, "source.lua", "r");
+  double t_fgetc = _now();
+  int c;
+  while ((c = mdfs_fgetc(f)) != MDFS_EOF) sum += c;
+  t_fgetc = _now() - t_fgetc;
+  mdfs_fclose(f);
+  f = mdfs_fopen(mdfs, "source.lua", "r");
+  double t_getc = _now();
+  while ((c = mdfs_getc(f)) != MDFS_EOF) sum += c;
+  t_getc = _now() - t_getc;
+  mdfs_fclose(f);
+  printf("mdfs_getc (%i MB, sum %u):\n", B_GETC_SIZE >> 20, sum);
+  printf("\tmdfs_fgetc %8.1f M chars/s\n", B_GETC_SIZE / t_fgetc / 1e6);
+  printf("\tmdfs_getc  %8.1f M chars/s\n", B_GETC_SIZE / t_getc / 1e6);
+  mdfs_deinit(mdfs);
+  free(fs);
+}
+
+// --------------------------------------------------------------------
+// File list shifting (_mdfs_insert, mdfs_remove_file)
+// --------------------------------------------------------------------
+#define B_LIST_ROUNDS (20)
+
+static void B_mdfs_list_shifting()
+{
+  uint8_t* fs = malloc(MDFS_BLOCKSIZE);
+  memset(fs, 0xFF, MDFS_BLOCKSIZE);
+  int n = MDFS_MAX_FILECOUNT;
+  char name[MDFS_MAX_FILENAME];
+  double t_insert = 0, t_remove = 0, t_dup = 0, t;
+  int round, i;
+  for (round = 0; round < B_LIST_ROUNDS; ++round)
+  {
+    // Insert at the front: a hole at the start is filled one byte at a time,
+    // every new file goes in front of the n/2 files behind the hole
+    mdfs_t* mdfs = mdfs_init_simple(fs);
+    mdfs_add_file(mdfs, "hole", n - n/2);
+    for (i = 0; i < n/2; ++i)
+    {
+      sprintf(name, "file_%03i", i);
+      mdfs_add_file(mdfs, name, 1);
+    }
+    mdfs_remove_file(mdfs, "hole");
+    t = _now();
+    for (i = 0; i < n - n/2; ++i) mdfs_add_file(mdfs, "front", 1);
+    t_insert += _now() - t;
+    mdfs_deinit(mdfs);
+
+    // Remove from the front, everything behind it moves
+    mdfs = mdfs_init_simple(fs);
+    for (i = 0; i < n; ++i)
+    {
+      sprintf(name, "file_%03i", i);
+      mdfs_add_file(mdfs, name, 1);
+    }
+    t = _now();
+    for (i = 0; i < n; ++i)
+    {
+      sprintf(name, "file_%03i", i);
+      mdfs_remove_file(mdfs, name);
+    }
+    t_remove += _now() - t;
+    mdfs_deinit(mdfs);
+
+    // Every other entry is a duplicate, removed with one call
+    mdfs = mdfs_init_simple(fs);
+    for (i = 0; i < n; ++i) mdfs_add_file(mdfs, (i & 1) ? "keep" : "dup", 1);
+    t = _now();
+    mdfs_remove_file(mdfs, "dup");
+    t_dup += _now() - t;
+    mdfs_deinit(mdfs);
+  }
+  printf("file list (%i entries):\n", n);
+  printf("\tinsert at front   %8.1f us/op\n", t_insert / B_LIST_ROUNDS / (n - n/2) * 1e6);
+  printf("\tremove from front %8.1f us/op\n", t_remove / B_LIST_ROUNDS / n * 1e6);
+  printf("\tremove %i dups   %8.1f us\n", (n + 1) / 2, t_dup / B_LIST_ROUNDS * 1e6);
+  free(fs);
+}
+
+// --------------------------------------------------------------------
+// mdfs_verify_all
+// --------------------------------------------------------------------
+#define B_VERIFY_FILES (8)
+#define B_VERIFY_FILESIZE (32*1024*1024)
+
+static void B_mdfs_verify_all()
+{
+  static const int threads[] = {1, 2, 4, 8};
+  size_t size = MDFS_BLOCKSIZE + (size_t)B_VERIFY_FILES * B_VERIFY_FILESIZE;
+  uint8_t* fs = malloc(size);
+  memset(fs, 0xFF, MDFS_BLOCKSIZE);
+  memset(fs + MDFS_BLOCKSIZE, 0x5A, size - MDFS_BLOCKSIZE);
+  mdfs_t* mdfs = mdfs_init_simple(fs);
+  char name[MDFS_MAX_FILENAME];
+  int i;
+  for (i = 0; i < B_VERIFY_FILES; ++i)
+  {
+    sprintf(name, "file_%i", i);
+    mdfs_add_file(mdfs, name, B_VERIFY_FILESIZE);
+    mdfs_update_crc(mdfs, name);
+  }
+  printf("mdfs_verify_all (%i MB):\n", B_VERIFY_FILES * (B_VERIFY_FILESIZE >> 20));
+  for (i = 0; i < sizeof(threads) / sizeof(threads[0]); ++i)
+  {
+    double t = _now();
+    mdfs_verify_all(mdfs, threads[i], NULL);
+    t = _now() - t;
+    printf("\t%i threads %7.2f GB/s\n", threads[i], (double)(size - MDFS_BLOCKSIZE) / t / 1e9);
+  }
+  mdfs_deinit(mdfs);
+  free(fs);
+}
+
+// --------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+  B_mdfs_calc_crc_engines();
+  B_mdfs_fread_bulk();
+  B_mdfs_getc();
+  B_mdfs_list_shifting();
+  B_mdfs_verify_all();
+  return 0;
+}
@@ -0,0 +1,552 @@
+/* Generated by crc32_table_gen.py --mdfs, do not edit.
+ *
+ * Slice-by-8 tables for polynomial 0xD79025C9 (reflected).
+ * Table 0 is the regular byte-wise table.
+ */
+#ifndef _MDFS_CRC_TABLES_H_
+#define _MDFS_CRC_TABLES_H_
+
+static const uint32_t _mdfs_crc_table[8][256] = {
+  {
+    0x00000000, 0x3CD0EADC, 0x79A1D5B8, 0x45713F64,
+    0xF343AB70, 0xCF9341AC, 0x8AE27EC8, 0xB6329414,
+    0x49A71D73, 0x7577F7AF, 0x3006C8CB, 0x0CD62217,
+    0xBAE4B603, 0x86345CDF, 0xC34563BB, 0xFF958967,
+    0x934E3AE6, 0xAF9ED03A, 0xEAEFEF5E, 0xD63F0582,
+    0x600D9196, 0x5CDD7B4A, 0x19AC442E, 0x257CAEF2,
+    0xDAE92795, 0xE639CD49, 0xA348F22D, 0x9F9818F1,
+    0x29AA8CE5, 0x157A6639, 0x500B595D, 0x6CDBB381,
+    0x89BC3E5F, 0xB56CD483, 0xF01DEBE7, 0xCCCD013B,
+    0x7AFF952F, 0x462F7FF3, 0x035E4097, 0x3F8EAA4B,
+    0xC01B232C, 0xFCCBC9F0, 0xB9BAF694, 0x856A1C48,
+    0x3358885C, 0x0F886280, 0x4AF95DE4, 0x7629B738,
+    0x1AF204B9, 0x2622EE65, 0x6353D101, 0x5F833BDD,
+    0xE9B1AFC9, 0xD5614515, 0x90107A71, 0xACC090AD,
+    0x535519CA, 0x6F85F316, 0x2AF4CC72, 0x162426AE,
+    0xA016B2BA, 0x9CC65866, 0xD9B76702, 0xE5678DDE,
+    0xBC58372D, 0x8088DDF1, 0xC5F9E295, 0xF9290849,
+    0x4F1B9C5D, 0x73CB7681, 0x36BA49E5, 0x0A6AA339,
+    0xF5FF2A5E, 0xC92FC082, 0x8C5EFFE6, 0xB08E153A,
+    0x06BC812E, 0x3A6C6BF2, 0x7F1D5496, 0x43CDBE4A,
+    0x2F160DCB, 0x13C6E717, 0x56B7D873, 0x6A6732AF,
+    0xDC55A6BB, 0xE0854C67, 0xA5F47303, 0x992499DF,
+    0x66B110B8, 0x5A61FA64, 0x1F10C500, 0x23C02FDC,
+    0x95F2BBC8, 0xA9225114, 0xEC536E70, 0xD08384AC,
+    0x35E40972, 0x0934E3AE, 0x4C45DCCA, 0x70953616,
+    0xC6A7A202, 0xFA7748DE, 0xBF0677BA, 0x83D69D66,
+    0x7C431401, 0x4093FEDD, 0x05E2C1B9, 0x39322B65,
+    0x8F00BF71, 0xB3D055AD, 0xF6A16AC9, 0xCA718015,
+    0xA6AA3394, 0x9A7AD948, 0xDF0BE62C, 0xE3DB0CF0,
+    0x55E998E4, 0x69397238, 0x2C484D5C, 0x1098A780,
+    0xEF0D2EE7, 0xD3DDC43B, 0x96ACFB5F, 0xAA7C1183,
+    0x1C4E8597, 0x209E6F4B, 0x65EF502F, 0x593FBAF3,
+    0xD79025C9, 0xEB40CF15, 0xAE31F071, 0x92E11AAD,
+    0x24D38EB9, 0x18036465, 0x5D725B01, 0x61A2B1DD,
+    0x9E3738BA, 0xA2E7D266, 0xE796ED02, 0xDB4607DE,
+    0x6D7493CA, 0x51A47916, 0x14D54672, 0x2805ACAE,
+    0x44DE1F2F, 0x780EF5F3, 0x3D7FCA97, 0x01AF204B,
+    0xB79DB45F, 0x8B4D5E83, 0xCE3C61E7, 0xF2EC8B3B,
+    0x0D79025C, 0x31A9E880, 0x74D8D7E4, 0x48083D38,
+    0xFE3AA92C, 0xC2EA43F0, 0x879B7C94, 0xBB4B9648,
+    0x5E2C1B96, 0x62FCF14A, 0x278DCE2E, 0x1B5D24F2,
+    0xAD6FB0E6, 0x91BF5A3A, 0xD4CE655E, 0xE81E8F82,
+    0x178B06E5, 0x2B5BEC39, 0x6E2AD35D, 0x52FA3981,
+    0xE4C8AD95, 0xD8184749, 0x9D69782D, 0xA1B992F1,
+    0xCD622170, 0xF1B2CBAC, 0xB4C3F4C8, 0x88131E14,
+    0x3E218A00, 0x02F160DC, 0x47805FB8, 0x7B50B564,
+    0x84C53C03, 0xB815D6DF, 0xFD64E9BB, 0xC1B40367,
+    0x77869773, 0x4B567DAF, 0x0E2742CB, 0x32F7A817,
+    0x6BC812E4, 0x5718F838, 0x1269C75C, 0x2EB92D80,
+    0x988BB994, 0xA45B5348, 0xE12A6C2C, 0xDDFA86F0,
+    0x226F0F97, 0x1EBFE54B, 0x5BCEDA2F, 0x671E30F3,
+    0xD12CA4E7, 0xEDFC4E3B, 0xA88D715F, 0x945D9B83,
+    0xF8862802, 0xC456C2DE, 0x8127FDBA, 0xBDF71766,
+    0x0BC58372, 0x371569AE, 0x726456CA, 0x4EB4BC16,
+    0xB1213571, 0x8DF1DFAD, 0xC880E0C9, 0xF4500A15,
+    0x42629E01, 0x7EB274DD, 0x3BC34BB9, 0x0713A165,
+    0xE2742CBB, 0xDEA4C667, 0x9BD5F903, 0xA70513DF,
+    0x113787CB, 0x2DE76D17, 0x68965273, 0x5446B8AF,
+    0xABD331C8, 0x9703DB14, 0xD272E470, 0xEEA20EAC,
+    0x58909AB8, 0x64407064, 0x21314F00, 0x1DE1A5DC,
+    0x713A165D, 0x4DEAFC81, 0x089BC3E5, 0x344B2939,
+    0x8279BD2D, 0xBEA957F1, 0xFBD86895, 0xC7088249,
+    0x389D0B2E, 0x044DE1F2, 0x413CDE96, 0x7DEC344A,
+    0xCBDEA05E, 0xF70E4A82, 0xB27F75E6, 0x8EAF9F3A
+  },
+  {
+    0x00000000, 0x425E4EEB, 0x84BC9DD6, 0xC6E2D33D,
+    0xA659703F, 0xE4073ED4, 0x22E5EDE9, 0x60BBA302,
+    0xE392ABED, 0xA1CCE506, 0x672E363B, 0x257078D0,
+    0x45CBDBD2, 0x07959539, 0xC1774604, 0x832908EF,
+    0x68051C49, 0x2A5B52A2, 0xECB9819F, 0xAEE7CF74,
+    0xCE5C6C76, 0x8C02229D, 0x4AE0F1A0, 0x08BEBF4B,
+    0x8B97B7A4, 0xC9C9F94F, 0x0F2B2A72, 0x4D756499,
+    0x2DCEC79B, 0x6F908970, 0xA9725A4D, 0xEB2C14A6,
+    0xD00A3892, 0x92547679, 0x54B6A544, 0x16E8EBAF,
+    0x765348AD, 0x340D0646, 0xF2EFD57B, 0xB0B19B90,
+    0x3398937F, 0x71C6DD94, 0xB7240EA9, 0xF57A4042,
+    0x95C1E340, 0xD79FADAB, 0x117D7E96, 0x5323307D,
+    0xB80F24DB, 0xFA516A30, 0x3CB3B90D, 0x7EEDF7E6,
+    0x1E5654E4, 0x5C081A0F, 0x9AEAC932, 0xD8B487D9,
+    0x5B9D8F36, 0x19C3C1DD, 0xDF2112E0, 0x9D7F5C0B,
+    0xFDC4FF09, 0xBF9AB1E2, 0x797862DF, 0x3B262C34,
+    0x0F343AB7, 0x4D6A745C, 0x8B88A761, 0xC9D6E98A,
+    0xA96D4A88, 0xEB330463, 0x2DD1D75E, 0x6F8F99B5,
+    0xECA6915A, 0xAEF8DFB1, 0x681A0C8C, 0x2A444267,
+    0x4AFFE165, 0x08A1AF8E, 0xCE437CB3, 0x8C1D3258,
+    0x673126FE, 0x256F6815, 0xE38DBB28, 0xA1D3F5C3,
+    0xC16856C1, 0x8336182A, 0x45D4CB17, 0x078A85FC,
+    0x84A38D13, 0xC6FDC3F8, 0x001F10C5, 0x42415E2E,
+    0x22FAFD2C, 0x60A4B3C7, 0xA64660FA, 0xE4182E11,
+    0xDF3E0225, 0x9D604CCE, 0x5B829FF3, 0x19DCD118,
+    0x7967721A, 0x3B393CF1, 0xFDDBEFCC, 0xBF85A127,
+    0x3CACA9C8, 0x7EF2E723, 0xB810341E, 0xFA4E7AF5,
+    0x9AF5D9F7, 0xD8AB971C, 0x1E494421, 0x5C170ACA,
+    0xB73B1E6C, 0xF5655087, 0x338783BA, 0x71D9CD51,
+    0x11626E53, 0x533C20B8, 0x95DEF385, 0xD780BD6E,
+    0x54A9B581, 0x16F7FB6A, 0xD0152857, 0x924B66BC,
+    0xF2F0C5BE, 0xB0AE8B55, 0x764C5868, 0x34121683,
+    0x1E68756E, 0x5C363B85, 0x9AD4E8B8, 0xD88AA653,
+    0xB8310551, 0xFA6F4BBA, 0x3C8D9887, 0x7ED3D66C,
+    0xFDFADE83, 0xBFA49068, 0x79464355, 0x3B180DBE,
+    0x5BA3AEBC, 0x19FDE057, 0xDF1F336A, 0x9D417D81,
+    0x766D6927, 0x343327CC, 0xF2D1F4F1, 0xB08FBA1A,
+    0xD0341918, 0x926A57F3, 0x548884CE, 0x16D6CA25,
+    0x95FFC2CA, 0xD7A18C21, 0x11435F1C, 0x531D11F7,
+    0x33A6B2F5, 0x71F8FC1E, 0xB71A2F23, 0xF54461C8,
+    0xCE624DFC, 0x8C3C0317, 0x4ADED02A, 0x08809EC1,
+    0x683B3DC3, 0x2A657328, 0xEC87A015, 0xAED9EEFE,
+    0x2DF0E611, 0x6FAEA8FA, 0xA94C7BC7, 0xEB12352C,
+    0x8BA9962E, 0xC9F7D8C5, 0x0F150BF8, 0x4D4B4513,
+    0xA66751B5, 0xE4391F5E, 0x22DBCC63, 0x60858288,
+    0x003E218A, 0x42606F61, 0x8482BC5C, 0xC6DCF2B7,
+    0x45F5FA58, 0x07ABB4B3, 0xC149678E, 0x83172965,
+    0xE3AC8A67, 0xA1F2C48C, 0x671017B1, 0x254E595A,
+    0x115C4FD9, 0x53020132, 0x95E0D20F, 0xD7BE9CE4,
+    0xB7053FE6, 0xF55B710D, 0x33B9A230, 0x71E7ECDB,
+    0xF2CEE434, 0xB090AADF, 0x767279E2, 0x342C3709,
+    0x5497940B, 0x16C9DAE0, 0xD02B09DD, 0x92754736,
+    0x79595390, 0x3B071D7B, 0xFDE5CE46, 0xBFBB80AD,
+    0xDF0023AF, 0x9D5E6D44, 0x5BBCBE79, 0x19E2F092,
+    0x9ACBF87D, 0xD895B696, 0x1E7765AB, 0x5C292B40,
+    0x3C928842, 0x7ECCC6A9, 0xB82E1594, 0xFA705B7F,
+    0xC156774B, 0x830839A0, 0x45EAEA9D, 0x07B4A476,
+    0x670F0774, 0x2551499F, 0xE3B39AA2, 0xA1EDD449,
+    0x22C4DCA6, 0x609A924D, 0xA6784170, 0xE4260F9B,
+    0x849DAC99, 0xC6C3E272, 0x0021314F, 0x427F7FA4,
+    0xA9536B02, 0xEB0D25E9, 0x2DEFF6D4, 0x6FB1B83F,
+    0x0F0A1B3D, 0x4D5455D6, 0x8BB686EB, 0xC9E8C800,
+    0x4AC1C0EF, 0x089F8E04, 0xCE7D5D39, 0x8C2313D2,
+    0xEC98B0D0, 0xAEC6FE3B, 0x68242D06, 0x2A7A63ED
+  },
+  {
+    0x00000000, 0xEEE050E2, 0x72E0EA57, 0x9C00BAB5,
+    0xE5C1D4AE, 0x0B21844C, 0x97213EF9, 0x79C16E1B,
+    0x64A3E2CF, 0x8A43B22D, 0x16430898, 0xF8A3587A,
+    0x81623661, 0x6F826683, 0xF382DC36, 0x1D628CD4,
+    0xC947C59E, 0x27A7957C, 0xBBA72FC9, 0x55477F2B,
+    0x2C861130, 0xC26641D2, 0x5E66FB67, 0xB086AB85,
+    0xADE42751, 0x430477B3, 0xDF04CD06, 0x31E49DE4,
+    0x4825F3FF, 0xA6C5A31D, 0x3AC519A8, 0xD425494A,
+    0x3DAFC0AF, 0xD34F904D, 0x4F4F2AF8, 0xA1AF7A1A,
+    0xD86E1401, 0x368E44E3, 0xAA8EFE56, 0x446EAEB4,
+    0x590C2260, 0xB7EC7282, 0x2BECC837, 0xC50C98D5,
+    0xBCCDF6CE, 0x522DA62C, 0xCE2D1C99, 0x20CD4C7B,
+    0xF4E80531, 0x1A0855D3, 0x8608EF66, 0x68E8BF84,
+    0x1129D19F, 0xFFC9817D, 0x63C93BC8, 0x8D296B2A,
+    0x904BE7FE, 0x7EABB71C, 0xE2AB0DA9, 0x0C4B5D4B,
+    0x758A3350, 0x9B6A63B2, 0x076AD907, 0xE98A89E5,
+    0x7B5F815E, 0x95BFD1BC, 0x09BF6B09, 0xE75F3BEB,
+    0x9E9E55F0, 0x707E0512, 0xEC7EBFA7, 0x029EEF45,
+    0x1FFC6391, 0xF11C3373, 0x6D1C89C6, 0x83FCD924,
+    0xFA3DB73F, 0x14DDE7DD, 0x88DD5D68, 0x663D0D8A,
+    0xB21844C0, 0x5CF81422, 0xC0F8AE97, 0x2E18FE75,
+    0x57D9906E, 0xB939C08C, 0x25397A39, 0xCBD92ADB,
+    0xD6BBA60F, 0x385BF6ED, 0xA45B4C58, 0x4ABB1CBA,
+    0x337A72A1, 0xDD9A2243, 0x419A98F6, 0xAF7AC814,
+    0x46F041F1, 0xA8101113, 0x3410ABA6, 0xDAF0FB44,
+    0xA331955F, 0x4DD1C5BD, 0xD1D17F08, 0x3F312FEA,
+    0x2253A33E, 0xCCB3F3DC, 0x50B34969, 0xBE53198B,
+    0xC7927790, 0x29722772, 0xB5729DC7, 0x5B92CD25,
+    0x8FB7846F, 0x6157D48D, 0xFD576E38, 0x13B73EDA,
+    0x6A7650C1, 0x84960023, 0x1896BA96, 0xF676EA74,
+    0xEB1466A0, 0x05F43642, 0x99F48CF7, 0x7714DC15,
+    0x0ED5B20E, 0xE035E2EC, 0x7C355859, 0x92D508BB,
+    0xF6BF02BC, 0x185F525E, 0x845FE8EB, 0x6ABFB809,
+    0x137ED612, 0xFD9E86F0, 0x619E3C45, 0x8F7E6CA7,
+    0x921CE073, 0x7CFCB091, 0xE0FC0A24, 0x0E1C5AC6,
+    0x77DD34DD, 0x993D643F, 0x053DDE8A, 0xEBDD8E68,
+    0x3FF8C722, 0xD11897C0, 0x4D182D75, 0xA3F87D97,
+    0xDA39138C, 0x34D9436E, 0xA8D9F9DB, 0x4639A939,
+    0x5B5B25ED, 0xB5BB750F, 0x29BBCFBA, 0xC75B9F58,
+    0xBE9AF143, 0x507AA1A1, 0xCC7A1B14, 0x229A4BF6,
+    0xCB10C213, 0x25F092F1, 0xB9F02844, 0x571078A6,
+    0x2ED116BD, 0xC031465F, 0x5C31FCEA, 0xB2D1AC08,
+    0xAFB320DC, 0x4153703E, 0xDD53CA8B, 0x33B39A69,
+    0x4A72F472, 0xA492A490, 0x38921E25, 0xD6724EC7,
+    0x0257078D, 0xECB7576F, 0x70B7EDDA, 0x9E57BD38,
+    0xE796D323, 0x097683C1, 0x95763974, 0x7B966996,
+    0x66F4E542, 0x8814B5A0, 0x14140F15, 0xFAF45FF7,
+    0x833531EC, 0x6DD5610E, 0xF1D5DBBB, 0x1F358B59,
+    0x8DE083E2, 0x6300D300, 0xFF0069B5, 0x11E03957,
+    0x6821574C, 0x86C107AE, 0x1AC1BD1B, 0xF421EDF9,
+    0xE943612D, 0x07A331CF, 0x9BA38B7A, 0x7543DB98,
+    0x0C82B583, 0xE262E561, 0x7E625FD4, 0x90820F36,
+    0x44A7467C, 0xAA47169E, 0x3647AC2B, 0xD8A7FCC9,
+    0xA16692D2, 0x4F86C230, 0xD3867885, 0x3D662867,
+    0x2004A4B3, 0xCEE4F451, 0x52E44EE4, 0xBC041E06,
+    0xC5C5701D, 0x2B2520FF, 0xB7259A4A, 0x59C5CAA8,
+    0xB04F434D, 0x5EAF13AF, 0xC2AFA91A, 0x2C4FF9F8,
+    0x558E97E3, 0xBB6EC701, 0x276E7DB4, 0xC98E2D56,
+    0xD4ECA182, 0x3A0CF160, 0xA60C4BD5, 0x48EC1B37,
+    0x312D752C, 0xDFCD25CE, 0x43CD9F7B, 0xAD2DCF99,
+    0x790886D3, 0x97E8D631, 0x0BE86C84, 0xE5083C66,
+    0x9CC9527D, 0x7229029F, 0xEE29B82A, 0x00C9E8C8,
+    0x1DAB641C, 0xF34B34FE, 0x6F4B8E4B, 0x81ABDEA9,
+    0xF86AB0B2, 0x168AE050, 0x8A8A5AE5, 0x646A0A07
+  },
+  {
+    0x00000000, 0x9B3B1953, 0x99567935, 0x026D6066,
+    0x9D8CB9F9, 0x06B7A0AA, 0x04DAC0CC, 0x9FE1D99F,
+    0x94393861, 0x0F022132, 0x0D6F4154, 0x96545807,
+    0x09B58198, 0x928E98CB, 0x90E3F8AD, 0x0BD8E1FE,
+    0x87523B51, 0x1C692202, 0x1E044264, 0x853F5B37,
+    0x1ADE82A8, 0x81E59BFB, 0x8388FB9D, 0x18B3E2CE,
+    0x136B0330, 0x88501A63, 0x8A3D7A05, 0x11066356,
+    0x8EE7BAC9, 0x15DCA39A, 0x17B1C3FC, 0x8C8ADAAF,
+    0xA1843D31, 0x3ABF2462, 0x38D24404, 0xA3E95D57,
+    0x3C0884C8, 0xA7339D9B, 0xA55EFDFD, 0x3E65E4AE,
+    0x35BD0550, 0xAE861C03, 0xACEB7C65, 0x37D06536,
+    0xA831BCA9, 0x330AA5FA, 0x3167C59C, 0xAA5CDCCF,
+    0x26D60660, 0xBDED1F33, 0xBF807F55, 0x24BB6606,
+    0xBB5ABF99, 0x2061A6CA, 0x220CC6AC, 0xB937DFFF,
+    0xB2EF3E01, 0x29D42752, 0x2BB94734, 0xB0825E67,
+    0x2F6387F8, 0xB4589EAB, 0xB635FECD, 0x2D0EE79E,
+    0xEC2831F1, 0x771328A2, 0x757E48C4, 0xEE455197,
+    0x71A48808, 0xEA9F915B, 0xE8F2F13D, 0x73C9E86E,
+    0x78110990, 0xE32A10C3, 0xE14770A5, 0x7A7C69F6,
+    0xE59DB069, 0x7EA6A93A, 0x7CCBC95C, 0xE7F0D00F,
+    0x6B7A0AA0, 0xF04113F3, 0xF22C7395, 0x69176AC6,
+    0xF6F6B359, 0x6DCDAA0A, 0x6FA0CA6C, 0xF49BD33F,
+    0xFF4332C1, 0x64782B92, 0x66154BF4, 0xFD2E52A7,
+    0x62CF8B38, 0xF9F4926B, 0xFB99F20D, 0x60A2EB5E,
+    0x4DAC0CC0, 0xD6971593, 0xD4FA75F5, 0x4FC16CA6,
+    0xD020B539, 0x4B1BAC6A, 0x4976CC0C, 0xD24DD55F,
+    0xD99534A1, 0x42AE2DF2, 0x40C34D94, 0xDBF854C7,
+    0x44198D58, 0xDF22940B, 0xDD4FF46D, 0x4674ED3E,
+    0xCAFE3791, 0x51C52EC2, 0x53A84EA4, 0xC89357F7,
+    0x57728E68, 0xCC49973B, 0xCE24F75D, 0x551FEE0E,
+    0x5EC70FF0, 0xC5FC16A3, 0xC79176C5, 0x5CAA6F96,
+    0xC34BB609, 0x5870AF5A, 0x5A1DCF3C, 0xC126D66F,
+    0x77702871, 0xEC4B3122, 0xEE265144, 0x751D4817,
+    0xEAFC9188, 0x71C788DB, 0x73AAE8BD, 0xE891F1EE,
+    0xE3491010, 0x78720943, 0x7A1F6925, 0xE1247076,
+    0x7EC5A9E9, 0xE5FEB0BA, 0xE793D0DC, 0x7CA8C98F,
+    0xF0221320, 0x6B190A73, 0x69746A15, 0xF24F7346,
+    0x6DAEAAD9, 0xF695B38A, 0xF4F8D3EC, 0x6FC3CABF,
+    0x641B2B41, 0xFF203212, 0xFD4D5274, 0x66764B27,
+    0xF99792B8, 0x62AC8BEB, 0x60C1EB8D, 0xFBFAF2DE,
+    0xD6F41540, 0x4DCF0C13, 0x4FA26C75, 0xD4997526,
+    0x4B78ACB9, 0xD043B5EA, 0xD22ED58C, 0x4915CCDF,
+    0x42CD2D21, 0xD9F63472, 0xDB9B5414, 0x40A04D47,
+    0xDF4194D8, 0x447A8D8B, 0x4617EDED, 0xDD2CF4BE,
+    0x51A62E11, 0xCA9D3742, 0xC8F05724, 0x53CB4E77,
+    0xCC2A97E8, 0x57118EBB, 0x557CEEDD, 0xCE47F78E,
+    0xC59F1670, 0x5EA40F23, 0x5CC96F45, 0xC7F27616,
+    0x5813AF89, 0xC328B6DA, 0xC145D6BC, 0x5A7ECFEF,
+    0x9B581980, 0x006300D3, 0x020E60B5, 0x993579E6,
+    0x06D4A079, 0x9DEFB92A, 0x9F82D94C, 0x04B9C01F,
+    0x0F6121E1, 0x945A38B2, 0x963758D4, 0x0D0C4187,
+    0x92ED9818, 0x09D6814B, 0x0BBBE12D, 0x9080F87E,
+    0x1C0A22D1, 0x87313B82, 0x855C5BE4, 0x1E6742B7,
+    0x81869B28, 0x1ABD827B, 0x18D0E21D, 0x83EBFB4E,
+    0x88331AB0, 0x130803E3, 0x11656385, 0x8A5E7AD6,
+    0x15BFA349, 0x8E84BA1A, 0x8CE9DA7C, 0x17D2C32F,
+    0x3ADC24B1, 0xA1E73DE2, 0xA38A5D84, 0x38B144D7,
+    0xA7509D48, 0x3C6B841B, 0x3E06E47D, 0xA53DFD2E,
+    0xAEE51CD0, 0x35DE0583, 0x37B365E5, 0xAC887CB6,
+    0x3369A529, 0xA852BC7A, 0xAA3FDC1C, 0x3104C54F,
+    0xBD8E1FE0, 0x26B506B3, 0x24D866D5, 0xBFE37F86,
+    0x2002A619, 0xBB39BF4A, 0xB954DF2C, 0x226FC67F,
+    0x29B72781, 0xB28C3ED2, 0xB0E15EB4, 0x2BDA47E7,
+    0xB43B9E78, 0x2F00872B, 0x2D6DE74D, 0xB656FE1E
+  },
+  {
+    0x00000000, 0x6AFC09B6, 0xD5F8136C, 0xBF041ADA,
+    0x04D06D4B, 0x6E2C64FD, 0xD1287E27, 0xBBD47791,
+    0x09A0DA96, 0x635CD320, 0xDC58C9FA, 0xB6A4C04C,
+    0x0D70B7DD, 0x678CBE6B, 0xD888A4B1, 0xB274AD07,
+    0x1341B52C, 0x79BDBC9A, 0xC6B9A640, 0xAC45AFF6,
+    0x1791D867, 0x7D6DD1D1, 0xC269CB0B, 0xA895C2BD,
+    0x1AE16FBA, 0x701D660C, 0xCF197CD6, 0xA5E57560,
+    0x1E3102F1, 0x74CD0B47, 0xCBC9119D, 0xA135182B,
+    0x26836A58, 0x4C7F63EE, 0xF37B7934, 0x99877082,
+    0x22530713, 0x48AF0EA5, 0xF7AB147F, 0x9D571DC9,
+    0x2F23B0CE, 0x45DFB978, 0xFADBA3A2, 0x9027AA14,
+    0x2BF3DD85, 0x410FD433, 0xFE0BCEE9, 0x94F7C75F,
+    0x35C2DF74, 0x5F3ED6C2, 0xE03ACC18, 0x8AC6C5AE,
+    0x3112B23F, 0x5BEEBB89, 0xE4EAA153, 0x8E16A8E5,
+    0x3C6205E2, 0x569E0C54, 0xE99A168E, 0x83661F38,
+    0x38B268A9, 0x524E611F, 0xED4A7BC5, 0x87B67273,
+    0x4D06D4B0, 0x27FADD06, 0x98FEC7DC, 0xF202CE6A,
+    0x49D6B9FB, 0x232AB04D, 0x9C2EAA97, 0xF6D2A321,
+    0x44A60E26, 0x2E5A0790, 0x915E1D4A, 0xFBA214FC,
+    0x4076636D, 0x2A8A6ADB, 0x958E7001, 0xFF7279B7,
+    0x5E47619C, 0x34BB682A, 0x8BBF72F0, 0xE1437B46,
+    0x5A970CD7, 0x306B0561, 0x8F6F1FBB, 0xE593160D,
+    0x57E7BB0A, 0x3D1BB2BC, 0x821FA866, 0xE8E3A1D0,
+    0x5337D641, 0x39CBDFF7, 0x86CFC52D, 0xEC33CC9B,
+    0x6B85BEE8, 0x0179B75E, 0xBE7DAD84, 0xD481A432,
+    0x6F55D3A3, 0x05A9DA15, 0xBAADC0CF, 0xD051C979,
+    0x6225647E, 0x08D96DC8, 0xB7DD7712, 0xDD217EA4,
+    0x66F50935, 0x0C090083, 0xB30D1A59, 0xD9F113EF,
+    0x78C40BC4, 0x12380272, 0xAD3C18A8, 0xC7C0111E,
+    0x7C14668F, 0x16E86F39, 0xA9EC75E3, 0xC3107C55,
+    0x7164D152, 0x1B98D8E4, 0xA49CC23E, 0xCE60CB88,
+    0x75B4BC19, 0x1F48B5AF, 0xA04CAF75, 0xCAB0A6C3,
+    0x9A0DA960, 0xF0F1A0D6, 0x4FF5BA0C, 0x2509B3BA,
+    0x9EDDC42B, 0xF421CD9D, 0x4B25D747, 0x21D9DEF1,
+    0x93AD73F6, 0xF9517A40, 0x4655609A, 0x2CA9692C,
+    0x977D1EBD, 0xFD81170B, 0x42850DD1, 0x28790467,
+    0x894C1C4C, 0xE3B015FA, 0x5CB40F20, 0x36480696,
+    0x8D9C7107, 0xE76078B1, 0x5864626B, 0x32986BDD,
+    0x80ECC6DA, 0xEA10CF6C, 0x5514D5B6, 0x3FE8DC00,
+    0x843CAB91, 0xEEC0A227, 0x51C4B8FD, 0x3B38B14B,
+    0xBC8EC338, 0xD672CA8E, 0x6976D054, 0x038AD9E2,
+    0xB85EAE73, 0xD2A2A7C5, 0x6DA6BD1F, 0x075AB4A9,
+    0xB52E19AE, 0xDFD21018, 0x60D60AC2, 0x0A2A0374,
+    0xB1FE74E5, 0xDB027D53, 0x64066789, 0x0EFA6E3F,
+    0xAFCF7614, 0xC5337FA2, 0x7A376578, 0x10CB6CCE,
+    0xAB1F1B5F, 0xC1E312E9, 0x7EE70833, 0x141B0185,
+    0xA66FAC82, 0xCC93A534, 0x7397BFEE, 0x196BB658,
+    0xA2BFC1C9, 0xC843C87F, 0x7747D2A5, 0x1DBBDB13,
+    0xD70B7DD0, 0xBDF77466, 0x02F36EBC, 0x680F670A,
+    0xD3DB109B, 0xB927192D, 0x062303F7, 0x6CDF0A41,
+    0xDEABA746, 0xB457AEF0, 0x0B53B42A, 0x61AFBD9C,
+    0xDA7BCA0D, 0xB087C3BB, 0x0F83D961, 0x657FD0D7,
+    0xC44AC8FC, 0xAEB6C14A, 0x11B2DB90, 0x7B4ED226,
+    0xC09AA5B7, 0xAA66AC01, 0x1562B6DB, 0x7F9EBF6D,
+    0xCDEA126A, 0xA7161BDC, 0x18120106, 0x72EE08B0,
+    0xC93A7F21, 0xA3C67697, 0x1CC26C4D, 0x763E65FB,
+    0xF1881788, 0x9B741E3E, 0x247004E4, 0x4E8C0D52,
+    0xF5587AC3, 0x9FA47375, 0x20A069AF, 0x4A5C6019,
+    0xF828CD1E, 0x92D4C4A8, 0x2DD0DE72, 0x472CD7C4,
+    0xFCF8A055, 0x9604A9E3, 0x2900B339, 0x43FCBA8F,
+    0xE2C9A2A4, 0x8835AB12, 0x3731B1C8, 0x5DCDB87E,
+    0xE619CFEF, 0x8CE5C659, 0x33E1DC83, 0x591DD535,
+    0xEB697832, 0x81957184, 0x3E916B5E, 0x546D62E8,
+    0xEFB91579, 0x85451CCF, 0x3A410615, 0x50BD0FA3
+  },
+  {
+    0x00000000, 0x47EAA3B1, 0x8FD54762, 0xC83FE4D3,
+    0xB08AC557, 0xF76066E6, 0x3F5F8235, 0x78B52184,
+    0xCE35C13D, 0x89DF628C, 0x41E0865F, 0x060A25EE,
+    0x7EBF046A, 0x3955A7DB, 0xF16A4308, 0xB680E0B9,
+    0x334BC9E9, 0x74A16A58, 0xBC9E8E8B, 0xFB742D3A,
+    0x83C10CBE, 0xC42BAF0F, 0x0C144BDC, 0x4BFEE86D,
+    0xFD7E08D4, 0xBA94AB65, 0x72AB4FB6, 0x3541EC07,
+    0x4DF4CD83, 0x0A1E6E32, 0xC2218AE1, 0x85CB2950,
+    0x669793D2, 0x217D3063, 0xE942D4B0, 0xAEA87701,
+    0xD61D5685, 0x91F7F534, 0x59C811E7, 0x1E22B256,
+    0xA8A252EF, 0xEF48F15E, 0x2777158D, 0x609DB63C,
+    0x182897B8, 0x5FC23409, 0x97FDD0DA, 0xD017736B,
+    0x55DC5A3B, 0x1236F98A, 0xDA091D59, 0x9DE3BEE8,
+    0xE5569F6C, 0xA2BC3CDD, 0x6A83D80E, 0x2D697BBF,
+    0x9BE99B06, 0xDC0338B7, 0x143CDC64, 0x53D67FD5,
+    0x2B635E51, 0x6C89FDE0, 0xA4B61933, 0xE35CBA82,
+    0xCD2F27A4, 0x8AC58415, 0x42FA60C6, 0x0510C377,
+    0x7DA5E2F3, 0x3A4F4142, 0xF270A591, 0xB59A0620,
+    0x031AE699, 0x44F04528, 0x8CCFA1FB, 0xCB25024A,
+    0xB39023CE, 0xF47A807F, 0x3C4564AC, 0x7BAFC71D,
+    0xFE64EE4D, 0xB98E4DFC, 0x71B1A92F, 0x365B0A9E,
+    0x4EEE2B1A, 0x090488AB, 0xC13B6C78, 0x86D1CFC9,
+    0x30512F70, 0x77BB8CC1, 0xBF846812, 0xF86ECBA3,
+    0x80DBEA27, 0xC7314996, 0x0F0EAD45, 0x48E40EF4,
+    0xABB8B476, 0xEC5217C7, 0x246DF314, 0x638750A5,
+    0x1B327121, 0x5CD8D290, 0x94E73643, 0xD30D95F2,
+    0x658D754B, 0x2267D6FA, 0xEA583229, 0xADB29198,
+    0xD507B01C, 0x92ED13AD, 0x5AD2F77E, 0x1D3854CF,
+    0x98F37D9F, 0xDF19DE2E, 0x17263AFD, 0x50CC994C,
+    0x2879B8C8, 0x6F931B79, 0xA7ACFFAA, 0xE0465C1B,
+    0x56C6BCA2, 0x112C1F13, 0xD913FBC0, 0x9EF95871,
+    0xE64C79F5, 0xA1A6DA44, 0x69993E97, 0x2E739D26,
+    0x357E04DB, 0x7294A76A, 0xBAAB43B9, 0xFD41E008,
+    0x85F4C18C, 0xC21E623D, 0x0A2186EE, 0x4DCB255F,
+    0xFB4BC5E6, 0xBCA16657, 0x749E8284, 0x33742135,
+    0x4BC100B1, 0x0C2BA300, 0xC41447D3, 0x83FEE462,
+    0x0635CD32, 0x41DF6E83, 0x89E08A50, 0xCE0A29E1,
+    0xB6BF0865, 0xF155ABD4, 0x396A4F07, 0x7E80ECB6,
+    0xC8000C0F, 0x8FEAAFBE, 0x47D54B6D, 0x003FE8DC,
+    0x788AC958, 0x3F606AE9, 0xF75F8E3A, 0xB0B52D8B,
+    0x53E99709, 0x140334B8, 0xDC3CD06B, 0x9BD673DA,
+    0xE363525E, 0xA489F1EF, 0x6CB6153C, 0x2B5CB68D,
+    0x9DDC5634, 0xDA36F585, 0x12091156, 0x55E3B2E7,
+    0x2D569363, 0x6ABC30D2, 0xA283D401, 0xE56977B0,
+    0x60A25EE0, 0x2748FD51, 0xEF771982, 0xA89DBA33,
+    0xD0289BB7, 0x97C23806, 0x5FFDDCD5, 0x18177F64,
+    0xAE979FDD, 0xE97D3C6C, 0x2142D8BF, 0x66A87B0E,
+    0x1E1D5A8A, 0x59F7F93B, 0x91C81DE8, 0xD622BE59,
+    0xF851237F, 0xBFBB80CE, 0x7784641D, 0x306EC7AC,
+    0x48DBE628, 0x0F314599, 0xC70EA14A, 0x80E402FB,
+    0x3664E242, 0x718E41F3, 0xB9B1A520, 0xFE5B0691,
+    0x86EE2715, 0xC10484A4, 0x093B6077, 0x4ED1C3C6,
+    0xCB1AEA96, 0x8CF04927, 0x44CFADF4, 0x03250E45,
+    0x7B902FC1, 0x3C7A8C70, 0xF44568A3, 0xB3AFCB12,
+    0x052F2BAB, 0x42C5881A, 0x8AFA6CC9, 0xCD10CF78,
+    0xB5A5EEFC, 0xF24F4D4D, 0x3A70A99E, 0x7D9A0A2F,
+    0x9EC6B0AD, 0xD92C131C, 0x1113F7CF, 0x56F9547E,
+    0x2E4C75FA, 0x69A6D64B, 0xA1993298, 0xE6739129,
+    0x50F37190, 0x1719D221, 0xDF2636F2, 0x98CC9543,
+    0xE079B4C7, 0xA7931776, 0x6FACF3A5, 0x28465014,
+    0xAD8D7944, 0xEA67DAF5, 0x22583E26, 0x65B29D97,
+    0x1D07BC13, 0x5AED1FA2, 0x92D2FB71, 0xD53858C0,
+    0x63B8B879, 0x24521BC8, 0xEC6DFF1B, 0xAB875CAA,
+    0xD3327D2E, 0x94D8DE9F, 0x5CE73A4C, 0x1B0D99FD
+  },
+  {
+    0x00000000, 0xF1F5210F, 0x4CCA098D, 0xBD3F2882,
+    0x9994131A, 0x68613215, 0xD55E1A97, 0x24AB3B98,
+    0x9C086DA7, 0x6DFD4CA8, 0xD0C2642A, 0x21374525,
+    0x059C7EBD, 0xF4695FB2, 0x49567730, 0xB8A3563F,
+    0x973090DD, 0x66C5B1D2, 0xDBFA9950, 0x2A0FB85F,
+    0x0EA483C7, 0xFF51A2C8, 0x426E8A4A, 0xB39BAB45,
+    0x0B38FD7A, 0xFACDDC75, 0x47F2F4F7, 0xB607D5F8,
+    0x92ACEE60, 0x6359CF6F, 0xDE66E7ED, 0x2F93C6E2,
+    0x81416A29, 0x70B44B26, 0xCD8B63A4, 0x3C7E42AB,
+    0x18D57933, 0xE920583C, 0x541F70BE, 0xA5EA51B1,
+    0x1D49078E, 0xECBC2681, 0x51830E03, 0xA0762F0C,
+    0x84DD1494, 0x7528359B, 0xC8171D19, 0x39E23C16,
+    0x1671FAF4, 0xE784DBFB, 0x5ABBF379, 0xAB4ED276,
+    0x8FE5E9EE, 0x7E10C8E1, 0xC32FE063, 0x32DAC16C,
+    0x8A799753, 0x7B8CB65C, 0xC6B39EDE, 0x3746BFD1,
+    0x13ED8449, 0xE218A546, 0x5F278DC4, 0xAED2ACCB,
+    0xADA29FC1, 0x5C57BECE, 0xE168964C, 0x109DB743,
+    0x34368CDB, 0xC5C3ADD4, 0x78FC8556, 0x8909A459,
+    0x31AAF266, 0xC05FD369, 0x7D60FBEB, 0x8C95DAE4,
+    0xA83EE17C, 0x59CBC073, 0xE4F4E8F1, 0x1501C9FE,
+    0x3A920F1C, 0xCB672E13, 0x76580691, 0x87AD279E,
+    0xA3061C06, 0x52F33D09, 0xEFCC158B, 0x1E393484,
+    0xA69A62BB, 0x576F43B4, 0xEA506B36, 0x1BA54A39,
+    0x3F0E71A1, 0xCEFB50AE, 0x73C4782C, 0x82315923,
+    0x2CE3F5E8, 0xDD16D4E7, 0x6029FC65, 0x91DCDD6A,
+    0xB577E6F2, 0x4482C7FD, 0xF9BDEF7F, 0x0848CE70,
+    0xB0EB984F, 0x411EB940, 0xFC2191C2, 0x0DD4B0CD,
+    0x297F8B55, 0xD88AAA5A, 0x65B582D8, 0x9440A3D7,
+    0xBBD36535, 0x4A26443A, 0xF7196CB8, 0x06EC4DB7,
+    0x2247762F, 0xD3B25720, 0x6E8D7FA2, 0x9F785EAD,
+    0x27DB0892, 0xD62E299D, 0x6B11011F, 0x9AE42010,
+    0xBE4F1B88, 0x4FBA3A87, 0xF2851205, 0x0370330A,
+    0xF4657411, 0x0590551E, 0xB8AF7D9C, 0x495A5C93,
+    0x6DF1670B, 0x9C044604, 0x213B6E86, 0xD0CE4F89,
+    0x686D19B6, 0x999838B9, 0x24A7103B, 0xD5523134,
+    0xF1F90AAC, 0x000C2BA3, 0xBD330321, 0x4CC6222E,
+    0x6355E4CC, 0x92A0C5C3, 0x2F9FED41, 0xDE6ACC4E,
+    0xFAC1F7D6, 0x0B34D6D9, 0xB60BFE5B, 0x47FEDF54,
+    0xFF5D896B, 0x0EA8A864, 0xB39780E6, 0x4262A1E9,
+    0x66C99A71, 0x973CBB7E, 0x2A0393FC, 0xDBF6B2F3,
+    0x75241E38, 0x84D13F37, 0x39EE17B5, 0xC81B36BA,
+    0xECB00D22, 0x1D452C2D, 0xA07A04AF, 0x518F25A0,
+    0xE92C739F, 0x18D95290, 0xA5E67A12, 0x54135B1D,
+    0x70B86085, 0x814D418A, 0x3C726908, 0xCD874807,
+    0xE2148EE5, 0x13E1AFEA, 0xAEDE8768, 0x5F2BA667,
+    0x7B809DFF, 0x8A75BCF0, 0x374A9472, 0xC6BFB57D,
+    0x7E1CE342, 0x8FE9C24D, 0x32D6EACF, 0xC323CBC0,
+    0xE788F058, 0x167DD157, 0xAB42F9D5, 0x5AB7D8DA,
+    0x59C7EBD0, 0xA832CADF, 0x150DE25D, 0xE4F8C352,
+    0xC053F8CA, 0x31A6D9C5, 0x8C99F147, 0x7D6CD048,
+    0xC5CF8677, 0x343AA778, 0x89058FFA, 0x78F0AEF5,
+    0x5C5B956D, 0xADAEB462, 0x10919CE0, 0xE164BDEF,
+    0xCEF77B0D, 0x3F025A02, 0x823D7280, 0x73C8538F,
+    0x57636817, 0xA6964918, 0x1BA9619A, 0xEA5C4095,
+    0x52FF16AA, 0xA30A37A5, 0x1E351F27, 0xEFC03E28,
+    0xCB6B05B0, 0x3A9E24BF, 0x87A10C3D, 0x76542D32,
+    0xD88681F9, 0x2973A0F6, 0x944C8874, 0x65B9A97B,
+    0x411292E3, 0xB0E7B3EC, 0x0DD89B6E, 0xFC2DBA61,
+    0x448EEC5E, 0xB57BCD51, 0x0844E5D3, 0xF9B1C4DC,
+    0xDD1AFF44, 0x2CEFDE4B, 0x91D0F6C9, 0x6025D7C6,
+    0x4FB61124, 0xBE43302B, 0x037C18A9, 0xF28939A6,
+    0xD622023E, 0x27D72331, 0x9AE80BB3, 0x6B1D2ABC,
+    0xD3BE7C83, 0x224B5D8C, 0x9F74750E, 0x6E815401,
+    0x4A2A6F99, 0xBBDF4E96, 0x06E06614, 0xF715471B
+  },
+  {
+    0x00000000, 0xFF647C46, 0x51E8B31F, 0xAE8CCF59,
+    0xA3D1663E, 0x5CB51A78, 0xF239D521, 0x0D5DA967,
+    0xE88287EF, 0x17E6FBA9, 0xB96A34F0, 0x460E48B6,
+    0x4B53E1D1, 0xB4379D97, 0x1ABB52CE, 0xE5DF2E88,
+    0x7E25444D, 0x8141380B, 0x2FCDF752, 0xD0A98B14,
+    0xDDF42273, 0x22905E35, 0x8C1C916C, 0x7378ED2A,
+    0x96A7C3A2, 0x69C3BFE4, 0xC74F70BD, 0x382B0CFB,
+    0x3576A59C, 0xCA12D9DA, 0x649E1683, 0x9BFA6AC5,
+    0xFC4A889A, 0x032EF4DC, 0xADA23B85, 0x52C647C3,
+    0x5F9BEEA4, 0xA0FF92E2, 0x0E735DBB, 0xF11721FD,
+    0x14C80F75, 0xEBAC7333, 0x4520BC6A, 0xBA44C02C,
+    0xB719694B, 0x487D150D, 0xE6F1DA54, 0x1995A612,
+    0x826FCCD7, 0x7D0BB091, 0xD3877FC8, 0x2CE3038E,
+    0x21BEAAE9, 0xDEDAD6AF, 0x705619F6, 0x8F3265B0,
+    0x6AED4B38, 0x9589377E, 0x3B05F827, 0xC4618461,
+    0xC93C2D06, 0x36585140, 0x98D49E19, 0x67B0E25F,
+    0x57B55AA7, 0xA8D126E1, 0x065DE9B8, 0xF93995FE,
+    0xF4643C99, 0x0B0040DF, 0xA58C8F86, 0x5AE8F3C0,
+    0xBF37DD48, 0x4053A10E, 0xEEDF6E57, 0x11BB1211,
+    0x1CE6BB76, 0xE382C730, 0x4D0E0869, 0xB26A742F,
+    0x29901EEA, 0xD6F462AC, 0x7878ADF5, 0x871CD1B3,
+    0x8A4178D4, 0x75250492, 0xDBA9CBCB, 0x24CDB78D,
+    0xC1129905, 0x3E76E543, 0x90FA2A1A, 0x6F9E565C,
+    0x62C3FF3B, 0x9DA7837D, 0x332B4C24, 0xCC4F3062,
+    0xABFFD23D, 0x549BAE7B, 0xFA176122, 0x05731D64,
+    0x082EB403, 0xF74AC845, 0x59C6071C, 0xA6A27B5A,
+    0x437D55D2, 0xBC192994, 0x1295E6CD, 0xEDF19A8B,
+    0xE0AC33EC, 0x1FC84FAA, 0xB14480F3, 0x4E20FCB5,
+    0xD5DA9670, 0x2ABEEA36, 0x8432256F, 0x7B565929,
+    0x760BF04E, 0x896F8C08, 0x27E34351, 0xD8873F17,
+    0x3D58119F, 0xC23C6DD9, 0x6CB0A280, 0x93D4DEC6,
+    0x9E8977A1, 0x61ED0BE7, 0xCF61C4BE, 0x3005B8F8,
+    0xAF6AB54E, 0x500EC908, 0xFE820651, 0x01E67A17,
+    0x0CBBD370, 0xF3DFAF36, 0x5D53606F, 0xA2371C29,
+    0x47E832A1, 0xB88C4EE7, 0x160081BE, 0xE964FDF8,
+    0xE439549F, 0x1B5D28D9, 0xB5D1E780, 0x4AB59BC6,
+    0xD14FF103, 0x2E2B8D45, 0x80A7421C, 0x7FC33E5A,
+    0x729E973D, 0x8DFAEB7B, 0x23762422, 0xDC125864,
+    0x39CD76EC, 0xC6A90AAA, 0x6825C5F3, 0x9741B9B5,
+    0x9A1C10D2, 0x65786C94, 0xCBF4A3CD, 0x3490DF8B,
+    0x53203DD4, 0xAC444192, 0x02C88ECB, 0xFDACF28D,
+    0xF0F15BEA, 0x0F9527AC, 0xA119E8F5, 0x5E7D94B3,
+    0xBBA2BA3B, 0x44C6C67D, 0xEA4A0924, 0x152E7562,
+    0x1873DC05, 0xE717A043, 0x499B6F1A, 0xB6FF135C,
+    0x2D057999, 0xD26105DF, 0x7CEDCA86, 0x8389B6C0,
+    0x8ED41FA7, 0x71B063E1, 0xDF3CACB8, 0x2058D0FE,
+    0xC587FE76, 0x3AE38230, 0x946F4D69, 0x6B0B312F,
+    0x66569848, 0x9932E40E, 0x37BE2B57, 0xC8DA5711,
+    0xF8DFEFE9, 0x07BB93AF, 0xA9375CF6, 0x565320B0,
+    0x5B0E89D7, 0xA46AF591, 0x0AE63AC8, 0xF582468E,
+    0x105D6806, 0xEF391440, 0x41B5DB19, 0xBED1A75F,
+    0xB38C0E38, 0x4CE8727E, 0xE264BD27, 0x1D00C161,
+    0x86FAABA4, 0x799ED7E2, 0xD71218BB, 0x287664FD,
+    0x252BCD9A, 0xDA4FB1DC, 0x74C37E85, 0x8BA702C3,
+    0x6E782C4B, 0x911C500D, 0x3F909F54, 0xC0F4E312,
+    0xCDA94A75, 0x32CD3633, 0x9C41F96A, 0x6325852C,
+    0x04956773, 0xFBF11B35, 0x557DD46C, 0xAA19A82A,
+    0xA744014D, 0x58207D0B, 0xF6ACB252, 0x09C8CE14,
+    0xEC17E09C, 0x13739CDA, 0xBDFF5383, 0x429B2FC5,
+    0x4FC686A2, 0xB0A2FAE4, 0x1E2E35BD, 0xE14A49FB,
+    0x7AB0233E, 0x85D45F78, 0x2B589021, 0xD43CEC67,
+    0xD9614500, 0x26053946, 0x8889F61F, 0x77ED8A59,
+    0x9232A4D1, 0x6D56D897, 0xC3DA17CE, 0x3CBE6B88,
+    0x31E3C2EF, 0xCE87BEA9, 0x600B71F0, 0x9F6F0DB6
+  }
+};
+
+// x^(2^n) modulo the polynomial, for combining crcs
+static const uint32_t _mdfs_crc_x2n_table[32] = {
+  0x40000000, 0x20000000, 0x08000000, 0x00800000,
+  0x00008000, 0xD79025C9, 0x9A0DA960, 0xDF67F2C0,
+  0xE4029289, 0xFD1A086C, 0x3B3240C6, 0x7D9BF314,
+  0xF0C2B08A, 0x58605FA6, 0xDC705D03, 0x150C5099,
+  0x984652E8, 0x49CC688F, 0xD3D5A04A, 0xE2DB4A27,
+  0x1406DCFC, 0xE0685C31, 0x196AFF36, 0xE61A8DDA,
+  0x6FDFCF3F, 0x12129E77, 0x06CEA03A, 0x6B15809A,
+  0x980CDF10, 0x7EA15F1E, 0x43D4DF54, 0x40000000
+};
+
+#endif // _MDFS_CRC_TABLES_H_
@@ -0,0 +1,232 @@
+/* mdfs_dump: list, verify and extract an MDFS image
+
+Usage: mdfs_dump [-j threads] <image>
+       mdfs_dump [-j threads] -x <directory> <image> [name...]
+
+Lists every file with offset, size and crc status, followed by the file list
+crc. The image is mmap'ed and the crcs are checked on several threads, so a
+big image is checked at memory speed.
+With -x the files (all, or only the given names) are written below directory.
+
+Exit code is 0 when everything checks out, 2 when a crc is wrong or a file
+doesn't fit in the image, 1 for other errors.
+*/
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "MDFS.h"
+
+#define DUMP_OK (0)
+#define DUMP_BAD_CRC (1)
+#define DUMP_NO_CRC (2)
+#define DUMP_TRUNCATED (3)
+
+typedef struct DumpFile {
+  char name[MDFS_MAX_FILENAME];
+  uint32_t offset;
+  int32_t size;
+  uint32_t crc;
+  int status;
+} dump_file_t;
+
+typedef struct DumpJob {
+  mdfs_t* mdfs;
+  dump_file_t* files;
+  int count;
+  int next; // Next file to check, protected by lock
+  pthread_mutex_t lock;
+} dump_job_t;
+
+static void* _worker(void* arg)
+{
+  dump_job_t* job = (dump_job_t*)arg;
+  while (1)
+  {
+    pthread_mutex_lock(&job->lock);
+    int i = job->next++;
+    pthread_mutex_unlock(&job->lock);
+    if (i >= job->count) break;
+    dump_file_t* f = &job->files[i];
+    if (f->status != DUMP_OK) continue;
+    // mdfs_fopen isn't thread safe, only read the data here
+    uint32_t crc = mdfs_calc_crc(mdfs_get_file_location(job->mdfs, f->offset), f->size);
+    if (crc != f->crc) f->status = DUMP_BAD_CRC;
+  }
+  return NULL;
+}
+
+/* Reject names that would end up outside the extract directory */
+static int _safe_name(const char* name)
+{
+  if (name[0] == '/') return 0;
+  const char* p = name;
+  while (p != NULL)
+  {
+    if (strncmp(p, "..", 2) == 0 && (p[2] == '/' || p[2] == 0)) return 0;
+    p = strchr(p, '/');
+    if (p != NULL) ++p;
+  }
+  return 1;
+}
+
+static int _extract(const dump_file_t* f, const char* dir, const void* data)
+{
+  char path[4096];
+  snprintf(path, sizeof(path), "%s/%s", dir, f->name);
+  // Create the directories in the name
+  char* slash;
+  for (slash = strchr(path + strlen(dir) + 1, '/'); slash != NULL; slash = strchr(slash + 1, '/'))
+  {
+    *slash = 0;
+    if (mkdir(path, 0755) && errno != EEXIST)
+    {
+      fprintf(stderr, "%s: %s\n", path, strerror(errno));
+      return -1;
+    }
+    *slash = '/';
+  }
+  FILE* out = fopen(path, "wb");
+  if (out == NULL || fwrite(data, 1, f->size, out) != (size_t)f->size || fclose(out))
+  {
+    fprintf(stderr, "%s: %s\n", path, strerror(errno));
+    return -1;
+  }
+  return 0;
+}
+
+static void _usage()
+{
+  fprintf(stderr, "Usage: mdfs_dump [-j threads] [-x directory] <image> [name...]\n");
+}
+
+int main(int argc, char** argv)
+{
+  static const char* status_text[] = {"OK", "BAD CRC", "NO CRC", "TRUNCATED"};
+  int threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  const char* extract_dir = NULL;
+  int opt;
+  while ((opt = getopt(argc, argv, "j:x:")) != -1)
+  {
+    switch (opt)
+    {
+    case 'j': threads = atoi(optarg); break;
+    case 'x': extract_dir = optarg; break;
+    default: _usage(); return 1;
+    }
+  }
+  if (argc - optind < 1 || (extract_dir == NULL && argc - optind > 1))
+  {
+    _usage();
+    return 1;
+  }
+  if (threads < 1) threads = 1;
+  const char* image = argv[optind];
+
+  int fd = open(image, O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st))
+  {
+    fprintf(stderr, "%s: %s\n", image, strerror(errno));
+    return 1;
+  }
+  if (st.st_size < MDFS_BLOCKSIZE)
+  {
+    fprintf(stderr, "%s: smaller than block 0\n", image);
+    return 1;
+  }
+  const uint8_t* map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (map == MAP_FAILED)
+  {
+    fprintf(stderr, "%s: %s\n", image, strerror(errno));
+    return 1;
+  }
+  close(fd);
+  madvise((void*)map, st.st_size, MADV_SEQUENTIAL);
+  mdfs_t* mdfs = mdfs_init_simple(map);
+  if (mdfs == NULL) return 1;
+
+  int count = mdfs_get_filecount(mdfs);
+  dump_file_t* files = calloc(count > 0 ? count : 1, sizeof(dump_file_t));
+  mdfs_file_t* list = (mdfs_file_t*)mdfs_get_file_list(mdfs);
+  int i;
+  for (i = 0; i < count; ++i)
+  {
+    dump_file_t* f = &files[i];
+    strcpy(f->name, list[i].filename);
+    f->offset = list[i].byte_offset;
+    f->size = list[i].size;
+    f->crc = list[i].crc;
+    if ((uint64_t)f->offset + f->size > (uint64_t)st.st_size) f->status = DUMP_TRUNCATED;
+    else if (f->crc == 0) f->status = DUMP_NO_CRC;
+  }
+
+  dump_job_t job;
+  job.mdfs = mdfs;
+  job.files = files;
+  job.count = count;
+  job.next = 0;
+  pthread_mutex_init(&job.lock, NULL);
+  if (threads > count) threads = count > 0 ? count : 1;
+  pthread_t* tids = malloc(threads * sizeof(pthread_t));
+  for (i = 0; i < threads; ++i) pthread_create(&tids[i], NULL, _worker, &job);
+  for (i = 0; i < threads; ++i) pthread_join(tids[i], NULL);
+  free(tids);
+
+  int result = 0;
+  printf("%5s %10s %10s %10s %-9s %s\n", "index", "offset", "size", "crc", "status", "name");
+  for (i = 0; i < count; ++i)
+  {
+    dump_file_t* f = &files[i];
+    printf("%5i 0x%08X %10i 0x%08X %-9s %s\n", i, f->offset, f->size, f->crc, status_text[f->status], f->name);
+    if (f->status == DUMP_BAD_CRC || f->status == DUMP_TRUNCATED) result = 2;
+  }
+  int list_ok = mdfs_check_file_list_crc(mdfs);
+  printf("file list crc 0x%08X %s\n", mdfs_get_file_list_crc(mdfs), list_ok ? "OK" : "BAD CRC");
+  if (!list_ok) result = 2;
+
+  if (extract_dir != NULL)
+  {
+    if (mkdir(extract_dir, 0755) && errno != EEXIST)
+    {
+      fprintf(stderr, "%s: %s\n", extract_dir, strerror(errno));
+      return 1;
+    }
+    int j;
+    for (j = optind + 1; j < argc; ++j)
+    {
+      for (i = 0; i < count && strcmp(files[i].name, argv[j]); ++i);
+      if (i == count)
+      {
+        fprintf(stderr, "%s: not in image\n", argv[j]);
+        result = 1;
+      }
+    }
+    for (i = 0; i < count; ++i)
+    {
+      dump_file_t* f = &files[i];
+      int wanted = argc - optind == 1;
+      for (j = optind + 1; j < argc && !wanted; ++j) wanted = strcmp(f->name, argv[j]) == 0;
+      if (!wanted) continue;
+      if (f->status == DUMP_TRUNCATED || !_safe_name(f->name))
+      {
+        fprintf(stderr, "%s: not extracted\n", f->name);
+        result = result ? result : 2;
+        continue;
+      }
+      if (_extract(f, extract_dir, mdfs_get_file_location(mdfs, f->offset))) result = 1;
+    }
+  }
+  mdfs_deinit(mdfs);
+  munmap((void*)map, st.st_size);
+  free(files);
+  return result;
+}
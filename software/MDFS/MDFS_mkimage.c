@@ -0,0 +1,296 @@
+/* mdfs_mkimage: build an MDFS image from a directory tree
+
+Usage: mdfs_mkimage [-j threads] [-a align] <directory> <image>
+
+Every regular file below directory becomes a file in the image, named by its
+path relative to directory (e.g. "fonts/small.bin"). Block 0 gets the file
+list with the crc of every file and the list crc, unused space is 0xFF like
+erased flash.
+
+File data is copied with large reads and writes, the crc is computed while
+copying. Files are spread over threads, so big images are bound by disk
+speed.
+*/
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "MDFS.h"
+
+#define MKIMAGE_CHUNK (1024*1024) // Bytes per read/write
+
+typedef struct MkimageFile {
+  char path[4096];
+  char name[MDFS_MAX_FILENAME];
+  int32_t size;
+  uint32_t offset;
+  uint32_t crc;
+} mkimage_file_t;
+
+typedef struct MkimageJob {
+  mkimage_file_t* files;
+  int count;
+  int next; // Next file to copy, protected by lock
+  int out;
+  int failed;
+  pthread_mutex_t lock;
+} mkimage_job_t;
+
+static int _name_cmp(const void* a, const void* b)
+{
+  return strcmp(((const mkimage_file_t*)a)->name, ((const mkimage_file_t*)b)->name);
+}
+
+/* Collect the regular files below dir, prefix is the name so far.
+ * Returns -1 on error, a message is printed.
+ */
+static int _collect(const char* dir, const char* prefix, mkimage_file_t* files, int* count)
+{
+  DIR* d = opendir(dir);
+  if (d == NULL)
+  {
+    fprintf(stderr, "%s: %s\n", dir, strerror(errno));
+    return -1;
+  }
+  struct dirent* e;
+  int result = 0;
+  while (result == 0 && (e = readdir(d)) != NULL)
+  {
+    if (strcmp(e->d_name, ".") == 0 || strcmp(e->d_name, "..") == 0) continue;
+    char path[4096];
+    char name[4096];
+    struct stat st;
+    snprintf(path, sizeof(path), "%s/%s", dir, e->d_name);
+    snprintf(name, sizeof(name), "%s%s", prefix, e->d_name);
+    if (lstat(path, &st))
+    {
+      fprintf(stderr, "%s: %s\n", path, strerror(errno));
+      result = -1;
+    }
+    else if (S_ISDIR(st.st_mode))
+    {
+      strcat(name, "/");
+      result = _collect(path, name, files, count);
+    }
+    else if (!S_ISREG(st.st_mode))
+    {
+      fprintf(stderr, "%s: skipped, not a regular file\n", path);
+    }
+    else if (st.st_size == 0)
+    {
+      fprintf(stderr, "%s: skipped, empty files can't be stored\n", path);
+    }
+    else if (st.st_size > MDFS_MAX_FILESIZE)
+    {
+      fprintf(stderr, "%s: larger than MDFS_MAX_FILESIZE\n", path);
+      result = -1;
+    }
+    else if (strlen(name) >= MDFS_MAX_FILENAME)
+    {
+      fprintf(stderr, "%s: name longer than %i chars\n", name, MDFS_MAX_FILENAME - 1);
+      result = -1;
+    }
+    else if (*count >= MDFS_MAX_FILECOUNT)
+    {
+      fprintf(stderr, "More than %i files\n", (int)MDFS_MAX_FILECOUNT);
+      result = -1;
+    }
+    else
+    {
+      mkimage_file_t* f = &files[(*count)++];
+      strcpy(f->path, path);
+      strcpy(f->name, name);
+      f->size = (int32_t)st.st_size;
+    }
+  }
+  closedir(d);
+  return result;
+}
+
+/* Copy one file into the image, computing its crc on the way */
+static int _copy_file(mkimage_file_t* f, int out, uint8_t* buf)
+{
+  int in = open(f->path, O_RDONLY);
+  if (in < 0)
+  {
+    fprintf(stderr, "%s: %s\n", f->path, strerror(errno));
+    return -1;
+  }
+  mdfs_crc_t crc;
+  mdfs_crc_init(&crc);
+  int32_t done = 0;
+  while (done < f->size)
+  {
+    size_t want = f->size - done < MKIMAGE_CHUNK ? f->size - done : MKIMAGE_CHUNK;
+    ssize_t n = read(in, buf, want);
+    if (n <= 0)
+    {
+      fprintf(stderr, "%s: %s\n", f->path, n < 0 ? strerror(errno) : "shrunk while reading");
+      close(in);
+      return -1;
+    }
+    mdfs_crc_update(&crc, buf, n);
+    if (pwrite(out, buf, n, (off_t)f->offset + done) != n)
+    {
+      fprintf(stderr, "write: %s\n", strerror(errno));
+      close(in);
+      return -1;
+    }
+    done += n;
+  }
+  close(in);
+  f->crc = mdfs_crc_final(&crc);
+  return 0;
+}
+
+static void* _worker(void* arg)
+{
+  mkimage_job_t* job = (mkimage_job_t*)arg;
+  uint8_t* buf = malloc(MKIMAGE_CHUNK);
+  if (buf == NULL)
+  {
+    job->failed = 1;
+    return NULL;
+  }
+  while (1)
+  {
+    pthread_mutex_lock(&job->lock);
+    int i = job->failed ? job->count : job->next++;
+    pthread_mutex_unlock(&job->lock);
+    if (i >= job->count) break;
+    if (_copy_file(&job->files[i], job->out, buf))
+    {
+      pthread_mutex_lock(&job->lock);
+      job->failed = 1;
+      pthread_mutex_unlock(&job->lock);
+    }
+  }
+  free(buf);
+  return NULL;
+}
+
+/* Write 0xFF from start to end */
+static int _fill(int out, uint32_t start, uint32_t end)
+{
+  static uint8_t erased[4096];
+  memset(erased, 0xFF, sizeof(erased));
+  while (start < end)
+  {
+    size_t n = end - start < sizeof(erased) ? end - start : sizeof(erased);
+    if (pwrite(out, erased, n, start) != (ssize_t)n) return -1;
+    start += n;
+  }
+  return 0;
+}
+
+static void _usage()
+{
+  fprintf(stderr, "Usage: mdfs_mkimage [-j threads] [-a align] <directory> <image>\n");
+}
+
+int main(int argc, char** argv)
+{
+  int threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  uint32_t align = MDFS_ALIGN_NONE;
+  int opt;
+  while ((opt = getopt(argc, argv, "j:a:")) != -1)
+  {
+    switch (opt)
+    {
+    case 'j': threads = atoi(optarg); break;
+    case 'a': align = (uint32_t)strtoul(optarg, NULL, 0); break;
+    default: _usage(); return 1;
+    }
+  }
+  if (argc - optind != 2)
+  {
+    _usage();
+    return 1;
+  }
+  if (threads < 1) threads = 1;
+  const char* dir = argv[optind];
+  const char* image = argv[optind + 1];
+
+  mkimage_file_t* files = calloc(MDFS_MAX_FILECOUNT, sizeof(mkimage_file_t));
+  int count = 0;
+  if (files == NULL || _collect(dir, "", files, &count)) return 1;
+  // Same image for the same tree
+  qsort(files, count, sizeof(mkimage_file_t), _name_cmp);
+
+  // Lay out the files with the library, block 0 starts erased
+  uint8_t* block0 = malloc(MDFS_BLOCKSIZE);
+  memset(block0, 0xFF, MDFS_BLOCKSIZE);
+  mdfs_t* mdfs = mdfs_init_simple(block0);
+  if (mdfs == NULL || mdfs_begin_batch(mdfs)) return 1;
+  int i;
+  for (i = 0; i < count; ++i)
+  {
+    files[i].offset = mdfs_add_file_ex(mdfs, files[i].name, files[i].size, align);
+    if (files[i].offset == 0)
+    {
+      fprintf(stderr, "%s: %s\n", files[i].name, mdfs_get_error(mdfs));
+      return 1;
+    }
+  }
+  if (mdfs_commit_batch(mdfs))
+  {
+    fprintf(stderr, "%s\n", mdfs_get_error(mdfs));
+    return 1;
+  }
+
+  int out = open(image, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (out < 0)
+  {
+    fprintf(stderr, "%s: %s\n", image, strerror(errno));
+    return 1;
+  }
+  mkimage_job_t job;
+  job.files = files;
+  job.count = count;
+  job.next = 0;
+  job.out = out;
+  job.failed = 0;
+  pthread_mutex_init(&job.lock, NULL);
+  if (threads > count) threads = count > 0 ? count : 1;
+  pthread_t* tids = malloc(threads * sizeof(pthread_t));
+  for (i = 0; i < threads; ++i) pthread_create(&tids[i], NULL, _worker, &job);
+  for (i = 0; i < threads; ++i) pthread_join(tids[i], NULL);
+  free(tids);
+  if (job.failed) return 1;
+
+  for (i = 0; i < count; ++i) mdfs_set_crc(mdfs, files[i].name, files[i].crc);
+  // Block 0: the list, size 0 and the list crc (set_crc doesn't update it)
+  mdfs_file_t* list = (mdfs_file_t*)mdfs_get_file_list(mdfs);
+  uint32_t n = mdfs_get_filecount(mdfs);
+  memcpy(block0, list, n * sizeof(mdfs_file_t));
+  uint32_t* terminator = (uint32_t*)(block0 + n * sizeof(mdfs_file_t));
+  terminator[0] = 0;
+  terminator[1] = mdfs_calc_crc(block0, n * sizeof(mdfs_file_t));
+
+  // Padding between files is erased flash too
+  uint32_t end = MDFS_BLOCKSIZE;
+  int failed = pwrite(out, block0, MDFS_BLOCKSIZE, 0) != MDFS_BLOCKSIZE;
+  for (i = 0; i < n && !failed; ++i)
+  {
+    if (list[i].byte_offset > end) failed = _fill(out, end, list[i].byte_offset);
+    end = list[i].byte_offset + list[i].size;
+  }
+  if (failed || close(out))
+  {
+    fprintf(stderr, "%s: %s\n", image, strerror(errno));
+    return 1;
+  }
+  printf("%s: %i files, %u bytes\n", image, count, end);
+  mdfs_deinit(mdfs);
+  free(block0);
+  free(files);
+  return 0;
+}
@@ -2,8 +2,13 @@
 #include <string.h>
 #include <stdlib.h>
 #include <ctype.h>
+#include <errno.h>
 
 #include "MDFS.h"
+#if MDFS_THREAD_SAFE
+#include <pthread.h>
+#include <sched.h>
+#endif
 
 int _mdfs_get_file_index(mdfs_t* mdfs, const char* filename);
 
@@ -178,13 +183,461 @@ static int T_mdfs_init_simple_empty_fileblock_expect_0_files()
   return result;
 }
 
+static int T_mdfs_init_static_expect_files_and_no_malloc()
+{
+  printf("T_mdfs_init_static_expect_files_and_no_malloc: ");
+  int result = 0;
+  static uint8_t workspace[MDFS_WORKSPACE_SIZE];
+  const void* fs = fs_factory(0xFF, MDFS_BLOCKSIZE, MDFS_BLOCKSIZE+50, "this is file_A", "this is file_B");
+  if (mdfs_init_static(fs, workspace, MDFS_WORKSPACE_SIZE - 1) != NULL)
+  {
+    printf("FAILED (accepted workspace that's too small)\n");
+    result = -1;
+  }
+  mdfs_t* mdfs = mdfs_init_static(fs, workspace, sizeof(workspace));
+  if (result == 0 && mdfs == NULL)
+  {
+    printf("FAILED (mdfs == NULL)\n");
+    result = -1;
+  }
+  if (result == 0 && ((uint8_t*)mdfs < workspace || (uint8_t*)mdfs_get_file_list(mdfs) + 
+      MDFS_MAX_FILECOUNT * sizeof(mdfs_file_t) + MDFS_EXTRA_CRC_SIZE > workspace + sizeof(workspace)))
+  {
+    printf("FAILED (mdfs or file list outside workspace)\n");
+    result = -1;
+  }
+  if (result == 0 && mdfs_get_filecount(mdfs) != 2)
+  {
+    printf("FAILED (filecount = %i)\n", mdfs_get_filecount(mdfs));
+    result = -1;
+  }
+  // Fill the list, the last one doesn't fit
+  int i;
+  for (i = 2; i < MDFS_MAX_FILECOUNT && result == 0; ++i)
+  {
+    if (mdfs_add_file(mdfs, "plop", 1) < MDFS_BLOCKSIZE)
+    {
+      printf("FAILED (add %i: %s)\n", i, mdfs_get_error(mdfs));
+      result = -1;
+    }
+  }
+  if (result == 0 && mdfs_add_file(mdfs, "plop", 1) >= MDFS_BLOCKSIZE)
+  {
+    printf("FAILED (added beyond MDFS_MAX_FILECOUNT)\n");
+    result = -1;
+  }
+  if (result == 0) printf("OK\n");
+  mdfs_deinit(mdfs);
+  free((void*)fs);
+  return result;
+}
+
+static int T_mdfs_init_static_fopen_pool_exhausted_expect_NULL()
+{
+  printf("T_mdfs_init_static_fopen_pool_exhausted_expect_NULL: ");
+  int result = 0;
+  static uint8_t workspace[MDFS_WORKSPACE_SIZE];
+  const void* fs = fs_factory(0xFF, MDFS_BLOCKSIZE, MDFS_BLOCKSIZE+50, "this is file_A", "this is file_B");
+  mdfs_t* mdfs = mdfs_init_static(fs, workspace, sizeof(workspace));
+  mdfs_FILE* files[MDFS_FILE_POOL_SIZE];
+  int i;
+  for (i = 0; i < MDFS_FILE_POOL_SIZE; ++i)
+  {
+    files[i] = mdfs_fopen(mdfs, "file_A", "r");
+    if (files[i] == NULL)
+    {
+      printf("FAILED (fopen %i: %s)\n", i, mdfs_get_error(mdfs));
+      result = -1;
+    }
+  }
+  mdfs_FILE* f = mdfs_fopen(mdfs, "file_B", "r");
+  if (result == 0 && f != NULL)
+  {
+    printf("FAILED (fopen past pool size = %p)\n", f);
+    result = -1;
+  }
+  mdfs_fclose(files[3]);
+  f = mdfs_fopen(mdfs, "file_B", "r");
+  if (result == 0 && f != files[3])
+  {
+    printf("FAILED (closed handle not reused, %p)\n", f);
+    result = -1;
+  }
+  files[3] = f;
+  for (i = 0; i < MDFS_FILE_POOL_SIZE; ++i) if (files[i] != NULL) mdfs_fclose(files[i]);
+  if (result == 0) printf("OK\n");
+  mdfs_deinit(mdfs);
+  free((void*)fs);
+  return result;
+}
+
+static int T_mdfs_init_direct_terminated_list_expect_no_copy()
+{
+  printf("T_mdfs_init_direct_terminated_list_expect_no_copy: ");
+  int result = 0;
+  // 0x00 fill: the entry after file_B has size 0, like the builder writes it
+  const void* fs = fs_factory(0x00, MDFS_BLOCKSIZE, MDFS_BLOCKSIZE+50, "this is file_A", "this is file_B");
+  uint8_t* block0 = malloc(MDFS_BLOCKSIZE);
+  memcpy(block0, fs, MDFS_BLOCKSIZE);
+  mdfs_t* mdfs = mdfs_init_direct(fs);
+  if (mdfs_get_file_list(mdfs) != fs || mdfs_get_filecount(mdfs) != 2)
+  {
+    printf("FAILED (list %p, fs %p, filecount %i)\n", mdfs_get_file_list(mdfs), fs, mdfs_get_filecount(mdfs));
+    result = -1;
+  }
+  if (result == 0 && mdfs_check_file_list_crc(mdfs) != 1)
+  {
+    printf("FAILED (file list crc)\n");
+    result = -1;
+  }
+  mdfs_FILE* f = mdfs_fopen(mdfs, "file_B", "r");
+  char buf[32] = {0};
+  if (result == 0 && (f == NULL || mdfs_fread(buf, 1, sizeof(buf), f) != 14 || strcmp(buf, "this is file_B")))
+  {
+    printf("FAILED (read file_B: \"%s\")\n", buf);
+    result = -1;
+  }
+  if (f != NULL) mdfs_fclose(f);
+  // First change copies the list, block 0 stays untouched
+  if (result == 0 && (mdfs_add_file(mdfs, "file_C", 10) < MDFS_BLOCKSIZE || 
+      mdfs_get_file_list(mdfs) == fs || mdfs_get_filecount(mdfs) != 3))
+  {
+    printf("FAILED (add after direct: %s)\n", mdfs_get_error(mdfs));
+    result = -1;
+  }
+  if (result == 0 && (mdfs_remove_file(mdfs, "file_A") != 1 || mdfs_check_file_list_crc(mdfs) != 1))
+  {
+    printf("FAILED (remove after direct)\n");
+    result = -1;
+  }
+  if (result == 0 && memcmp(block0, fs, MDFS_BLOCKSIZE))
+  {
+    printf("FAILED (block 0 was written)\n");
+    result = -1;
+  }
+  if (result == 0) printf("OK\n");
+  mdfs_deinit(mdfs);
+  free(block0);
+  free((void*)fs);
+  return result;
+}
+
+static int T_mdfs_init_direct_unterminated_list_expect_copy()
+{
+  printf("T_mdfs_init_direct_unterminated_list_expect_copy: ");
+  int result = 0;
+  // 0xFF fill: no size 0 after the last file, so the list is copied
+  const void* fs = fs_factory(0xFF, MDFS_BLOCKSIZE, MDFS_BLOCKSIZE+50, "this is file_A", "this is file_B");
+  mdfs_t* mdfs = mdfs_init_direct(fs);
+  if (mdfs_get_file_list(mdfs) == fs || mdfs_get_filecount(mdfs) != 2)
+  {
+    printf("FAILED (list %p, fs %p, filecount %i)\n", mdfs_get_file_list(mdfs), fs, mdfs_get_filecount(mdfs));
+    result = -1;
+  }
+  mdfs_FILE* f = mdfs_fopen(mdfs, "file_B", "r");
+  if (result == 0 && f == NULL)
+  {
+    printf("FAILED (file_B not found)\n");
+    result = -1;
+  }
+  if (f != NULL) mdfs_fclose(f);
+  if (result == 0) printf("OK\n");
+  mdfs_deinit(mdfs);
+  free((void*)fs);
+  return result;
+}
+
+#if MDFS_USE_MMAP
+/* Write the first size bytes of fs to a file */
+static void _write_image(const char* path, const void* fs, size_t size)
+{
+  FILE* f = fopen(path, "wb");
+  fwrite(fs, 1, size, f);
+  fclose(f);
+}
+
+static int T_mdfs_open_image_expect_mapped_files()
+{
+  printf("T_mdfs_open_image_expect_mapped_files: ");
+  int result = 0;
+  const char* path = "T_mdfs_open_image.bin";
+  const void* fs = fs_factory(0x00, MDFS_BLOCKSIZE, MDFS_BLOCKSIZE+50, "this is file_A", "this is file_B");
+  _write_image(path, fs, 3*MDFS_BLOCKSIZE);
+  mdfs_t* mdfs = mdfs_open_image(path);
+  if (mdfs == NULL || mdfs_get_filecount(mdfs) != 2 || mdfs_get_file_list(mdfs) != mdfs->target)
+  {
+    printf("FAILED (mdfs %p, not direct or filecount != 2)\n", mdfs);
+    result = -1;
+  }
+  char buf[32] = {0};
+  mdfs_FILE* f = result ? NULL : mdfs_fopen(mdfs, "file_B", "r");
+  if (result == 0 && (f == NULL || mdfs_fread(buf, 1, sizeof(buf), f) != 14 || strcmp(buf, "this is file_B")))
+  {
+    printf("FAILED (read \"%s\")\n", buf);
+    result = -1;
+  }
+  if (f != NULL) mdfs_fclose(f);
+  if (result == 0 && mdfs_verify_all(mdfs, 2, NULL) != 0)
+  {
+    printf("FAILED (verify_all)\n");
+    result = -1;
+  }
+  // Only in the list, not in the image file
+  if (result == 0 && (mdfs_add_file(mdfs, "new", 3*MDFS_BLOCKSIZE) == 0 || mdfs_fopen(mdfs, "new", "r") != NULL || errno != ENXIO))
+  {
+    printf("FAILED (opened file outside image)\n");
+    result = -1;
+  }
+  if (mdfs != NULL) mdfs_deinit(mdfs);
+  if (result == 0 && (mdfs_open_image("no such image") != NULL || errno != ENOENT))
+  {
+    printf("FAILED (opened missing image)\n");
+    result = -1;
+  }
+  if (result == 0) printf("OK\n");
+  remove(path);
+  free((void*)fs);
+  return result;
+}
+
+static int T_mdfs_open_image_truncated_expect_file_left_out()
+{
+  printf("T_mdfs_open_image_truncated_expect_file_left_out: ");
+  int result = 0;
+  const char* path = "T_mdfs_open_image.bin";
+  const void* fs = fs_factory(0xFF, MDFS_BLOCKSIZE, MDFS_BLOCKSIZE+50, "this is file_A", "this is file_B");
+  // file_B ends at MDFS_BLOCKSIZE+64
+  _write_image(path, fs, MDFS_BLOCKSIZE + 60);
+  mdfs_t* mdfs = mdfs_open_image(path);
+  mdfs_FILE* f = mdfs ? mdfs_fopen(mdfs, "file_B", "r") : NULL;
+  if (mdfs == NULL || mdfs_get_filecount(mdfs) != 1 || f != NULL)
+  {
+    printf("FAILED (file_B still there)\n");
+    result = -1;
+  }
+  if (result == 0) printf("OK\n");
+  if (mdfs != NULL) mdfs_deinit(mdfs);
+  remove(path);
+  free((void*)fs);
+  return result;
+}
+#endif
+
+/* Stand-in for a block device: reads come from a file */
+typedef struct TestDevice {
+  FILE* file;
+  int reads; ///< Number of calls
+  int fail; ///< Fail every read when set
+  int busy; ///< Calls in progress
+  int overlaps; ///< Calls that started while another was in progress
+} t_device_t;
+
+static int _t_device_read(void* ctx, uint32_t offset, uint32_t size, void* buf)
+{
+  t_device_t* dev = (t_device_t*)ctx;
+  if (__atomic_fetch_add(&dev->busy, 1, __ATOMIC_SEQ_CST)) __atomic_fetch_add(&dev->overlaps, 1, __ATOMIC_SEQ_CST);
+  dev->reads++;
+#if MDFS_THREAD_SAFE
+  sched_yield(); // Give other threads a chance to call in at the same time
+#endif
+  int result = -1;
+  if (!dev->fail && fseek(dev->file, offset, SEEK_SET) == 0)
+  {
+    size_t n = fread(buf, 1, size, dev->file);
+    memset((uint8_t*)buf + n, 0xFF, size - n); // Erased flash after the end
+    result = 0;
+  }
+  __atomic_fetch_sub(&dev->busy, 1, __ATOMIC_SEQ_CST);
+  return result;
+}
+
+/* Put the first size bytes of fs in a temporary file behind dev */
+static void _t_device_open(t_device_t* dev, mdfs_device_t* device, const void* fs, size_t size)
+{
+  dev->file = tmpfile();
+  fwrite(fs, 1, size, dev->file);
+  dev->reads = 0;
+  dev->fail = 0;
+  dev->busy = 0;
+  dev->overlaps = 0;
+  memset((void*)device, 0, sizeof(mdfs_device_t));
+  device->read = _t_device_read;
+  device->ctx = dev;
+  device->size = size;
+  device->cache_block = 4096;
+  device->cache_blocks = 4;
+}
+
+static int T_mdfs_init_ex_file_device_expect_files()
+{
+  printf("T_mdfs_init_ex_file_device_expect_files: ");
+  int result = 0;
+  const void* fs = fs_factory(0xFF, MDFS_BLOCKSIZE, MDFS_BLOCKSIZE+50, "this is file_A", "this is file_B");
+  t_device_t dev;
+  mdfs_device_t device;
+  _t_device_open(&dev, &device, fs, 3*MDFS_BLOCKSIZE);
+  mdfs_t* mdfs = mdfs_init_ex(&device);
+  if (mdfs == NULL || mdfs_get_filecount(mdfs) != 2 || mdfs_check_file_list_crc(mdfs) != 1)
+  {
+    printf("FAILED (mdfs %p, filecount or list crc)\n", mdfs);
+    result = -1;
+  }
+  char buf[32] = {0};
+  mdfs_FILE* f = result ? NULL : mdfs_fopen(mdfs, "file_B", "rv");
+  if (result == 0 && (f == NULL || mdfs_fread(buf, 1, 8, f) != 8 || mdfs_fgetc(f) != 'f'))
+  {
+    printf("FAILED (read \"%s\")\n", buf);
+    result = -1;
+  }
+  // fclose verifies the rest, all from the cache
+  int reads = dev.reads;
+  mdfs_view_t view = result ? (mdfs_view_t){NULL, 0} : mdfs_fpeek(f, 100);
+  if (result == 0 && (view.size != 5 || memcmp(view.data, "ile_B", 5) || mdfs_fclose(f) != 0 || dev.reads != reads))
+  {
+    printf("FAILED (view %u bytes, device reads %i -> %i)\n", view.size, reads, dev.reads);
+    result = -1;
+  }
+  f = result ? NULL : mdfs_fopen(mdfs, "file_A", "r");
+  if (result == 0 && (f == NULL || mdfs_check_crc(f) != 1 || mdfs_get_open_file_location(f) != NULL))
+  {
+    printf("FAILED (check_crc)\n");
+    result = -1;
+  }
+  if (f != NULL) mdfs_fclose(f);
+  if (result == 0 && mdfs_verify_all(mdfs, 2, NULL) != 0)
+  {
+    printf("FAILED (verify_all)\n");
+    result = -1;
+  }
+  if (mdfs != NULL) mdfs_deinit(mdfs);
+  // Block 0 can't be read
+  dev.fail = 1;
+  if (result == 0 && (mdfs_init_ex(&device) != NULL || errno != EIO))
+  {
+    printf("FAILED (init with failing device)\n");
+    result = -1;
+  }
+  if (result == 0) printf("OK\n");
+  fclose(dev.file);
+  free((void*)fs);
+  return result;
+}
+
+static int T_mdfs_init_ex_cache_lru_expect_oldest_evicted()
+{
+  printf("T_mdfs_init_ex_cache_lru_expect_oldest_evicted: ");
+  int result = 0;
+  // file_A and file_B in different 4 KB blocks, file_C in a third
+  const void* fs = fs_factory(0xFF, MDFS_BLOCKSIZE, MDFS_BLOCKSIZE+8192, "this is file_A", "this is file_B");
+  t_device_t dev;
+  mdfs_device_t device;
+  _t_device_open(&dev, &device, fs, 3*MDFS_BLOCKSIZE);
+  device.cache_blocks = 2;
+  mdfs_t* mdfs = mdfs_init_ex(&device);
+  mdfs_add_file_ex(mdfs, "file_C", 10, MDFS_ALIGN_PAGE);
+  static const char* order[] = {"file_A", "file_B", "file_A", "file_C", "file_A", "file_B"};
+  static const int misses[] = {1, 1, 0, 1, 0, 1}; // C replaces B, not A
+  char buf[16];
+  int i;
+  for (i = 0; i < 6 && result == 0; ++i)
+  {
+    int reads = dev.reads;
+    mdfs_FILE* f = mdfs_fopen(mdfs, order[i], "r");
+    mdfs_fread(buf, 1, sizeof(buf), f);
+    mdfs_fclose(f);
+    if (dev.reads - reads != misses[i])
+    {
+      printf("FAILED (read %i of %s: %i device reads)\n", i, order[i], dev.reads - reads);
+      result = -1;
+    }
+  }
+  // An uncached block fails to read
+  dev.fail = 1;
+  mdfs_FILE* f = mdfs_fopen(mdfs, "file_C", "r");
+  if (result == 0 && (mdfs_fread(buf, 1, sizeof(buf), f) != 0 || !mdfs_ferror(f) || errno != EIO))
+  {
+    printf("FAILED (read error not reported)\n");
+    result = -1;
+  }
+  mdfs_fclose(f);
+  if (result == 0) printf("OK\n");
+  mdfs_deinit(mdfs);
+  fclose(dev.file);
+  free((void*)fs);
+  return result;
+}
+
+#if MDFS_THREAD_SAFE
+static void* _t_device_reader(void* arg)
+{
+  mdfs_t* mdfs = (mdfs_t*)arg;
+  char buf[32];
+  int i;
+  for (i = 0; i < 500; ++i)
+  {
+    mdfs_FILE* f = mdfs_fopen(mdfs, "file_B", "r");
+    if (f == NULL) return (void*)1;
+    memset(buf, 0, sizeof(buf));
+    mdfs_fread(buf, 1, sizeof(buf), f);
+    mdfs_fclose(f);
+    if (strcmp(buf, "this is file_B")) return (void*)1;
+  }
+  return NULL;
+}
+
+/* Without a cache every read goes to the device, from all threads */
+static int T_mdfs_init_ex_no_cache_threads_expect_one_read_at_a_time()
+{
+  printf("T_mdfs_init_ex_no_cache_threads_expect_one_read_at_a_time: ");
+  int result = 0;
+  const void* fs = fs_factory(0xFF, MDFS_BLOCKSIZE, MDFS_BLOCKSIZE+50, "this is file_A", "this is file_B");
+  t_device_t dev;
+  mdfs_device_t device;
+  _t_device_open(&dev, &device, fs, 3*MDFS_BLOCKSIZE);
+  device.cache_blocks = 0;
+  mdfs_t* mdfs = mdfs_init_ex(&device);
+  pthread_t readers[4];
+  int i;
+  for (i = 0; i < 4; ++i) pthread_create(&readers[i], NULL, _t_device_reader, mdfs);
+  for (i = 0; i < 4; ++i)
+  {
+    void* failed;
+    pthread_join(readers[i], &failed);
+    if (failed != NULL) result = -1;
+  }
+  if (result != 0 || dev.overlaps != 0)
+  {
+    printf("FAILED (%i overlapping device reads)\n", dev.overlaps);
+    result = -1;
+  }
+  else printf("OK\n");
+  mdfs_deinit(mdfs);
+  fclose(dev.file);
+  free((void*)fs);
+  return result;
+}
+#endif
+
 int T_mdfs_init_simple()
 {
   return
     T_mdfs_init_simple_empty_fileblock_expect_0_files() |
     T_mdfs_init_simple_init_0xFF_expect_filecount_2() |
     T_mdfs_init_simple_init_0x00_expect_filecount_2() |
-    T_mdfs_init_simple_init_0x01_expect_filecount_2();
+    T_mdfs_init_simple_init_0x01_expect_filecount_2() |
+    T_mdfs_init_static_expect_files_and_no_malloc() |
+    T_mdfs_init_static_fopen_pool_exhausted_expect_NULL() |
+    T_mdfs_init_direct_terminated_list_expect_no_copy() |
+    T_mdfs_init_ex_file_device_expect_files() |
+    T_mdfs_init_ex_cache_lru_expect_oldest_evicted() |
+#if MDFS_THREAD_SAFE
+    T_mdfs_init_ex_no_cache_threads_expect_one_read_at_a_time() |
+#endif
+#if MDFS_USE_MMAP
+    T_mdfs_open_image_expect_mapped_files() |
+    T_mdfs_open_image_truncated_expect_file_left_out() |
+#endif
+    T_mdfs_init_direct_unterminated_list_expect_copy();
 }
 
 // --------------------------------------------------------------------
@@ -233,7 +686,7 @@ static int T_mdfs_fopen_existing_expect_ptr()
   if (f == NULL) 
   {
     printf("FAILED (fopen('file_A') = %p)\n", f);
-    printf("%s\n", mdfs->error);
+    printf("%s\n", mdfs_get_error(mdfs));
     test_result = -1;
   }
   mdfs_fclose(f);
@@ -251,66 +704,203 @@ static int T_mdfs_fopen_existing_expect_ptr()
   return test_result;
 }
 
-int T_mdfs_fopen()
-{
-  return
-    T_mdfs_fopen_non_existing_expect_NULL() |
-    T_mdfs_fopen_existing_expect_ptr();
-}
-
-// --------------------------------------------------------------------
-// mdfs_add_file
-// --------------------------------------------------------------------
-int T_mdfs_add_file_size_0_expect_error()
+/* Handles come from the pool and are reused, past the pool malloc takes over */
+static int T_mdfs_fopen_pool_reuse_expect_same_handle()
 {
-  printf("T_mdfs_add_file_size_0_expect_error: ");
-  int result = -1;
+  printf("T_mdfs_fopen_pool_reuse_expect_same_handle: ");
+  int test_result = 0;
   const void* fs = fs_factory(0xFF, MDFS_BLOCKSIZE, MDFS_BLOCKSIZE+50, "This is file A", "this is file B");
   mdfs_t* mdfs = mdfs_init_simple(fs);
-  uint32_t offset = mdfs_add_file(mdfs, "test0", 0);
-  printf("offset = 0x%08X ", offset);
-  if (offset < MDFS_BLOCKSIZE)
+  mdfs_FILE* first = mdfs_fopen(mdfs, "file_A", "r");
+  mdfs_fclose(first);
+  int i;
+  for (i = 0; i < 1000 && test_result == 0; ++i)
   {
-    printf(" OK\n");
-    result = 0;
+    mdfs_FILE* f = mdfs_fopen(mdfs, (i & 1) ? "file_A" : "file_B", "r");
+    if (f != first)
+    {
+      printf("FAILED (handle %p != %p)\n", f, first);
+      test_result = -1;
+    }
+    mdfs_fclose(f);
   }
-  else
+  mdfs_FILE* files[MDFS_FILE_POOL_SIZE + 2];
+  for (i = 0; i < MDFS_FILE_POOL_SIZE + 2; ++i)
   {
-    printf("FAILED\n");
-    result = -1;
+    files[i] = mdfs_fopen(mdfs, "file_B", "r");
+    if (test_result == 0 && files[i] == NULL)
+    {
+      printf("FAILED (fopen %i past pool size: %s)\n", i, mdfs_get_error(mdfs));
+      test_result = -1;
+    }
   }
+  for (i = 0; i < MDFS_FILE_POOL_SIZE + 2; ++i) if (files[i] != NULL) mdfs_fclose(files[i]);
+  if (test_result == 0) printf("OK\n");
   mdfs_deinit(mdfs);
   free((void*)fs);
-  return result;
+  return test_result;
 }
 
-int T_mdfs_add_file_negative_size_expect_error()
+/* freopen with NULL filename finds the file after the list changed */
+static int T_mdfs_freopen_null_name_after_list_change_expect_same_file()
 {
-  int result = -1;
+  printf("T_mdfs_freopen_null_name_after_list_change_expect_same_file: ");
+  int test_result = 0;
   const void* fs = fs_factory(0xFF, MDFS_BLOCKSIZE, MDFS_BLOCKSIZE+50, "This is file A", "this is file B");
   mdfs_t* mdfs = mdfs_init_simple(fs);
-  uint32_t offset = mdfs_add_file(mdfs, "test0", -1);
-  printf("T_mdfs_add_file_negative_size_expect_error: offset = 0x%08X ", offset);
-  if (offset < MDFS_BLOCKSIZE)
+  mdfs_FILE* a = mdfs_fopen(mdfs, "file_A", "r");
+  mdfs_FILE* b = mdfs_fopen(mdfs, "file_B", "r");
+  mdfs_fgetc(b);
+  mdfs_remove_file(mdfs, "file_A"); // file_B moves to index 0
+  const char* name = mdfs_get_open_filename(b);
+  if (name == NULL || strcmp(name, "file_B") != 0)
+  {
+    printf("FAILED (name = %s)\n", name ? name : "NULL");
+    test_result = -1;
+  }
+  b = mdfs_freopen(mdfs, NULL, "r", b);
+  if (test_result == 0 && (b == NULL || b->index != 0 || b->offset != 0 || mdfs_fgetc(b) != 't'))
   {
-    printf(" OK\n");
-    result = 0;
+    printf("FAILED (freopen = %p)\n", b);
+    test_result = -1;
   }
-  else
+  if (test_result == 0 && mdfs_freopen(mdfs, NULL, "r", a) != NULL)
   {
-    printf("FAILED\n");
-    result = -1;
+    printf("FAILED (freopen of removed file succeeded)\n");
+    test_result = -1;
   }
+  if (b != NULL) mdfs_fclose(b);
+  if (test_result == 0) printf("OK\n");
   mdfs_deinit(mdfs);
   free((void*)fs);
-  return result;
+  return test_result;
 }
 
-int T_mdfs_add_file_unprintable_name_expect_error()
+#if MDFS_THREAD_SAFE
+#define T_THREADS_READERS (4)
+#define T_THREADS_ROUNDS (2000)
+
+static void* _t_reader(void* arg)
 {
-  int result = -1;
-  const void* fs = fs_factory(0xFF, MDFS_BLOCKSIZE, MDFS_BLOCKSIZE+50, "This is file A", "this is file B");
-  mdfs_t* mdfs = mdfs_init_simple(fs);
+  mdfs_t* mdfs = (mdfs_t*)arg;
+  char buf[32];
+  int i;
+  for (i = 0; i < T_THREADS_ROUNDS; ++i)
+  {
+    mdfs_FILE* f = mdfs_fopen(mdfs, "file_A", "r");
+    memset(buf, 0, sizeof(buf));
+    if (f == NULL) return (void*)1;
+    mdfs_fread(buf, 1, sizeof(buf), f);
+    mdfs_fclose(f);
+    if (strcmp(buf, "This is file A")) return (void*)1;
+    if (mdfs_fopen(mdfs, "missing", "r") != NULL) return (void*)1;
+  }
+  return NULL;
+}
+
+/* Readers open and read while the list is changed, errors stay per thread */
+static int T_mdfs_fopen_threads_while_changing_list_expect_consistent()
+{
+  printf("T_mdfs_fopen_threads_while_changing_list_expect_consistent: ");
+  int result = 0;
+  const void* fs = fs_factory(0xFF, MDFS_BLOCKSIZE, MDFS_BLOCKSIZE+50, "This is file A", "this is file B");
+  mdfs_t* mdfs = mdfs_init_simple(fs);
+  mdfs_add_file(mdfs, "", 1); // Invalid name, error of this thread
+  pthread_t readers[T_THREADS_READERS];
+  int i;
+  for (i = 0; i < T_THREADS_READERS; ++i) pthread_create(&readers[i], NULL, _t_reader, mdfs);
+  char name[MDFS_MAX_FILENAME];
+  for (i = 0; i < 200; ++i)
+  {
+    // Grows file_list past its first capacity, so it's realloc'ed too
+    sprintf(name, "tmp_%i", i);
+    mdfs_add_file(mdfs, name, 100);
+    if (i % 3 == 0) mdfs_remove_file(mdfs, name);
+  }
+  for (i = 0; i < T_THREADS_READERS; ++i)
+  {
+    void* failed;
+    pthread_join(readers[i], &failed);
+    if (failed != NULL) result = -1;
+  }
+  if (result != 0) printf("FAILED (reader saw a bad list)\n");
+  if (result == 0 && strcmp(mdfs_get_error(mdfs), "Invalid name"))
+  {
+    printf("FAILED (error = \"%s\")\n", mdfs_get_error(mdfs));
+    result = -1;
+  }
+  if (result == 0) printf("OK\n");
+  mdfs_deinit(mdfs);
+  free((void*)fs);
+  return result;
+}
+#endif
+
+int T_mdfs_fopen()
+{
+  return
+    T_mdfs_fopen_non_existing_expect_NULL() |
+    T_mdfs_fopen_existing_expect_ptr() |
+    T_mdfs_fopen_pool_reuse_expect_same_handle() |
+#if MDFS_THREAD_SAFE
+    T_mdfs_fopen_threads_while_changing_list_expect_consistent() |
+#endif
+    T_mdfs_freopen_null_name_after_list_change_expect_same_file();
+}
+
+// --------------------------------------------------------------------
+// mdfs_add_file
+// --------------------------------------------------------------------
+int T_mdfs_add_file_size_0_expect_error()
+{
+  printf("T_mdfs_add_file_size_0_expect_error: ");
+  int result = -1;
+  const void* fs = fs_factory(0xFF, MDFS_BLOCKSIZE, MDFS_BLOCKSIZE+50, "This is file A", "this is file B");
+  mdfs_t* mdfs = mdfs_init_simple(fs);
+  uint32_t offset = mdfs_add_file(mdfs, "test0", 0);
+  printf("offset = 0x%08X ", offset);
+  if (offset < MDFS_BLOCKSIZE)
+  {
+    printf(" OK\n");
+    result = 0;
+  }
+  else
+  {
+    printf("FAILED\n");
+    result = -1;
+  }
+  mdfs_deinit(mdfs);
+  free((void*)fs);
+  return result;
+}
+
+int T_mdfs_add_file_negative_size_expect_error()
+{
+  int result = -1;
+  const void* fs = fs_factory(0xFF, MDFS_BLOCKSIZE, MDFS_BLOCKSIZE+50, "This is file A", "this is file B");
+  mdfs_t* mdfs = mdfs_init_simple(fs);
+  uint32_t offset = mdfs_add_file(mdfs, "test0", -1);
+  printf("T_mdfs_add_file_negative_size_expect_error: offset = 0x%08X ", offset);
+  if (offset < MDFS_BLOCKSIZE)
+  {
+    printf(" OK\n");
+    result = 0;
+  }
+  else
+  {
+    printf("FAILED\n");
+    result = -1;
+  }
+  mdfs_deinit(mdfs);
+  free((void*)fs);
+  return result;
+}
+
+int T_mdfs_add_file_unprintable_name_expect_error()
+{
+  int result = -1;
+  const void* fs = fs_factory(0xFF, MDFS_BLOCKSIZE, MDFS_BLOCKSIZE+50, "This is file A", "this is file B");
+  mdfs_t* mdfs = mdfs_init_simple(fs);
   char name[3] = {11, 21, 0}; // everything under 33 is unprintable
   uint32_t offset = mdfs_add_file(mdfs, name, 10);
   printf("T_mdfs_add_file_unprintable_name_expect_error: offset = 0x%08X ", offset);
@@ -446,6 +1036,164 @@ int T_mdfs_add_file_to_full_list_expect_error()
   return result;
 }
 
+/* Files a(100) b(10) c(50) d(10) e(10) from MDFS_BLOCKSIZE, a and c removed */
+static mdfs_t* _mdfs_with_gaps(const void* fs)
+{
+  mdfs_t* mdfs = mdfs_init_simple(fs);
+  mdfs_add_file(mdfs, "a", 100);
+  mdfs_add_file(mdfs, "b", 10);
+  mdfs_add_file(mdfs, "c", 50);
+  mdfs_add_file(mdfs, "d", 10);
+  mdfs_add_file(mdfs, "e", 10);
+  mdfs_remove_file(mdfs, "a");
+  mdfs_remove_file(mdfs, "c");
+  return mdfs;
+}
+
+int T_mdfs_add_file_exact_fit_expect_gap_used()
+{
+  printf("T_mdfs_add_file_exact_fit_expect_gap_used: ");
+  int result = 0;
+  // file_A is 14 bytes, so there's 36 bytes before file_B
+  const void* fs = fs_factory(0xFF, MDFS_BLOCKSIZE, MDFS_BLOCKSIZE+50, "this is file_A", "this is file_B");
+  mdfs_t* mdfs = mdfs_init_simple(fs);
+  uint32_t offset = mdfs_add_file(mdfs, "plop", 36);
+  if (offset != MDFS_BLOCKSIZE + 14)
+  {
+    printf("FAILED (offset = 0x%08X)\n", offset);
+    result = -1;
+  }
+  if (result == 0 && mdfs_get_file_offset(mdfs, 1) != offset)
+  {
+    printf("FAILED (not inserted at index 1)\n");
+    result = -1;
+  }
+  if (result == 0) printf("OK\n");
+  mdfs_deinit(mdfs);
+  free((void*)fs);
+  return result;
+}
+
+int T_mdfs_add_file_policies_expect_gap_per_policy()
+{
+  printf("T_mdfs_add_file_policies_expect_gap_per_policy: ");
+  int result = 0;
+  const void* fs = fs_empty(0xFF);
+  // Gaps: 100 bytes at 0, 50 bytes at 110 (relative to MDFS_BLOCKSIZE)
+  mdfs_t* mdfs = _mdfs_with_gaps(fs);
+  mdfs_t* first = _mdfs_with_gaps(fs);
+  uint32_t offset = mdfs_add_file(first, "f", 40);
+  if (offset != MDFS_BLOCKSIZE)
+  {
+    printf("FAILED (first fit offset = %u)\n", offset - MDFS_BLOCKSIZE);
+    result = -1;
+  }
+  mdfs_set_alloc_policy(mdfs, MDFS_ALLOC_BEST_FIT);
+  offset = mdfs_add_file(mdfs, "f", 40);
+  if (result == 0 && offset != MDFS_BLOCKSIZE + 110)
+  {
+    printf("FAILED (best fit offset = %u)\n", offset - MDFS_BLOCKSIZE);
+    result = -1;
+  }
+  // 10 bytes left at 150, next fit continues there instead of at 0
+  mdfs_set_alloc_policy(mdfs, MDFS_ALLOC_NEXT_FIT);
+  offset = mdfs_add_file(mdfs, "n", 5);
+  if (result == 0 && offset != MDFS_BLOCKSIZE + 150)
+  {
+    printf("FAILED (next fit offset = %u)\n", offset - MDFS_BLOCKSIZE);
+    result = -1;
+  }
+  // Nothing fits 200 bytes, goes after e
+  offset = mdfs_add_file(mdfs, "big", 200);
+  if (result == 0 && offset != MDFS_BLOCKSIZE + 180)
+  {
+    printf("FAILED (end offset = %u)\n", offset - MDFS_BLOCKSIZE);
+    result = -1;
+  }
+  if (result == 0 && mdfs_set_alloc_policy(mdfs, 42) != -1)
+  {
+    printf("FAILED (accepted unknown policy)\n");
+    result = -1;
+  }
+  if (result == 0) printf("OK\n");
+  mdfs_deinit(first);
+  mdfs_deinit(mdfs);
+  free((void*)fs);
+  return result;
+}
+
+int T_mdfs_get_free_stats_expect_gaps()
+{
+  printf("T_mdfs_get_free_stats_expect_gaps: ");
+  int result = 0;
+  const void* fs = fs_empty(0xFF);
+  mdfs_t* mdfs = _mdfs_with_gaps(fs);
+  mdfs_free_stats_t stats;
+  mdfs_get_free_stats(mdfs, &stats);
+  if (stats.gap_count != 2 || stats.gap_bytes != 150 || stats.largest_gap != 100 ||
+      stats.end_offset != MDFS_BLOCKSIZE + 180 || stats.fragmentation != 34)
+  {
+    printf("FAILED (count %u, bytes %u, largest %u, end %u, frag %u)\n", stats.gap_count, 
+      stats.gap_bytes, stats.largest_gap, stats.end_offset, stats.fragmentation);
+    result = -1;
+  }
+  // Filling both gaps leaves none
+  mdfs_add_file(mdfs, "a", 100);
+  mdfs_add_file(mdfs, "c", 50);
+  mdfs_get_free_stats(mdfs, &stats);
+  if (result == 0 && (stats.gap_count != 0 || stats.fragmentation != 0 || stats.end_offset != MDFS_BLOCKSIZE + 180))
+  {
+    printf("FAILED (after fill: count %u, end %u)\n", stats.gap_count, stats.end_offset);
+    result = -1;
+  }
+  if (result == 0) printf("OK\n");
+  mdfs_deinit(mdfs);
+  free((void*)fs);
+  return result;
+}
+
+int T_mdfs_add_file_ex_block_aligned_expect_padding_reused()
+{
+  printf("T_mdfs_add_file_ex_block_aligned_expect_padding_reused: ");
+  int result = 0;
+  // file_B ends at MDFS_BLOCKSIZE+64
+  const void* fs = fs_factory(0xFF, MDFS_BLOCKSIZE, MDFS_BLOCKSIZE+50, "this is file_A", "this is file_B");
+  mdfs_t* mdfs = mdfs_init_simple(fs);
+  uint32_t offset = mdfs_add_file_ex(mdfs, "block", 100, MDFS_ALIGN_BLOCK);
+  if (offset != 2*MDFS_BLOCKSIZE)
+  {
+    printf("FAILED (block aligned offset = 0x%08X)\n", offset);
+    result = -1;
+  }
+  offset = mdfs_add_file_ex(mdfs, "page", 100, MDFS_ALIGN_PAGE);
+  if (result == 0 && offset != MDFS_BLOCKSIZE + MDFS_ALIGN_PAGE)
+  {
+    printf("FAILED (page aligned offset = 0x%08X)\n", offset);
+    result = -1;
+  }
+  // The padding in front of the aligned files is still free
+  offset = mdfs_add_file(mdfs, "packed", 1000);
+  if (result == 0 && offset != MDFS_BLOCKSIZE + 64)
+  {
+    printf("FAILED (packed offset = 0x%08X)\n", offset);
+    result = -1;
+  }
+  if (result == 0 && mdfs_add_file_ex(mdfs, "odd", 10, 3) != 0)
+  {
+    printf("FAILED (accepted alignment 3)\n");
+    result = -1;
+  }
+  if (result == 0 && mdfs_get_filecount(mdfs) != 5)
+  {
+    printf("FAILED (filecount = %i)\n", mdfs_get_filecount(mdfs));
+    result = -1;
+  }
+  if (result == 0) printf("OK\n");
+  mdfs_deinit(mdfs);
+  free((void*)fs);
+  return result;
+}
+
 int T_mdfs_add_file()
 {
   return 
@@ -455,7 +1203,11 @@ int T_mdfs_add_file()
   T_mdfs_add_file_namelen_0_expect_error() |
   T_mdfs_add_file_long_name_expect_error() |
   T_mdfs_add_file_to_empty_list_expect_success() |
-  T_mdfs_add_file_to_full_list_expect_error();
+  T_mdfs_add_file_to_full_list_expect_error() |
+  T_mdfs_add_file_exact_fit_expect_gap_used() |
+  T_mdfs_add_file_policies_expect_gap_per_policy() |
+  T_mdfs_get_free_stats_expect_gaps() |
+  T_mdfs_add_file_ex_block_aligned_expect_padding_reused();
 }
 
 // --------------------------------------------------------------------
@@ -623,6 +1375,32 @@ int T_mdfs_remove_and_add()
   return result;
 }
 
+int T_mdfs_remove_file_expect_no_realloc()
+{
+  // Capacity is kept after a remove, adding the file back doesn't realloc
+  printf("T_mdfs_remove_file_expect_no_realloc: ");
+  int result = 0;
+  const void* fs = fs_empty(0);
+  mdfs_t* mdfs = mdfs_init_simple(fs);
+  int i;
+  for (i = 0; i < 100; ++i) mdfs_add_file(mdfs, "plop", 10);
+  void* list = mdfs_get_file_list(mdfs);
+  uint32_t capacity = mdfs->file_capacity;
+  mdfs_remove_file(mdfs, "plop");
+  mdfs_add_file(mdfs, "plop", 10);
+  if (mdfs_get_file_list(mdfs) != list || mdfs->file_capacity != capacity ||
+      capacity < 100 || capacity > MDFS_MAX_FILECOUNT)
+  {
+    printf("FAILED (list %p -> %p, capacity %u -> %u)\n", 
+      list, mdfs_get_file_list(mdfs), capacity, mdfs->file_capacity);
+    result = -1;
+  }
+  else printf("OK\n");
+  mdfs_deinit(mdfs);
+  free((void*)fs);
+  return result;
+}
+
 int T_mdfs_remove_file()
 {
   return 
@@ -632,9 +1410,124 @@ int T_mdfs_remove_file()
     T_mdfs_remove_file_nonexisting_expect_0() |
     T_mdfs_remove_file_unique_expect_1() |
     T_mdfs_remove_and_add() |
+    T_mdfs_remove_file_expect_no_realloc() |
     0;
 }
 
+// --------------------------------------------------------------------
+// mdfs_begin_batch
+// --------------------------------------------------------------------
+int T_mdfs_batch_add_remove_rename_expect_applied_on_commit()
+{
+  printf("T_mdfs_batch_add_remove_rename_expect_applied_on_commit: ");
+  int result = 0;
+  const void* fs = fs_factory(0xFF, MDFS_BLOCKSIZE, MDFS_BLOCKSIZE+50, "This is file A", "this is file B");
+  mdfs_t* mdfs = mdfs_init_simple(fs);
+  char name[MDFS_MAX_FILENAME];
+  int i;
+  mdfs_begin_batch(mdfs);
+  for (i = 0; i < 100; ++i)
+  {
+    sprintf(name, "batch_%i", i);
+    if (mdfs_add_file(mdfs, name, 100 + i) < MDFS_BLOCKSIZE) result = -1;
+  }
+  if (mdfs_remove_file(mdfs, "file_A") != 1 || mdfs_rename_file(mdfs, "file_B", "file_C") != 1) result = -1;
+  if (result != 0) printf("FAILED (queueing: %s)\n", mdfs_get_error(mdfs));
+  // Nothing visible before the commit
+  mdfs_FILE* f = mdfs_fopen(mdfs, "file_A", "r");
+  if (result == 0 && (f == NULL || mdfs_get_filecount(mdfs) != 2))
+  {
+    printf("FAILED (list changed before commit)\n");
+    result = -1;
+  }
+  if (f != NULL) mdfs_fclose(f);
+  if (result == 0 && mdfs_commit_batch(mdfs) != 0)
+  {
+    printf("FAILED (commit: %s)\n", mdfs_get_error(mdfs));
+    result = -1;
+  }
+  if (result == 0 && (mdfs_get_filecount(mdfs) != 101 || mdfs_check_file_list_crc(mdfs) != 1))
+  {
+    printf("FAILED (filecount %i, list crc %i)\n", mdfs_get_filecount(mdfs), mdfs_check_file_list_crc(mdfs));
+    result = -1;
+  }
+  for (i = 1; i < mdfs_get_filecount(mdfs) && result == 0; ++i)
+  {
+    if (mdfs_get_file_offset(mdfs, i-1) + mdfs_get_filesize(mdfs, i-1) > mdfs_get_file_offset(mdfs, i))
+    {
+      printf("FAILED (entry %i overlaps or out of order)\n", i);
+      result = -1;
+    }
+  }
+  const char* expect_found[] = {"file_C", "batch_0", "batch_99"};
+  for (i = 0; i < 3 && result == 0; ++i)
+  {
+    f = mdfs_fopen(mdfs, expect_found[i], "r");
+    if (f == NULL)
+    {
+      printf("FAILED (%s not found)\n", expect_found[i]);
+      result = -1;
+    }
+    else mdfs_fclose(f);
+  }
+  if (result == 0 && (mdfs_fopen(mdfs, "file_A", "r") != NULL || mdfs_fopen(mdfs, "file_B", "r") != NULL))
+  {
+    printf("FAILED (removed or renamed file still there)\n");
+    result = -1;
+  }
+  if (result == 0) printf("OK\n");
+  mdfs_deinit(mdfs);
+  free((void*)fs);
+  return result;
+}
+
+int T_mdfs_batch_expect_same_list_as_one_by_one()
+{
+  printf("T_mdfs_batch_expect_same_list_as_one_by_one: ");
+  int result = 0;
+  const void* fs = fs_factory(0xFF, MDFS_BLOCKSIZE, MDFS_BLOCKSIZE+200, "This is file A", "this is file B");
+  mdfs_t* batched = mdfs_init_simple(fs);
+  mdfs_t* single = mdfs_init_simple(fs);
+  char name[MDFS_MAX_FILENAME];
+  int i;
+  mdfs_begin_batch(batched);
+  for (i = 0; i < 300; ++i)
+  {
+    sprintf(name, "file_%03i", i);
+    mdfs_add_file_ex(batched, name, 1 + (i * 37) % 500, (i & 1) ? MDFS_ALIGN_CACHELINE : MDFS_ALIGN_NONE);
+    mdfs_add_file_ex(single, name, 1 + (i * 37) % 500, (i & 1) ? MDFS_ALIGN_CACHELINE : MDFS_ALIGN_NONE);
+  }
+  mdfs_rename_file(batched, "file_A", "renamed");
+  mdfs_rename_file(single, "file_A", "renamed");
+  mdfs_commit_batch(batched);
+  // Entries only, mdfs_rename_file doesn't update the list crc. Without the
+  // extent map batched adds don't go in gaps, so only the count matches.
+  if (mdfs_get_filecount(batched) != mdfs_get_filecount(single) || (MDFS_USE_EXTENT_MAP &&
+      memcmp(mdfs_get_file_list(batched), mdfs_get_file_list(single), mdfs_get_filecount(single) * sizeof(mdfs_file_t))))
+  {
+    printf("FAILED (lists differ)\n");
+    result = -1;
+  }
+  if (result == 0 && (mdfs_commit_batch(batched) != -1 || mdfs_begin_batch(batched) != 0 || mdfs_begin_batch(batched) != -1))
+  {
+    printf("FAILED (commit without batch or double begin accepted)\n");
+    result = -1;
+  }
+  mdfs_abort_batch(batched);
+  if (result == 0) printf("OK\n");
+  mdfs_deinit(batched);
+  mdfs_deinit(single);
+  free((void*)fs);
+  return result;
+}
+
+int T_mdfs_batch()
+{
+  return
+    T_mdfs_batch_add_remove_rename_expect_applied_on_commit() |
+    T_mdfs_batch_expect_same_list_as_one_by_one();
+}
+
 // --------------------------------------------------------------------
 // mdfs_fgetc
 // --------------------------------------------------------------------
@@ -720,37 +1613,218 @@ int T_mdfs_fgetc_read_past_eof_expect_eof()
   return result;
 }
 
-int T_mdfs_fgetc()
+/* file_B of 12000 bytes behind a device with 8 blocks of 4 KB */
+static mdfs_t* _t_readahead_mdfs(t_device_t* dev, const void** fs)
 {
-  return 
-    T_mdfs_fgetc_read_till_eof() |
-    T_mdfs_fgetc_read_past_eof_expect_eof();
+  char* content = malloc(12001);
+  memset(content, 'x', 12000);
+  content[12000] = 0;
+  *fs = fs_factory(0xFF, MDFS_BLOCKSIZE, MDFS_BLOCKSIZE+50, "blaat", content);
+  free(content);
+  mdfs_device_t device;
+  _t_device_open(dev, &device, *fs, 3*MDFS_BLOCKSIZE);
+  device.cache_blocks = 8;
+  return mdfs_init_ex(&device);
 }
 
-// --------------------------------------------------------------------
-// mdfs_fread
-// --------------------------------------------------------------------
-int T_mdfs_fread_exact_length_expect_success()
+int T_mdfs_fgetc_sequential_expect_readahead()
 {
-  printf("T_mdfs_fread_exact_length_expect_success: ");
+  printf("T_mdfs_fgetc_sequential_expect_readahead: ");
   int result = 0;
-  const char* content = "This is file A";
-  const void* fs = fs_factory(0xFF, MDFS_BLOCKSIZE, MDFS_BLOCKSIZE+50, content, "this is file B");
-  mdfs_t* mdfs = mdfs_init_simple(fs);
-  mdfs_FILE* f = mdfs_fopen(mdfs, "file_A", "r");
-
-  char buf[30];
-  size_t L = strlen(content);
-  size_t count = mdfs_fread(buf, 1, L, f);
-  buf[count] = 0;
-  if (count != L)
+  t_device_t dev;
+  const void* fs;
+  mdfs_t* mdfs = _t_readahead_mdfs(&dev, &fs);
+  mdfs_FILE* f = mdfs_fopen(mdfs, "file_B", "r");
+  mdfs_fgetc(f);
+  // The first window (MDFS_READAHEAD_MIN) is in the cache already
+  dev.fail = 1;
+  int i;
+  for (i = 1; i < MDFS_READAHEAD_MIN && result == 0; ++i)
   {
-    printf("FAILED (return value = %i)\n", count);
-    result = -1;
+    if (mdfs_fgetc(f) != 'x')
+    {
+      printf("FAILED (byte %i not read ahead)\n", i);
+      result = -1;
+    }
   }
-  else if (strcmp(content, buf) != 0)
+  mdfs_fclose(f);
+  // No readahead for random reads
+  dev.fail = 0;
+  f = mdfs_fopen(mdfs, "file_B", "r");
+  mdfs_fadvise(f, 0, 0, MDFS_FADV_DONTNEED);
+  mdfs_fadvise(f, 0, 0, MDFS_FADV_RANDOM);
+  dev.reads = 0;
+  mdfs_fgetc(f);
+  if (result == 0 && dev.reads != 1)
   {
-    printf("FAILED (content mismatch, '%s')\n", buf);
+    printf("FAILED (%i device reads for a random read)\n", dev.reads);
+    result = -1;
+  }
+  mdfs_fclose(f);
+  if (result == 0) printf("OK\n");
+  mdfs_deinit(mdfs);
+  fclose(dev.file);
+  free((void*)fs);
+  return result;
+}
+
+int T_mdfs_fread_one_block_cache_expect_one_device_read_per_block()
+{
+  printf("T_mdfs_fread_one_block_cache_expect_one_device_read_per_block: ");
+  int result = 0;
+  t_device_t dev;
+  const void* fs;
+  mdfs_t* mdfs = _t_readahead_mdfs(&dev, &fs);
+  mdfs_deinit(mdfs);
+  fclose(dev.file);
+  mdfs_device_t device;
+  _t_device_open(&dev, &device, fs, 3*MDFS_BLOCKSIZE);
+  device.cache_blocks = 1;
+  mdfs = mdfs_init_ex(&device);
+  mdfs_FILE* f = mdfs_fopen(mdfs, "file_B", "r");
+  // file_B spans 3 blocks of 4 KB, readahead must not evict the block that
+  // the small reads still need
+  char buf[100];
+  dev.reads = 0;
+  while (mdfs_fread(buf, 1, sizeof(buf), f) == sizeof(buf));
+  if (!mdfs_feof(f) || mdfs_ferror(f) || dev.reads != 3)
+  {
+    printf("FAILED (%i device reads, expected 3)\n", dev.reads);
+    result = -1;
+  }
+  else printf("OK\n");
+  mdfs_fclose(f);
+  mdfs_deinit(mdfs);
+  fclose(dev.file);
+  free((void*)fs);
+  return result;
+}
+
+int T_mdfs_fadvise_willneed_dontneed_expect_cached_and_dropped()
+{
+  printf("T_mdfs_fadvise_willneed_dontneed_expect_cached_and_dropped: ");
+  int result = 0;
+  t_device_t dev;
+  const void* fs;
+  mdfs_t* mdfs = _t_readahead_mdfs(&dev, &fs);
+  mdfs_FILE* f = mdfs_fopen(mdfs, "file_B", "r");
+  mdfs_fadvise(f, 0, 0, MDFS_FADV_RANDOM);
+  char buf[100];
+  if (mdfs_fadvise(f, 8000, 100, MDFS_FADV_WILLNEED) || mdfs_fadvise(f, 0, 0, 99) != -1 || errno != EINVAL)
+  {
+    printf("FAILED (fadvise return value)\n");
+    result = -1;
+  }
+  // Bytes 0..7999 can only come from the device, the rest is cached
+  dev.fail = 1;
+  if (result == 0 && (mdfs_fread(buf, 1, 100, f) != 0 || !mdfs_ferror(f)))
+  {
+    printf("FAILED (read from failing device)\n");
+    result = -1;
+  }
+  f->offset = 8000;
+  if (result == 0 && mdfs_fread(buf, 1, 100, f) != 100)
+  {
+    printf("FAILED (WILLNEED not cached)\n");
+    result = -1;
+  }
+  f->offset = 8000;
+  mdfs_fadvise(f, 8000, 100, MDFS_FADV_DONTNEED);
+  if (result == 0 && mdfs_fread(buf, 1, 100, f) != 0)
+  {
+    printf("FAILED (DONTNEED still cached)\n");
+    result = -1;
+  }
+  mdfs_fclose(f);
+  if (result == 0) printf("OK\n");
+  mdfs_deinit(mdfs);
+  fclose(dev.file);
+  free((void*)fs);
+  return result;
+}
+
+int T_mdfs_getc_inline_expect_same_as_fgetc()
+{
+  printf("T_mdfs_getc_inline_expect_same_as_fgetc: ");
+  int result = 0;
+  char content[8000];
+  int i;
+  for (i = 0; i < sizeof(content) - 1; ++i) content[i] = 'a' + i % 26;
+  content[sizeof(content) - 1] = 0;
+  const void* fs = fs_factory(0xFF, MDFS_BLOCKSIZE, MDFS_BLOCKSIZE+50, "blaat", content);
+  mdfs_t* mdfs = mdfs_init_simple(fs);
+  mdfs_FILE* f = mdfs_fopen(mdfs, "file_B", "r");
+  char buf[10];
+  int c;
+  i = 0;
+  // A fread in between moves the offset under the inline path
+  while (result == 0 && (c = mdfs_getc(f)) != MDFS_EOF)
+  {
+    if (c != content[i++])
+    {
+      printf("FAILED (byte %i: %i)\n", i - 1, c);
+      result = -1;
+    }
+    if (i == 5000) i += mdfs_fread(buf, 1, sizeof(buf), f);
+  }
+  if (result == 0 && (i != strlen(content) || f->getc_end == 0))
+  {
+    printf("FAILED (read %i bytes, getc_end %u)\n", i, f->getc_end);
+    result = -1;
+  }
+  mdfs_fclose(f);
+  // Verify mode takes mdfs_fgetc until the crc is checked
+  f = mdfs_fopen(mdfs, "file_B", "rv");
+  for (i = 0; i < 100; ++i) mdfs_getc(f);
+  uint32_t getc_end = f->getc_end;
+  while (mdfs_getc(f) != MDFS_EOF);
+  if (result == 0 && (getc_end != 0 || mdfs_ferror(f)))
+  {
+    printf("FAILED (verify mode, getc_end %u)\n", getc_end);
+    result = -1;
+  }
+  mdfs_fclose(f);
+  if (result == 0) printf("OK\n");
+  mdfs_deinit(mdfs);
+  free((void*)fs);
+  return result;
+}
+
+int T_mdfs_fgetc()
+{
+  return 
+    T_mdfs_fgetc_read_till_eof() |
+    T_mdfs_fgetc_read_past_eof_expect_eof() |
+    T_mdfs_getc_inline_expect_same_as_fgetc() |
+    T_mdfs_fgetc_sequential_expect_readahead() |
+    T_mdfs_fread_one_block_cache_expect_one_device_read_per_block() |
+    T_mdfs_fadvise_willneed_dontneed_expect_cached_and_dropped();
+}
+
+// --------------------------------------------------------------------
+// mdfs_fread
+// --------------------------------------------------------------------
+int T_mdfs_fread_exact_length_expect_success()
+{
+  printf("T_mdfs_fread_exact_length_expect_success: ");
+  int result = 0;
+  const char* content = "This is file A";
+  const void* fs = fs_factory(0xFF, MDFS_BLOCKSIZE, MDFS_BLOCKSIZE+50, content, "this is file B");
+  mdfs_t* mdfs = mdfs_init_simple(fs);
+  mdfs_FILE* f = mdfs_fopen(mdfs, "file_A", "r");
+
+  char buf[30];
+  size_t L = strlen(content);
+  size_t count = mdfs_fread(buf, 1, L, f);
+  buf[count] = 0;
+  if (count != L)
+  {
+    printf("FAILED (return value = %i)\n", count);
+    result = -1;
+  }
+  else if (strcmp(content, buf) != 0)
+  {
+    printf("FAILED (content mismatch, '%s')\n", buf);
     result = -1;
   }
   else if (!mdfs_feof(f))
@@ -824,89 +1898,709 @@ int T_mdfs_fread_uneven_steps_expect_success()
   char* loc = buf;
   while (!mdfs_feof(f))
   {
-    count = mdfs_fread(loc, 1, 3, f);
-    loc += count;
-    len += count;
-    if (count != 3 && !mdfs_feof(f)) 
+    count = mdfs_fread(loc, 1, 3, f);
+    loc += count;
+    len += count;
+    if (count != 3 && !mdfs_feof(f)) 
+    {
+      result = -1;
+      printf("FAILD (read %i/3 chars and not at eof\n", count);
+    }
+  }
+  buf[len] = 0;
+  if (L != len)
+  {
+    printf("FAILED (read %i / %i chars)\n", len, L);
+    result = -1;
+  }
+  else if (strcmp(content, buf) != 0)
+  {
+    printf("FAILED (content mismatch, '%s')\n", buf);
+    result = -1;
+  }
+  else if (!mdfs_feof(f))
+  {
+    printf("FAILED (not at eof after reading '%s')\n", buf);
+    result = -1;
+  }
+  else
+  {
+    printf("OK\n");
+  }
+
+  mdfs_fclose(f);
+  mdfs_deinit(mdfs);
+  free((void*)fs);
+  return result;
+}
+
+int T_mdfs_fread_at_eof_expect_0()
+{
+  printf("T_mdfs_fread_at_eof_expect_0: ");
+  int result = 0;
+  const char* content = "This is file B with some more text";
+  const void* fs = fs_factory(0xFF, MDFS_BLOCKSIZE, MDFS_BLOCKSIZE+50, "blaat", content);
+  mdfs_t* mdfs = mdfs_init_simple(fs);
+  mdfs_FILE* f = mdfs_fopen(mdfs, "file_B", "r");
+  // read till end
+  char buf[100];
+  size_t count = mdfs_fread(buf, 1, strlen(content)+10, f);
+  buf[count] = 0;
+  // We're at eof now, buf has content
+  count = mdfs_fread(buf, 1, 10, f);
+  if (count != 0)
+  {
+    result = -1;
+    printf("FAILED (fread at eof returned %i)\n", count);
+  }
+  else if (strcmp(content, buf) != 0)
+  {
+    result = -1;
+    printf("FAILED (fread at eof changed buffer: '%s')\n", buf);
+  }
+  else if (!mdfs_feof(f))
+  {
+    result = -1;
+    printf("FAILED (no longer at eof after fread)\n");
+  }
+  else
+  {
+    printf("'%s' OK\n", buf);
+  }
+
+  mdfs_fclose(f);
+  mdfs_deinit(mdfs);
+  free((void*)fs);
+  return result;
+}
+
+int T_mdfs_fread_view_in_steps_expect_no_copy()
+{
+  printf("T_mdfs_fread_view_in_steps_expect_no_copy: ");
+  int result = 0;
+  const char* content = "This is file B with some more text";
+  const void* fs = fs_factory(0xFF, MDFS_BLOCKSIZE, MDFS_BLOCKSIZE+50, "blaat", content);
+  mdfs_t* mdfs = mdfs_init_simple(fs);
+  mdfs_FILE* f = mdfs_fopen(mdfs, "file_B", "r");
+  const uint8_t* expect = (const uint8_t*)fs + MDFS_BLOCKSIZE + 50;
+  size_t L = strlen(content);
+  size_t len = 0;
+  mdfs_view_t peek = mdfs_fpeek(f, 4);
+  if (peek.data != expect || peek.size != 4 || f->offset != 0)
+  {
+    printf("FAILED (peek %p/%u, offset %u)\n", peek.data, peek.size, f->offset);
+    result = -1;
+  }
+  while (result == 0)
+  {
+    mdfs_view_t view = mdfs_fread_view(f, 8);
+    if (view.size == 0) break;
+    if (view.data != expect + len)
+    {
+      printf("FAILED (view at %p, expected %p)\n", view.data, expect + len);
+      result = -1;
+    }
+    len += view.size;
+  }
+  if (result == 0 && (len != L || !mdfs_feof(f) || mdfs_fread_view(f, 8).data != NULL))
+  {
+    printf("FAILED (read %u / %u chars, feof = %i)\n", (unsigned)len, (unsigned)L, mdfs_feof(f));
+    result = -1;
+  }
+  if (result == 0) printf("OK\n");
+  mdfs_fclose(f);
+  mdfs_deinit(mdfs);
+  free((void*)fs);
+  return result;
+}
+
+int T_mdfs_fread_elements_expect_complete_count()
+{
+  printf("T_mdfs_fread_elements_expect_complete_count: ");
+  int result = 0;
+  const char* content = "This is file A"; // 14 bytes
+  const void* fs = fs_factory(0xFF, MDFS_BLOCKSIZE, MDFS_BLOCKSIZE+50, content, "this is file B");
+  mdfs_t* mdfs = mdfs_init_simple(fs);
+  mdfs_FILE* f = mdfs_fopen(mdfs, "file_A", "r");
+  char buf[30];
+  size_t first = mdfs_fread(buf, 5, 2, f); // 10 bytes, 2 elements
+  uint32_t offset_first = f->offset;
+  size_t second = mdfs_fread(buf + 10, 5, 2, f); // 4 bytes left, 0 elements
+  if (first != 2 || offset_first != 10 || second != 0 || !mdfs_feof(f) ||
+      memcmp(buf, content, 14) != 0)
+  {
+    printf("FAILED (returned %u and %u, offset %u)\n", (unsigned)first, (unsigned)second, f->offset);
+    result = -1;
+  }
+  else printf("OK\n");
+  mdfs_fclose(f);
+  mdfs_deinit(mdfs);
+  free((void*)fs);
+  return result;
+}
+
+int T_mdfs_fread_bulk_unaligned_expect_success()
+{
+  printf("T_mdfs_fread_bulk_unaligned_expect_success: ");
+  int result = 0;
+  int32_t size = 600*1024 + 13;
+  uint8_t* fs = malloc(MDFS_BLOCKSIZE + size);
+  memset(fs, 0xFF, MDFS_BLOCKSIZE);
+  mdfs_t* mdfs = mdfs_init_simple(fs);
+  uint32_t offset = mdfs_add_file(mdfs, "big", size);
+  int i;
+  for (i = 0; i < size; ++i) fs[offset + i] = i * 31;
+  mdfs_FILE* f = mdfs_fopen(mdfs, "big", "r");
+  uint8_t* buf = malloc(size + 3);
+  size_t count = mdfs_fread(buf + 3, 1, size + 100, f);
+  if (count != size || memcmp(buf + 3, fs + offset, size) != 0 || !mdfs_feof(f))
+  {
+    printf("FAILED (read %u of %i bytes)\n", (unsigned)count, size);
+    result = -1;
+  }
+  else printf("OK\n");
+  free(buf);
+  mdfs_fclose(f);
+  mdfs_deinit(mdfs);
+  free(fs);
+  return result;
+}
+
+typedef struct TestAio {
+  int calls;
+  size_t bytes;
+  int errors;
+} t_aio_t;
+
+static void _t_aio_done(mdfs_FILE* f, void* buf, size_t n, int error, void* ctx)
+{
+  t_aio_t* aio = (t_aio_t*)ctx;
+  aio->calls++;
+  aio->bytes += n;
+  if (error) aio->errors++;
+}
+
+/* Read file_B in pieces of 4 bytes, all in flight at once */
+static int _t_fread_async_pieces(mdfs_t* mdfs, const char* content)
+{
+  mdfs_FILE* f = mdfs_fopen(mdfs, "file_B", "r");
+  char buf[60] = {0};
+  t_aio_t aio = {0, 0, 0};
+  int submitted = 0;
+  while (!mdfs_feof(f))
+  {
+    if (mdfs_fread_async(f, buf + 4 * submitted, 4, _t_aio_done, &aio)) break;
+    ++submitted;
+  }
+  while (mdfs_aio_poll(mdfs, 1) > 0);
+  mdfs_fclose(f);
+  if (submitted != (strlen(content) + 3) / 4 || aio.calls != submitted || aio.errors || aio.bytes != strlen(content) || strcmp(buf, content))
+  {
+    printf("FAILED (%i submitted, %i callbacks, %i bytes: \"%s\")\n", submitted, aio.calls, (int)aio.bytes, buf);
+    return -1;
+  }
+  return 0;
+}
+
+int T_mdfs_fread_async_pieces_expect_content()
+{
+  printf("T_mdfs_fread_async_pieces_expect_content: ");
+  const char* content = "This is file B with some more text";
+  const void* fs = fs_factory(0xFF, MDFS_BLOCKSIZE, MDFS_BLOCKSIZE+50, "blaat", content);
+  mdfs_t* mdfs = mdfs_init_simple(fs);
+  int result = _t_fread_async_pieces(mdfs, content);
+  mdfs_deinit(mdfs);
+  // Same through a device
+  t_device_t dev;
+  mdfs_device_t device;
+  _t_device_open(&dev, &device, fs, 3*MDFS_BLOCKSIZE);
+  mdfs = mdfs_init_ex(&device);
+  if (result == 0) result = _t_fread_async_pieces(mdfs, content);
+  mdfs_deinit(mdfs);
+  fclose(dev.file);
+  if (result == 0) printf("OK\n");
+  free((void*)fs);
+  return result;
+}
+
+int T_mdfs_fread_async_queue_full_expect_EAGAIN()
+{
+  printf("T_mdfs_fread_async_queue_full_expect_EAGAIN: ");
+  int result = 0;
+  const void* fs = fs_factory(0xFF, MDFS_BLOCKSIZE, MDFS_BLOCKSIZE+50, "blaat", "This is file B");
+  mdfs_t* mdfs = mdfs_init_simple(fs);
+  mdfs_FILE* f = mdfs_fopen(mdfs, "file_B", "r");
+  char buf[MDFS_AIO_DEPTH];
+  t_aio_t aio = {0, 0, 0};
+  int i;
+  // Slots are only freed by polling, reads past eof complete with 0 bytes
+  for (i = 0; i < MDFS_AIO_DEPTH && result == 0; ++i)
+  {
+    if (mdfs_fread_async(f, buf + i, 1, _t_aio_done, &aio)) result = -1;
+  }
+  if (result == 0 && (mdfs_fread_async(f, buf, 1, _t_aio_done, &aio) != -1 || errno != EAGAIN))
+  {
+    printf("FAILED (read %i queued)\n", MDFS_AIO_DEPTH + 1);
+    result = -1;
+  }
+  while (mdfs_aio_poll(mdfs, 1) > 0);
+  if (result == 0 && (aio.calls != MDFS_AIO_DEPTH || aio.bytes != 14 || mdfs_fread_async(f, buf, 1, _t_aio_done, &aio)))
+  {
+    printf("FAILED (%i callbacks, %i bytes)\n", aio.calls, (int)aio.bytes);
+    result = -1;
+  }
+  while (mdfs_aio_poll(mdfs, 1) > 0);
+  if (result == 0) printf("OK\n");
+  mdfs_fclose(f);
+  mdfs_deinit(mdfs);
+  free((void*)fs);
+  return result;
+}
+
+int T_mdfs_fread_async_static_expect_ENOTSUP()
+{
+  printf("T_mdfs_fread_async_static_expect_ENOTSUP: ");
+  int result = 0;
+  static uint8_t workspace[MDFS_WORKSPACE_SIZE];
+  const void* fs = fs_factory(0xFF, MDFS_BLOCKSIZE, MDFS_BLOCKSIZE+50, "blaat", "This is file B");
+  mdfs_t* mdfs = mdfs_init_static(fs, workspace, sizeof(workspace));
+  mdfs_FILE* f = mdfs_fopen(mdfs, "file_B", "r");
+  char buf[4];
+  t_aio_t aio = {0, 0, 0};
+  // No queue or workers are created, nothing to poll
+  if (mdfs_fread_async(f, buf, sizeof(buf), _t_aio_done, &aio) != -1 || errno != ENOTSUP ||
+    mdfs->aio != NULL || mdfs_aio_poll(mdfs, 0) != 0 || aio.calls != 0)
+  {
+    printf("FAILED (async read on a static mdfs)\n");
+    result = -1;
+  }
+  else printf("OK\n");
+  mdfs_fclose(f);
+  mdfs_deinit(mdfs);
+  free((void*)fs);
+  return result;
+}
+
+int T_mdfs_fseek_ftell_rewind_expect_positions()
+{
+  printf("T_mdfs_fseek_ftell_rewind_expect_positions: ");
+  int result = 0;
+  const char* content = "0123456789";
+  const void* fs = fs_factory(0xFF, MDFS_BLOCKSIZE, MDFS_BLOCKSIZE+50, "blaat", content);
+  mdfs_t* mdfs = mdfs_init_simple(fs);
+  mdfs_FILE* f = mdfs_fopen(mdfs, "file_B", "r");
+  if (mdfs_fseek(f, 4, SEEK_SET) || mdfs_getc(f) != '4' ||
+    mdfs_fseek(f, 2, SEEK_CUR) || mdfs_getc(f) != '7' ||
+    mdfs_fseek(f, -1, SEEK_END) || mdfs_getc(f) != '9' || !mdfs_feof(f))
+  {
+    printf("FAILED (read after seek)\n");
+    result = -1;
+  }
+  mdfs_fseek(f, 3, SEEK_SET);
+  if (result == 0 && (mdfs_fseek(f, 1, SEEK_END) != -1 || errno != EINVAL ||
+    mdfs_fseek(f, -4, SEEK_CUR) != -1 || mdfs_fseek(f, 0, 99) != -1 || mdfs_ftell(f) != 3))
+  {
+    printf("FAILED (bad seek accepted, at %li)\n", mdfs_ftell(f));
+    result = -1;
+  }
+  mdfs_rewind(f);
+  if (result == 0 && (mdfs_ftell(f) != 0 || mdfs_getc(f) != '0'))
+  {
+    printf("FAILED (rewind)\n");
+    result = -1;
+  }
+  if (result == 0) printf("OK\n");
+  mdfs_fclose(f);
+  mdfs_deinit(mdfs);
+  free((void*)fs);
+  return result;
+}
+
+int T_mdfs_fseek_verify_mode_expect_crc_checked()
+{
+  printf("T_mdfs_fseek_verify_mode_expect_crc_checked: ");
+  int result = 0;
+  const char* content = "This is file B with some more text";
+  uint8_t* fs = (uint8_t*)fs_factory(0xFF, MDFS_BLOCKSIZE, MDFS_BLOCKSIZE+50, "blaat", content);
+  mdfs_t* mdfs = mdfs_init_simple(fs);
+  char buf[40];
+  int corrupt;
+  for (corrupt = 0; corrupt < 2 && result == 0; ++corrupt)
+  {
+    // Skip ahead, go back, read a bit: fclose checks the whole file
+    if (corrupt) fs[MDFS_BLOCKSIZE + 50 + 20] ^= 1;
+    mdfs_FILE* f = mdfs_fopen(mdfs, "file_B", "rv");
+    mdfs_fseek(f, 10, SEEK_SET);
+    mdfs_fread(buf, 1, 5, f);
+    mdfs_rewind(f);
+    mdfs_fread(buf, 1, 3, f);
+    int ret_val = mdfs_fclose(f);
+    if (ret_val != (corrupt ? MDFS_EOF : 0))
+    {
+      printf("FAILED (fclose returned %i, corrupt %i)\n", ret_val, corrupt);
+      result = -1;
+    }
+  }
+  if (result == 0) printf("OK\n");
+  mdfs_deinit(mdfs);
+  free((void*)fs);
+  return result;
+}
+
+int T_mdfs_rewind_after_crc_mismatch_expect_fclose_fails()
+{
+  printf("T_mdfs_rewind_after_crc_mismatch_expect_fclose_fails: ");
+  int result = 0;
+  uint8_t* fs = (uint8_t*)fs_factory(0xFF, MDFS_BLOCKSIZE, MDFS_BLOCKSIZE+50, "blaat", "This is file B");
+  fs[MDFS_BLOCKSIZE + 50 + 3] ^= 1;
+  mdfs_t* mdfs = mdfs_init_simple(fs);
+  mdfs_FILE* f = mdfs_fopen(mdfs, "file_B", "rv");
+  char buf[40];
+  // The mismatch is found at eof, rewind clears the error indicator only
+  mdfs_fread(buf, 1, sizeof(buf), f);
+  int error = mdfs_ferror(f);
+  mdfs_rewind(f);
+  errno = 0;
+  int ret_val = mdfs_fclose(f);
+  if (!error || ret_val != MDFS_EOF || errno != EIO)
+  {
+    printf("FAILED (ferror %i, fclose returned %i)\n", error, ret_val);
+    result = -1;
+  }
+  else printf("OK\n");
+  mdfs_deinit(mdfs);
+  free((void*)fs);
+  return result;
+}
+
+/* Positional reads on file_B leave the offset alone */
+static int _t_pread(mdfs_t* mdfs)
+{
+  mdfs_FILE* f = mdfs_fopen(mdfs, "file_B", "r");
+  char buf[16] = {0};
+  mdfs_fseek(f, 2, SEEK_SET);
+  int result = 0;
+  if (mdfs_pread(f, buf, 4, 6) != 4 || memcmp(buf, "6789", 4) ||
+    mdfs_pread(f, buf, sizeof(buf), 8) != 2 || mdfs_pread(f, buf, 4, 10) != 0 || mdfs_pread(f, buf, 4, 100) != 0 ||
+    mdfs_ftell(f) != 2 || mdfs_getc(f) != '2')
+  {
+    printf("FAILED (pread)\n");
+    result = -1;
+  }
+  mdfs_fclose(f);
+  return result;
+}
+
+int T_mdfs_pread_expect_offset_unchanged()
+{
+  printf("T_mdfs_pread_expect_offset_unchanged: ");
+  const void* fs = fs_factory(0xFF, MDFS_BLOCKSIZE, MDFS_BLOCKSIZE+50, "blaat", "0123456789");
+  mdfs_t* mdfs = mdfs_init_simple(fs);
+  int result = _t_pread(mdfs);
+  mdfs_deinit(mdfs);
+  t_device_t dev;
+  mdfs_device_t device;
+  _t_device_open(&dev, &device, fs, 3*MDFS_BLOCKSIZE);
+  mdfs = mdfs_init_ex(&device);
+  if (result == 0) result = _t_pread(mdfs);
+  mdfs_deinit(mdfs);
+  fclose(dev.file);
+  if (result == 0) printf("OK\n");
+  free((void*)fs);
+  return result;
+}
+
+int T_mdfs_fread()
+{
+  return 
+    T_mdfs_fread_exact_length_expect_success() |
+    T_mdfs_fread_oversized_buffer_expect_success() |
+    T_mdfs_fread_uneven_steps_expect_success() |
+    T_mdfs_fread_at_eof_expect_0() |
+    T_mdfs_fread_view_in_steps_expect_no_copy() |
+    T_mdfs_fread_elements_expect_complete_count() |
+    T_mdfs_fread_bulk_unaligned_expect_success() |
+    T_mdfs_fread_async_pieces_expect_content() |
+    T_mdfs_fread_async_queue_full_expect_EAGAIN() |
+    T_mdfs_fread_async_static_expect_ENOTSUP() |
+    T_mdfs_fseek_ftell_rewind_expect_positions() |
+    T_mdfs_fseek_verify_mode_expect_crc_checked() |
+    T_mdfs_rewind_after_crc_mismatch_expect_fclose_fails() |
+    T_mdfs_pread_expect_offset_unchanged();
+}
+
+// --------------------------------------------------------------------
+// Lines
+// --------------------------------------------------------------------
+int T_mdfs_fgets_short_buffer_expect_split_line()
+{
+  printf("T_mdfs_fgets_short_buffer_expect_split_line: ");
+  int result = 0;
+  const void* fs = fs_factory(0xFF, MDFS_BLOCKSIZE, MDFS_BLOCKSIZE+50, "blaat", "first\nsecond line\n\nlast");
+  mdfs_t* mdfs = mdfs_init_simple(fs);
+  mdfs_FILE* f = mdfs_fopen(mdfs, "file_B", "rv");
+  static const char* expected[] = {"first\n", "second ", "line\n", "\n", "last"};
+  char buf[8];
+  int i;
+  for (i = 0; i < 5 && result == 0; ++i)
+  {
+    if (mdfs_fgets(buf, sizeof(buf), f) == NULL || strcmp(buf, expected[i]))
     {
+      printf("FAILED (line %i)\n", i);
       result = -1;
-      printf("FAILD (read %i/3 chars and not at eof\n", count);
     }
   }
-  buf[len] = 0;
-  if (L != len)
+  if (result == 0 && (mdfs_fgets(buf, sizeof(buf), f) != NULL || mdfs_fclose(f) != 0))
   {
-    printf("FAILED (read %i / %i chars)\n", len, L);
+    printf("FAILED (no NULL at eof or crc error)\n");
     result = -1;
   }
-  else if (strcmp(content, buf) != 0)
+  if (result == 0) printf("OK\n");
+  mdfs_deinit(mdfs);
+  free((void*)fs);
+  return result;
+}
+
+/* getline and getline_view on file_B, lines as in content */
+static int _t_getline(mdfs_t* mdfs, const char* content)
+{
+  mdfs_FILE* f = mdfs_fopen(mdfs, "file_B", "r");
+  char* line = NULL;
+  size_t size = 0;
+  const char* p = content;
+  int32_t n;
+  int result = 0;
+  while (result == 0 && (n = mdfs_getline(&line, &size, f)) != -1)
   {
-    printf("FAILED (content mismatch, '%s')\n", buf);
-    result = -1;
+    if (strncmp(line, p, n) || strlen(line) != n || size < n + 1)
+    {
+      printf("FAILED (getline \"%s\")\n", line);
+      result = -1;
+    }
+    p += n;
   }
-  else if (!mdfs_feof(f))
+  if (result == 0 && *p != 0)
   {
-    printf("FAILED (not at eof after reading '%s')\n", buf);
+    printf("FAILED (stopped before \"%s\")\n", p);
     result = -1;
   }
-  else
+  free(line);
+  mdfs_fclose(f);
+  f = mdfs_fopen(mdfs, "file_B", "r");
+  p = content;
+  mdfs_view_t view;
+  while (result == 0 && (view = mdfs_getline_view(f)).size > 0)
   {
-    printf("OK\n");
+    const char* nl = strchr(p, '\n');
+    size_t len = nl ? nl - p + 1 : strlen(p);
+    if (view.size != len || memcmp(view.data, p, len))
+    {
+      printf("FAILED (view of %u bytes at %i)\n", view.size, (int)(p - content));
+      result = -1;
+    }
+    p += len;
   }
-
   mdfs_fclose(f);
+  return result;
+}
+
+int T_mdfs_getline_expect_lines()
+{
+  printf("T_mdfs_getline_expect_lines: ");
+  // Longer than the first buffer getline allocates
+  char content[400];
+  memset(content, 'y', sizeof(content));
+  strcpy(content, "a\nbb\n\nccc\n");
+  content[sizeof(content) - 1] = 0;
+  const void* fs = fs_factory(0xFF, MDFS_BLOCKSIZE, MDFS_BLOCKSIZE+50, "blaat", content);
+  mdfs_t* mdfs = mdfs_init_simple(fs);
+  int result = _t_getline(mdfs, content);
+  mdfs_deinit(mdfs);
+  t_device_t dev;
+  mdfs_device_t device;
+  _t_device_open(&dev, &device, fs, 3*MDFS_BLOCKSIZE);
+  mdfs = mdfs_init_ex(&device);
+  if (result == 0) result = _t_getline(mdfs, content);
   mdfs_deinit(mdfs);
+  fclose(dev.file);
+  if (result == 0) printf("OK\n");
   free((void*)fs);
   return result;
 }
 
-int T_mdfs_fread_at_eof_expect_0()
+int T_mdfs_getdelim_view_expect_no_copy()
 {
-  printf("T_mdfs_fread_at_eof_expect_0: ");
+  printf("T_mdfs_getdelim_view_expect_no_copy: ");
   int result = 0;
-  const char* content = "This is file B with some more text";
-  const void* fs = fs_factory(0xFF, MDFS_BLOCKSIZE, MDFS_BLOCKSIZE+50, "blaat", content);
+  const void* fs = fs_factory(0xFF, MDFS_BLOCKSIZE, MDFS_BLOCKSIZE+50, "blaat", "key=value;x=1;");
   mdfs_t* mdfs = mdfs_init_simple(fs);
   mdfs_FILE* f = mdfs_fopen(mdfs, "file_B", "r");
-  // read till end
-  char buf[100];
-  size_t count = mdfs_fread(buf, 1, strlen(content)+10, f);
-  buf[count] = 0;
-  // We're at eof now, buf has content
-  count = mdfs_fread(buf, 1, 10, f);
-  if (count != 0)
+  mdfs_view_t a = mdfs_getdelim_view(f, ';');
+  mdfs_view_t b = mdfs_getdelim_view(f, ';');
+  mdfs_view_t c = mdfs_getdelim_view(f, ';');
+  if (a.data != (const uint8_t*)fs + MDFS_BLOCKSIZE + 50 || a.size != 10 || b.size != 4 || c.size != 0)
   {
+    printf("FAILED (views of %u, %u and %u bytes)\n", a.size, b.size, c.size);
     result = -1;
-    printf("FAILED (fread at eof returned %i)\n", count);
   }
-  else if (strcmp(content, buf) != 0)
+  if (result == 0) printf("OK\n");
+  mdfs_fclose(f);
+  mdfs_deinit(mdfs);
+  free((void*)fs);
+  return result;
+}
+
+int T_mdfs_lines()
+{
+  return
+    T_mdfs_fgets_short_buffer_expect_split_line() |
+    T_mdfs_getline_expect_lines() |
+    T_mdfs_getdelim_view_expect_no_copy();
+}
+
+// --------------------------------------------------------------------
+// Filename index
+// --------------------------------------------------------------------
+int T_mdfs_index_full_list_expect_all_found()
+{
+  printf("T_mdfs_index_full_list_expect_all_found: ");
+  int result = 0;
+  const void* fs = fs_empty(0);
+  mdfs_t* mdfs = mdfs_init_simple(fs);
+  char name[MDFS_MAX_FILENAME];
+  int i;
+  for (i = 0; i < MDFS_MAX_FILECOUNT; ++i)
   {
-    result = -1;
-    printf("FAILED (fread at eof changed buffer: '%s')\n", buf);
+    sprintf(name, "lua/module_%i.lua", i);
+    mdfs_add_file(mdfs, name, 1);
   }
-  else if (!mdfs_feof(f))
+  // Files are appended so index in the list equals i
+  for (i = 0; i < MDFS_MAX_FILECOUNT; ++i)
   {
-    result = -1;
-    printf("FAILED (no longer at eof after fread)\n");
+    sprintf(name, "lua/module_%i.lua", i);
+    mdfs_FILE* f = mdfs_fopen(mdfs, name, "r");
+    if (f == NULL || f->index != i)
+    {
+      printf("FAILED (%s not found at %i)\n", name, i);
+      result = -1;
+      if (f != NULL) mdfs_fclose(f);
+      break;
+    }
+    mdfs_fclose(f);
   }
-  else
+  if (result == 0) printf("OK (%u bytes)\n", (unsigned)mdfs_get_index_size(mdfs));
+  mdfs_deinit(mdfs);
+  free((void*)fs);
+  return result;
+}
+
+int T_mdfs_index_duplicates_expect_first()
+{
+  printf("T_mdfs_index_duplicates_expect_first: ");
+  int result = 0;
+  const void* fs = fs_factory(0xFF, MDFS_BLOCKSIZE, MDFS_BLOCKSIZE+50, "This is file A", "this is file B");
+  mdfs_t* mdfs = mdfs_init_simple(fs);
+  mdfs_add_file(mdfs, "file_B", 10);
+  mdfs_FILE* f = mdfs_fopen(mdfs, "file_B", "r");
+  if (f == NULL || f->index != 1)
   {
-    printf("'%s' OK\n", buf);
+    printf("FAILED (expected index 1, got %i)\n", f ? f->index : -1);
+    result = -1;
+  }
+  else printf("OK\n");
+  if (f != NULL) mdfs_fclose(f);
+  mdfs_deinit(mdfs);
+  free((void*)fs);
+  return result;
+}
+
+int T_mdfs_index_after_remove_and_rename_expect_updated()
+{
+  printf("T_mdfs_index_after_remove_and_rename_expect_updated: ");
+  int result = 0;
+  const void* fs = fs_factory(0xFF, MDFS_BLOCKSIZE, MDFS_BLOCKSIZE+50, "This is file A", "this is file B");
+  mdfs_t* mdfs = mdfs_init_simple(fs);
+  mdfs_remove_file(mdfs, "file_A");
+  mdfs_rename_file(mdfs, "file_B", "file_C");
+  mdfs_FILE* a = mdfs_fopen(mdfs, "file_A", "r");
+  mdfs_FILE* b = mdfs_fopen(mdfs, "file_B", "r");
+  mdfs_FILE* c = mdfs_fopen(mdfs, "file_C", "r");
+  if (a != NULL || b != NULL || c == NULL || c->index != 0)
+  {
+    printf("FAILED (A = %p, B = %p, C = %p)\n", a, b, c);
+    result = -1;
   }
+  else printf("OK\n");
+  if (a != NULL) mdfs_fclose(a);
+  if (b != NULL) mdfs_fclose(b);
+  if (c != NULL) mdfs_fclose(c);
+  mdfs_deinit(mdfs);
+  free((void*)fs);
+  return result;
+}
 
-  mdfs_fclose(f);
+int T_mdfs_index_mixed_changes_expect_same_as_linear()
+{
+  printf("T_mdfs_index_mixed_changes_expect_same_as_linear: ");
+  int result = 0;
+  const void* fs = fs_empty(0);
+  mdfs_t* mdfs = mdfs_init_simple(fs);
+  char name[MDFS_MAX_FILENAME], newname[MDFS_MAX_FILENAME], listed[MDFS_MAX_FILENAME];
+  uint32_t seed = 12345;
+  int step, i;
+  // Few names so there are duplicates, removes make gaps that adds then fill
+  // at the front of the list
+  for (step = 0; step < 500 && result == 0; ++step)
+  {
+    seed = seed * 1103515245u + 12345u;
+    sprintf(name, "f%u", (seed >> 16) % 40);
+    switch ((seed >> 8) % 4)
+    {
+    case 0:
+    case 1:
+      mdfs_add_file(mdfs, name, 1 + (seed >> 4) % 100);
+      break;
+    case 2:
+      mdfs_remove_file(mdfs, name);
+      break;
+    default:
+      sprintf(newname, "f%u", (seed >> 20) % 40);
+      mdfs_rename_file(mdfs, name, newname);
+      break;
+    }
+    for (i = 0; i < mdfs_get_filecount(mdfs); ++i)
+    {
+      mdfs_get_filename(mdfs, i, listed);
+      int first;
+      for (first = 0; first < i; ++first)
+      {
+        mdfs_get_filename(mdfs, first, name);
+        if (strcmp(name, listed) == 0) break;
+      }
+      if (first < i) continue; // Only the first occurence is indexed
+      mdfs_FILE* f = mdfs_fopen(mdfs, listed, "r");
+      if (f == NULL || f->index != i)
+      {
+        printf("FAILED (step %i: %s at %i, opened %i)\n", step, listed, i, f ? f->index : -1);
+        result = -1;
+      }
+      if (f != NULL) mdfs_fclose(f);
+      if (result) break;
+    }
+  }
+  if (result == 0) printf("OK\n");
   mdfs_deinit(mdfs);
   free((void*)fs);
   return result;
 }
 
-int T_mdfs_fread()
+int T_mdfs_index()
 {
-  return 
-    T_mdfs_fread_exact_length_expect_success() |
-    T_mdfs_fread_oversized_buffer_expect_success() |
-    T_mdfs_fread_uneven_steps_expect_success() |
-    T_mdfs_fread_at_eof_expect_0();
+  return
+    T_mdfs_index_full_list_expect_all_found() |
+    T_mdfs_index_duplicates_expect_first() |
+    T_mdfs_index_after_remove_and_rename_expect_updated() |
+    T_mdfs_index_mixed_changes_expect_same_as_linear();
 }
 
 // --------------------------------------------------------------------
@@ -1154,10 +2848,292 @@ int T_mdfs_check_file_list_crc_after_add_expect_changed()
   return result;  
 }
 
+int T_mdfs_calc_crc_engines_expect_identical()
+{
+  printf("T_mdfs_calc_crc_engines_expect_identical: ");
+  int result = 0;
+  // Random data, all lengths up to 300 and all alignments up to 8
+  uint8_t* data = malloc(4096);
+  int i, offset, len, engine;
+  srand(1234);
+  for (i = 0; i < 4096; ++i) data[i] = rand();
+  for (engine = MDFS_CRC_ENGINE_SLICE8; engine <= MDFS_CRC_ENGINE_PCLMUL; ++engine)
+  {
+    if (!mdfs_crc_engine_available(engine)) continue;
+    if (mdfs_calc_crc_engine("crc testing text", 16, engine) != 0x60f44eeb)
+    {
+      printf("FAILED (engine %i, known answer)\n", engine);
+      result = -1;
+    }
+    for (offset = 0; offset < 8 && result == 0; ++offset)
+    {
+      for (len = 0; len < 300; ++len)
+      {
+        uint32_t expect = mdfs_calc_crc_engine(data + offset, len, MDFS_CRC_ENGINE_BYTEWISE);
+        uint32_t crc = mdfs_calc_crc_engine(data + offset, len, engine);
+        if (crc != expect)
+        {
+          printf("FAILED (engine %i, offset %i, len %i: 0x%08X != 0x%08X)\n",
+            engine, offset, len, crc, expect);
+          result = -1;
+          break;
+        }
+      }
+    }
+    if (result == 0 && mdfs_calc_crc_engine(data, 4096, engine) != 
+      mdfs_calc_crc_engine(data, 4096, MDFS_CRC_ENGINE_BYTEWISE))
+    {
+      printf("FAILED (engine %i, 4096 bytes)\n", engine);
+      result = -1;
+    }
+  }
+  if (result == 0) printf("OK\n");
+  free(data);
+  return result;
+}
+
+int T_mdfs_crc_streaming_chunks_expect_same_as_calc()
+{
+  printf("T_mdfs_crc_streaming_chunks_expect_same_as_calc: ");
+  int result = 0;
+  uint8_t data[1000];
+  int i, chunk;
+  for (i = 0; i < sizeof(data); ++i) data[i] = i * 7;
+  uint32_t expect = mdfs_calc_crc(data, sizeof(data));
+  for (chunk = 1; chunk < 300; chunk += 37)
+  {
+    mdfs_crc_t ctx;
+    mdfs_crc_init(&ctx);
+    for (i = 0; i < sizeof(data); i += chunk)
+    {
+      mdfs_crc_update(&ctx, data + i, i + chunk > sizeof(data) ? sizeof(data) - i : chunk);
+    }
+    if (mdfs_crc_final(&ctx) != expect)
+    {
+      printf("FAILED (chunk %i: 0x%08X != 0x%08X)\n", chunk, mdfs_crc_final(&ctx), expect);
+      result = -1;
+      break;
+    }
+  }
+  if (result == 0) printf("OK\n");
+  return result;
+}
+
+int T_mdfs_crc_combine_expect_same_as_calc()
+{
+  printf("T_mdfs_crc_combine_expect_same_as_calc: ");
+  int result = 0;
+  uint8_t data[1000];
+  int i, split;
+  for (i = 0; i < sizeof(data); ++i) data[i] = i * 13;
+  uint32_t expect = mdfs_calc_crc(data, sizeof(data));
+  for (split = 1; split < sizeof(data); split += 51)
+  {
+    uint32_t crc1 = mdfs_calc_crc(data, split);
+    uint32_t crc2 = mdfs_calc_crc(data + split, sizeof(data) - split);
+    uint32_t crc = mdfs_crc_combine(crc1, crc2, sizeof(data) - split);
+    if (crc != expect)
+    {
+      printf("FAILED (split %i: 0x%08X != 0x%08X)\n", split, crc, expect);
+      result = -1;
+      break;
+    }
+  }
+  if (result == 0 && mdfs_crc_combine(expect, 0, 0) != expect)
+  {
+    printf("FAILED (combine with empty block)\n");
+    result = -1;
+  }
+  if (result == 0) printf("OK\n");
+  return result;
+}
+
+int T_mdfs_verify_mode_fread_intact_expect_no_error()
+{
+  printf("T_mdfs_verify_mode_fread_intact_expect_no_error: ");
+  int result = 0;
+  const char* content = "This is file B with some more text";
+  const void* fs = fs_factory(0xFF, MDFS_BLOCKSIZE, MDFS_BLOCKSIZE+50, "blaat", content);
+  mdfs_t* mdfs = mdfs_init_simple(fs);
+  mdfs_FILE* f = mdfs_fopen(mdfs, "file_B", "rv");
+  char buf[60];
+  while (!mdfs_feof(f)) mdfs_fread(buf, 1, 5, f);
+  if (mdfs_ferror(f))
+  {
+    printf("FAILED (ferror set)\n");
+    result = -1;
+  }
+  int ret_val = mdfs_fclose(f);
+  if (result == 0 && ret_val != 0)
+  {
+    printf("FAILED (fclose returned %i)\n", ret_val);
+    result = -1;
+  }
+  if (result == 0) printf("OK\n");
+  mdfs_deinit(mdfs);
+  free((void*)fs);
+  return result;
+}
+
+int T_mdfs_verify_mode_fgetc_corrupted_expect_error()
+{
+  printf("T_mdfs_verify_mode_fgetc_corrupted_expect_error: ");
+  int result = 0;
+  const char* content = "crc testing text";
+  const void* fs = fs_factory(0xFF, MDFS_BLOCKSIZE, MDFS_BLOCKSIZE+50, content, "this is file B");
+  mdfs_t* mdfs = mdfs_init_simple(fs);
+  mdfs_FILE* f = mdfs_fopen(mdfs, "file_A", "rv");
+  *(uint8_t*)mdfs_get_open_file_location(f) = 1; // corrupt first byte
+  while (mdfs_fgetc(f) != MDFS_EOF)
+  {
+    if (mdfs_ferror(f) && !mdfs_feof(f))
+    {
+      printf("FAILED (ferror set before eof)\n");
+      result = -1;
+      break;
+    }
+  }
+  if (result == 0 && !mdfs_ferror(f))
+  {
+    printf("FAILED (ferror not set at eof)\n");
+    result = -1;
+  }
+  int ret_val = mdfs_fclose(f);
+  if (result == 0 && ret_val != MDFS_EOF)
+  {
+    printf("FAILED (fclose returned %i)\n", ret_val);
+    result = -1;
+  }
+  if (result == 0) printf("OK\n");
+  mdfs_deinit(mdfs);
+  free((void*)fs);
+  return result;
+}
+
+int T_mdfs_verify_mode_partial_read_expect_fclose_error()
+{
+  printf("T_mdfs_verify_mode_partial_read_expect_fclose_error: ");
+  int result = 0;
+  const char* content = "crc testing text";
+  const void* fs = fs_factory(0xFF, MDFS_BLOCKSIZE, MDFS_BLOCKSIZE+50, content, "this is file B");
+  mdfs_t* mdfs = mdfs_init_simple(fs);
+  // Intact file, read half
+  mdfs_FILE* f = mdfs_fopen(mdfs, "file_A", "rv");
+  char buf[8];
+  mdfs_fread(buf, 1, 8, f);
+  int ret_intact = mdfs_fclose(f);
+  // Corrupt last byte, read half
+  f = mdfs_fopen(mdfs, "file_A", "rv");
+  *((uint8_t*)mdfs_get_open_file_location(f) + strlen(content) - 1) = 1;
+  mdfs_fread(buf, 1, 8, f);
+  int ret_corrupt = mdfs_fclose(f);
+  if (ret_intact != 0 || ret_corrupt != MDFS_EOF)
+  {
+    printf("FAILED (fclose returned %i and %i)\n", ret_intact, ret_corrupt);
+    result = -1;
+  }
+  else printf("OK\n");
+  mdfs_deinit(mdfs);
+  free((void*)fs);
+  return result;
+}
+
+int T_mdfs_verify_all_expect_bitmap()
+{
+  printf("T_mdfs_verify_all_expect_bitmap: ");
+  int result = 0;
+  const void* fs = fs_factory(0xFF, MDFS_BLOCKSIZE, MDFS_BLOCKSIZE+50, "this is file A", "this is file B");
+  mdfs_t* mdfs = mdfs_init_simple(fs);
+  uint8_t bitmap = 0;
+  int failed = mdfs_verify_all(mdfs, 4, &bitmap);
+  if (failed != 0 || bitmap != 0x03)
+  {
+    printf("FAILED (intact: failed %i, bitmap 0x%02X)\n", failed, bitmap);
+    result = -1;
+  }
+  *((uint8_t*)fs + MDFS_BLOCKSIZE + 50) = 'T'; // corrupt file_B
+  failed = mdfs_verify_all(mdfs, 1, &bitmap);
+  if (result == 0 && (failed != 1 || bitmap != 0x01))
+  {
+    printf("FAILED (corrupted: failed %i, bitmap 0x%02X)\n", failed, bitmap);
+    result = -1;
+  }
+  if (result == 0) printf("OK\n");
+  mdfs_deinit(mdfs);
+  free((void*)fs);
+  return result;
+}
+
+int T_mdfs_verify_all_static_expect_bitmap()
+{
+  printf("T_mdfs_verify_all_static_expect_bitmap: ");
+  int result = 0;
+  static uint8_t workspace[MDFS_WORKSPACE_SIZE];
+  uint8_t* fs = (uint8_t*)fs_factory(0xFF, MDFS_BLOCKSIZE, MDFS_BLOCKSIZE+50, "this is file A", "this is file B");
+  mdfs_t* mdfs = mdfs_init_static(fs, workspace, sizeof(workspace));
+  uint8_t bitmap = 0;
+  // Checked on this thread without a chunk list, threads is ignored
+  int failed = mdfs_verify_all(mdfs, 4, &bitmap);
+  if (failed != 0 || bitmap != 0x03)
+  {
+    printf("FAILED (intact: failed %i, bitmap 0x%02X)\n", failed, bitmap);
+    result = -1;
+  }
+  fs[MDFS_BLOCKSIZE] = 'T'; // corrupt file_A
+  failed = mdfs_verify_all(mdfs, 0, &bitmap);
+  if (result == 0 && (failed != 1 || bitmap != 0x02))
+  {
+    printf("FAILED (corrupted: failed %i, bitmap 0x%02X)\n", failed, bitmap);
+    result = -1;
+  }
+  if (result == 0) printf("OK\n");
+  mdfs_deinit(mdfs);
+  free((void*)fs);
+  return result;
+}
+
+int T_mdfs_verify_all_chunked_file_expect_combined_crc()
+{
+  printf("T_mdfs_verify_all_chunked_file_expect_combined_crc: ");
+  int result = 0;
+  uint32_t size = 3 * MDFS_VERIFY_CHUNK + 123;
+  uint8_t* fs = malloc(MDFS_BLOCKSIZE + size);
+  memset(fs, 0xFF, MDFS_BLOCKSIZE);
+  uint32_t i;
+  for (i = 0; i < size; ++i) fs[MDFS_BLOCKSIZE + i] = (uint8_t)(i * 7 + (i >> 12));
+  mdfs_t* mdfs = mdfs_init_simple(fs);
+  mdfs_add_file(mdfs, "big", size);
+  mdfs_update_crc(mdfs, "big");
+  int failed = mdfs_verify_all(mdfs, 3, NULL);
+  // mdfs_set_crc/update_crc don't update the list crc
+  if (failed != 1)
+  {
+    printf("FAILED (intact: failed %i)\n", failed);
+    result = -1;
+  }
+  fs[MDFS_BLOCKSIZE + size - 1] ^= 1;
+  failed = mdfs_verify_all(mdfs, 0, NULL);
+  if (result == 0 && failed != 2)
+  {
+    printf("FAILED (corrupted: failed %i)\n", failed);
+    result = -1;
+  }
+  if (result == 0) printf("OK\n");
+  mdfs_deinit(mdfs);
+  free(fs);
+  return result;
+}
+
 int T_mdfs_crc()
 {
   return 
     T_mdfs_calc_crc_test_text_expect_0x60f44eeb() |
+    T_mdfs_calc_crc_engines_expect_identical() |
+    T_mdfs_crc_streaming_chunks_expect_same_as_calc() |
+    T_mdfs_crc_combine_expect_same_as_calc() |
+    T_mdfs_verify_mode_fread_intact_expect_no_error() |
+    T_mdfs_verify_mode_fgetc_corrupted_expect_error() |
+    T_mdfs_verify_mode_partial_read_expect_fclose_error() |
     T_mdfs_calc_crc_length_0_expect_0xFFFFFFFF() |
     T_mdfs_calc_crc_negative_length_expect_0xFFFFFFFF() |
     T_mdfs_check_crc_test_file_expect_1() |
@@ -1165,7 +3141,10 @@ int T_mdfs_crc()
     T_mdfs_check_crc_corrupted_crc_expect_0() |
     T_mdfs_check_file_list_crc_populated_expect_1() |
     T_mdfs_check_file_list_crc_empty_expect_1() |
-    T_mdfs_check_file_list_crc_after_add_expect_changed();
+    T_mdfs_check_file_list_crc_after_add_expect_changed() |
+    T_mdfs_verify_all_expect_bitmap() |
+    T_mdfs_verify_all_static_expect_bitmap() |
+    T_mdfs_verify_all_chunked_file_expect_combined_crc();
     
 }
 
@@ -1177,8 +3156,11 @@ int main(int argc, char** argv)
   result |= T_mdfs_fopen();
   result |= T_mdfs_add_file();
   result |= T_mdfs_remove_file();
+  result |= T_mdfs_batch();
   result |= T_mdfs_fgetc();
   result |= T_mdfs_fread();
+  result |= T_mdfs_lines();
+  result |= T_mdfs_index();
   result |= T_mdfs_crc();
   printf("\n == %s ==\n", result ? "FAILED" : "PASSED");
   return result;